@@ -545,6 +545,41 @@ gjs_string_to_intarray(JSContext   *context,
     }
 }
 
+/* Fetches element @i of @array, throwing if it can't be retrieved */
+static inline JSBool
+get_array_element(JSContext *context,
+                  JSObject  *array,
+                  unsigned   i,
+                  jsval     *elem_p)
+{
+    *elem_p = JSVAL_VOID;
+    if (!JS_GetElement(context, array, i, elem_p)) {
+        gjs_throw(context, "Missing array element %u", i);
+        return JS_FALSE;
+    }
+    return JS_TRUE;
+}
+
+/* Converts an element to an int, avoiding the generic conversion
+ * for the common case of an int jsval. */
+static inline JSBool
+get_int_element(JSContext *context,
+                jsval      elem,
+                gboolean   is_signed,
+                guint32   *val_p)
+{
+    if (JSVAL_IS_INT(elem)) {
+        *val_p = (guint32) JSVAL_TO_INT(elem);
+        return JS_TRUE;
+    }
+
+    /* do whatever sign extension is appropriate */
+    if (is_signed)
+        return JS_ValueToECMAInt32(context, elem, (gint32 *) val_p);
+    else
+        return JS_ValueToECMAUint32(context, elem, val_p);
+}
+
 static JSBool
 gjs_array_to_intarray(JSContext   *context,
                       jsval        array_value,
@@ -553,55 +588,52 @@ gjs_array_to_intarray(JSContext   *context,
                       unsigned intsize,
                       gboolean is_signed)
 {
-    /* nasty union types in an attempt to unify the various int types */
-    union { guint32 u; gint32 i; } intval;
+    JSObject *array = JSVAL_TO_OBJECT(array_value);
     void *result;
     unsigned i;
 
     /* add one so we're always zero terminated */
     result = g_malloc0((length+1) * intsize);
 
-    for (i = 0; i < length; ++i) {
-        jsval elem;
-        JSBool success;
-
-        elem = JSVAL_VOID;
-        if (!JS_GetElement(context, JSVAL_TO_OBJECT(array_value),
-                           i, &elem)) {
-            g_free(result);
-            gjs_throw(context,
-                      "Missing array element %u",
-                      i);
-            return JS_FALSE;
-        }
-
-        /* do whatever sign extension is appropriate */
-        success = (is_signed) ?
-            JS_ValueToECMAInt32(context, elem, &(intval.i)) :
-            JS_ValueToECMAUint32(context, elem, &(intval.u));
+    /* Note that this is truncating assignment. The switch on the
+     * element size is kept out of the loop. */
+#define FILL_INT_ARRAY(ctype)                                           \
+    for (i = 0; i < length; ++i) {                                      \
+        jsval elem;                                                     \
+        guint32 val;                                                    \
+                                                                        \
+        if (!get_array_element(context, array, i, &elem))               \
+            goto err;                                                   \
+        if (!get_int_element(context, elem, is_signed, &val)) {         \
+            gjs_throw(context, "Invalid element in int array");         \
+            goto err;                                                   \
+        }                                                               \
+        ((ctype*)result)[i] = (ctype) val;                              \
+    }
 
-        if (!success) {
-            g_free(result);
-            gjs_throw(context,
-                      "Invalid element in int array");
-            return JS_FALSE;
-        }
-        /* Note that this is truncating assignment. */
-        switch (intsize) {
-        case 1:
-            ((guint8*)result)[i] = (gint8) intval.u; break;
-        case 2:
-            ((guint16*)result)[i] = (gint16) intval.u; break;
-        case 4:
-            ((guint32*)result)[i] = (gint32) intval.u; break;
-        default:
-            g_assert_not_reached();
-        }
+    switch (intsize) {
+    case 1:
+        FILL_INT_ARRAY(guint8);
+        break;
+    case 2:
+        FILL_INT_ARRAY(guint16);
+        break;
+    case 4:
+        FILL_INT_ARRAY(guint32);
+        break;
+    default:
+        g_assert_not_reached();
     }
 
+#undef FILL_INT_ARRAY
+
     *arr_p = result;
 
     return JS_TRUE;
+
+ err:
+    g_free(result);
+    return JS_FALSE;
 }
 
 static JSBool
@@ -620,11 +652,9 @@ gjs_gtypearray_to_array(JSContext   *context,
         jsval elem;
         GType gtype;
 
-        elem = JSVAL_VOID;
-        if (!JS_GetElement(context, JSVAL_TO_OBJECT(array_value),
-                           i, &elem)) {
+        if (!get_array_element(context, JSVAL_TO_OBJECT(array_value),
+                               i, &elem)) {
             g_free(result);
-            gjs_throw(context, "Missing array element %u", i);
             return JS_FALSE;
         }
 
@@ -648,6 +678,22 @@ gjs_gtypearray_to_array(JSContext   *context,
     return JS_FALSE;
 }
 
+static inline JSBool
+get_number_element(JSContext *context,
+                   jsval      elem,
+                   double    *val_p)
+{
+    if (JSVAL_IS_DOUBLE(elem)) {
+        *val_p = JSVAL_TO_DOUBLE(elem);
+        return JS_TRUE;
+    }
+    if (JSVAL_IS_INT(elem)) {
+        *val_p = JSVAL_TO_INT(elem);
+        return JS_TRUE;
+    }
+    return JS_ValueToNumber(context, elem, val_p);
+}
+
 static JSBool
 gjs_array_to_floatarray(JSContext   *context,
                         jsval        array_value,
@@ -655,50 +701,42 @@ gjs_array_to_floatarray(JSContext   *context,
                         void       **arr_p,
                         gboolean     is_double)
 {
+    JSObject *array = JSVAL_TO_OBJECT(array_value);
     unsigned int i;
     void *result;
 
     /* add one so we're always zero terminated */
     result = g_malloc0((length+1) * (is_double ? sizeof(double) : sizeof(float)));
 
-    for (i = 0; i < length; ++i) {
-        jsval elem;
-        double val;
-        JSBool success;
-
-        elem = JSVAL_VOID;
-        if (!JS_GetElement(context, JSVAL_TO_OBJECT(array_value),
-                           i, &elem)) {
-            g_free(result);
-            gjs_throw(context,
-                      "Missing array element %u",
-                      i);
-            return JS_FALSE;
-        }
-
-        /* do whatever sign extension is appropriate */
-        success = JS_ValueToNumber(context, elem, &val);
+    /* Note that this is truncating assignment for floats. */
+#define FILL_FLOAT_ARRAY(ctype)                                         \
+    for (i = 0; i < length; ++i) {                                      \
+        jsval elem;                                                     \
+        double val;                                                     \
+                                                                        \
+        if (!get_array_element(context, array, i, &elem))               \
+            goto err;                                                   \
+        if (!get_number_element(context, elem, &val)) {                 \
+            gjs_throw(context, "Invalid element in array");             \
+            goto err;                                                   \
+        }                                                               \
+        ((ctype*)result)[i] = (ctype) val;                              \
+    }
 
-        if (!success) {
-            g_free(result);
-            gjs_throw(context,
-                      "Invalid element in array");
-            return JS_FALSE;
-        }
+    if (is_double)
+        FILL_FLOAT_ARRAY(double)
+    else
+        FILL_FLOAT_ARRAY(float)
 
-        /* Note that this is truncating assignment. */
-        if (is_double) {
-            double *darray = (double*)result;
-            darray[i] = val;
-        } else {
-            float *farray = (float*)result;
-            farray[i] = val;
-        }
-    }
+#undef FILL_FLOAT_ARRAY
 
     *arr_p = result;
 
     return JS_TRUE;
+
+ err:
+    g_free(result);
+    return JS_FALSE;
 }
 
 static JSBool
@@ -867,6 +905,105 @@ is_gvalue_flat_array(GITypeInfo *param_info,
     return result;
 }
 
+/* Same as typed_array_to_c_array(), for our own ByteArray class */
+static gboolean
+byte_array_to_c_array(JSContext  *context,
+                      jsval       array_value,
+                      gsize       length,
+                      GITypeTag   element_type,
+                      void      **arr_p)
+{
+    guint8 *data;
+    gsize byte_length;
+
+    if (element_type != GI_TYPE_TAG_UINT8 && element_type != GI_TYPE_TAG_INT8)
+        return FALSE;
+
+    if (!gjs_typecheck_bytearray(context, JSVAL_TO_OBJECT(array_value), FALSE))
+        return FALSE;
+
+    gjs_byte_array_peek_data(context, JSVAL_TO_OBJECT(array_value),
+                             &data, &byte_length);
+    if (byte_length != length)
+        return FALSE;
+
+    /* add one so we're always zero terminated */
+    *arr_p = g_malloc0(length + 1);
+    memcpy(*arr_p, data, length);
+
+    return TRUE;
+}
+
+/* Copies the contents of a JS typed array straight into a new C array,
+ * if the element layout matches @element_type. Returns FALSE without
+ * an exception pending if the value can't be handled this way, in
+ * which case the caller should fall back to converting each element.
+ */
+static gboolean
+typed_array_to_c_array(JSContext  *context,
+                       jsval       array_value,
+                       gsize       length,
+                       GITypeTag   element_type,
+                       void      **arr_p)
+{
+    GjsTypedArrayType typed_type;
+    void *data;
+    guint32 typed_length;
+    gsize element_size;
+
+    if (!gjs_typed_array_peek_data(context, JSVAL_TO_OBJECT(array_value),
+                                   &typed_type, &data, &typed_length))
+        return FALSE;
+
+    if (typed_length != length)
+        return FALSE;
+
+    /* Signedness doesn't matter here; a plain JS array would be
+     * converted with truncating assignment too. */
+    switch (element_type) {
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_UINT8:
+        if (typed_type != GJS_TYPED_ARRAY_INT8 &&
+            typed_type != GJS_TYPED_ARRAY_UINT8 &&
+            typed_type != GJS_TYPED_ARRAY_UINT8_CLAMPED)
+            return FALSE;
+        element_size = 1;
+        break;
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_UINT16:
+        if (typed_type != GJS_TYPED_ARRAY_INT16 &&
+            typed_type != GJS_TYPED_ARRAY_UINT16)
+            return FALSE;
+        element_size = 2;
+        break;
+    case GI_TYPE_TAG_INT32:
+    case GI_TYPE_TAG_UINT32:
+        if (typed_type != GJS_TYPED_ARRAY_INT32 &&
+            typed_type != GJS_TYPED_ARRAY_UINT32)
+            return FALSE;
+        element_size = 4;
+        break;
+    case GI_TYPE_TAG_FLOAT:
+        if (typed_type != GJS_TYPED_ARRAY_FLOAT32)
+            return FALSE;
+        element_size = sizeof(float);
+        break;
+    case GI_TYPE_TAG_DOUBLE:
+        if (typed_type != GJS_TYPED_ARRAY_FLOAT64)
+            return FALSE;
+        element_size = sizeof(double);
+        break;
+    default:
+        return FALSE;
+    }
+
+    /* add one so we're always zero terminated */
+    *arr_p = g_malloc0((length + 1) * element_size);
+    memcpy(*arr_p, data, length * element_size);
+
+    return TRUE;
+}
+
 static JSBool
 gjs_array_to_array(JSContext   *context,
                    jsval        array_value,
@@ -892,6 +1029,13 @@ gjs_array_to_array(JSContext   *context,
         g_base_info_unref(interface_info);
     }
 
+    /* Typed arrays of the right width can be copied in one go */
+    if (typed_array_to_c_array(context, array_value, length,
+                               element_type, arr_p) ||
+        byte_array_to_c_array(context, array_value, length,
+                              element_type, arr_p))
+        return JS_TRUE;
+
     switch (element_type) {
     case GI_TYPE_TAG_UTF8:
         return gjs_array_to_strv (context, array_value, length, arr_p);
@@ -1423,10 +1567,18 @@ gjs_value_to_g_argument(JSContext      *context,
                     /* We special case Closures later, so skip them here */
                     !g_type_is_a(gtype, G_TYPE_CLOSURE)) {
                     JSObject *obj = JSVAL_TO_OBJECT(value);
+                    gboolean bytes_ref_taken = FALSE;
 
                     if (g_type_is_a(gtype, G_TYPE_BYTES)
                         && gjs_typecheck_bytearray(context, obj, FALSE)) {
+                        /* Always a new reference: the ByteArray may be
+                         * written to, or collected, while C holds on to
+                         * it. For transfer none, gjs_invoke_c_function()
+                         * drops it after the call; other callers (e.g.
+                         * callback return values) can't tell and leak it.
+                         */
                         arg->v_pointer = gjs_byte_array_get_bytes(context, obj);
+                        bytes_ref_taken = TRUE;
                     } else if (g_type_is_a(gtype, G_TYPE_ERROR)) {
                         if (!gjs_typecheck_gerror(context, JSVAL_TO_OBJECT(value), JS_TRUE)) {
                             arg->v_pointer = NULL;
@@ -1447,7 +1599,7 @@ gjs_value_to_g_argument(JSContext      *context,
                         }
                     }
 
-                    if (!wrong && transfer != GI_TRANSFER_NOTHING) {
+                    if (!wrong && transfer != GI_TRANSFER_NOTHING && !bytes_ref_taken) {
                         if (g_type_is_a(gtype, G_TYPE_BOXED))
                             arg->v_pointer = g_boxed_copy (gtype, arg->v_pointer);
                         else if (g_type_is_a(gtype, G_TYPE_VARIANT))
@@ -1693,7 +1845,14 @@ gjs_value_to_g_argument(JSContext      *context,
                     break;
                 } else if (array_type == GI_ARRAY_TYPE_C && 
                            (element_type == GI_TYPE_TAG_UINT8 || element_type == GI_TYPE_TAG_INT8)) {
-                    gjs_byte_array_peek_data(context, bytearray_obj, (guint8**) &data, &length);
+                    guint8 *bytes;
+
+                    /* The C array is freed after the call (or owned by
+                     * the callee), so it can't share the ByteArray's
+                     * data. Add one so we're always zero terminated. */
+                    gjs_byte_array_peek_data(context, bytearray_obj, &bytes, &length);
+                    data = g_malloc0(length + 1);
+                    memcpy(data, bytes, length);
                     bytearray_fastpath = TRUE;
                 } else {
                     /* Fall through, !handled */
@@ -2014,6 +2173,56 @@ gjs_array_from_g_list (JSContext  *context,
     return result;
 }
 
+/* Returning numeric C arrays as typed arrays is opt-in, since unlike
+ * JS arrays they can't grow and silently wrap out of range values.
+ */
+static gboolean
+return_typed_arrays(void)
+{
+    static gsize init = 0;
+    static gboolean enabled = FALSE;
+
+    if (g_once_init_enter(&init)) {
+        enabled = g_getenv("GJS_RETURN_TYPED_ARRAYS") != NULL;
+        g_once_init_leave(&init, 1);
+    }
+
+    return enabled;
+}
+
+static gboolean
+typed_array_type_for_tag(GITypeTag          element_type,
+                         GjsTypedArrayType *typed_type_p)
+{
+    switch (element_type) {
+    case GI_TYPE_TAG_INT8:
+        *typed_type_p = GJS_TYPED_ARRAY_INT8;
+        return TRUE;
+    case GI_TYPE_TAG_INT16:
+        *typed_type_p = GJS_TYPED_ARRAY_INT16;
+        return TRUE;
+    case GI_TYPE_TAG_UINT16:
+        *typed_type_p = GJS_TYPED_ARRAY_UINT16;
+        return TRUE;
+    case GI_TYPE_TAG_INT32:
+        *typed_type_p = GJS_TYPED_ARRAY_INT32;
+        return TRUE;
+    case GI_TYPE_TAG_UINT32:
+        *typed_type_p = GJS_TYPED_ARRAY_UINT32;
+        return TRUE;
+    case GI_TYPE_TAG_FLOAT:
+        *typed_type_p = GJS_TYPED_ARRAY_FLOAT32;
+        return TRUE;
+    case GI_TYPE_TAG_DOUBLE:
+        *typed_type_p = GJS_TYPED_ARRAY_FLOAT64;
+        return TRUE;
+    default:
+        /* uint8 already becomes a ByteArray, and 64-bit integers
+         * don't have a typed array type */
+        return FALSE;
+    }
+}
+
 static JSBool
 gjs_array_from_carray_internal (JSContext  *context,
                                 jsval      *value_p,
@@ -2049,6 +2258,18 @@ gjs_array_from_carray_internal (JSContext  *context,
         return JS_TRUE;
     } 
 
+    if (return_typed_arrays()) {
+        GjsTypedArrayType typed_type;
+
+        if (typed_array_type_for_tag(element_type, &typed_type)) {
+            obj = gjs_typed_array_new(context, typed_type, array, length);
+            if (obj == NULL)
+                return JS_FALSE;
+            *value_p = OBJECT_TO_JSVAL(obj);
+            return JS_TRUE;
+        }
+    }
+
     obj = JS_NewArrayObject(context, 0, NULL);
     if (obj == NULL)
       return JS_FALSE;
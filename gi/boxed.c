@@ -40,6 +40,40 @@
 
 #include <girepository.h>
 
+/* Everything needed to access a field, computed once when the class is
+ * defined so that the getter and setter don't have to go back to the
+ * typelib. Fields of plain numeric types are loaded and stored directly
+ * at their offset; anything else goes through GArgument conversion.
+ */
+typedef struct {
+    GIFieldInfo *info;
+    GITypeInfo *type_info;
+    GIBaseInfo *interface_info; /* set for nested (non-pointer) structs */
+    JSObject *nested_proto;     /* prototype for interface_info, looked up
+                                   on first access */
+    int offset;
+    GITypeTag tag;
+    guint8 size;                /* 0 if the field can't be accessed directly */
+
+    guint readable : 1;
+    guint writable : 1;
+    guint nested_is_simple : 1;
+} BoxedField;
+
+/* Maps the ids of field names to fields, for constructing from a hash of
+ * field values. Shared by the prototype and its instances, like the
+ * field table.
+ */
+typedef struct {
+    GHashTable *by_id;
+    int n_fields;
+
+    /* the ids seen in the last hash, in order */
+    int n_last;
+    jsid *last_ids;
+    BoxedField **last_fields;
+} BoxedFieldMap;
+
 typedef struct {
     /* prototype info */
     GIBoxedInfo *info;
@@ -48,27 +82,71 @@ typedef struct {
     jsid zero_args_constructor_name;
     gint default_constructor; /* -1 if none */
     jsid default_constructor_name;
+    BoxedField *fields; /* owned by the prototype, shared with instances */
+    int n_fields;
+    BoxedFieldMap *field_map; /* likewise */
+    gsize inline_size; /* size of the struct if instances can store it
+                          inline, 0 otherwise */
 
     /* instance info */
     void *gboxed; /* NULL if we are the prototype and not an instance */
+    JSObject **nested_wrappers; /* wrappers handed out for nested struct
+                                   fields, indexed like fields */
 
+    guint is_prototype : 1;
     guint can_allocate_directly : 1;
     guint allocated_directly : 1;
     guint not_owning_gboxed : 1; /* if set, the JS wrapper does not own
                                     the reference to the C gboxed */
+    guint has_inline_storage : 1;
 } Boxed;
 
+/* Small structs that we allocate ourselves are stored right after the
+ * Boxed private rather than in a block of their own. That saves an
+ * allocation per wrapper and keeps the struct next to the private. The
+ * offset keeps the struct aligned like a slice allocation would be.
+ */
+#define BOXED_INLINE_MAX_SIZE 64
+#define BOXED_INLINE_OFFSET ((sizeof(Boxed) + 15) & ~(gsize) 15)
+
 static gboolean struct_is_simple(GIStructInfo *info);
 
 static JSBool boxed_set_field_from_value(JSContext   *context,
                                          Boxed       *priv,
-                                         GIFieldInfo *field_info,
+                                         BoxedField  *field,
                                          jsval        value);
 
 static struct JSClass gjs_boxed_class;
 
 GJS_DEFINE_PRIV_FROM_JS(Boxed, gjs_boxed_class)
 
+static void
+boxed_free_fields(Boxed *priv)
+{
+    int i;
+
+    for (i = 0; i < priv->n_fields; i++) {
+        BoxedField *field = &priv->fields[i];
+
+        g_base_info_unref((GIBaseInfo *)field->info);
+        g_base_info_unref((GIBaseInfo *)field->type_info);
+        if (field->interface_info)
+            g_base_info_unref(field->interface_info);
+    }
+
+    g_free(priv->fields);
+    priv->fields = NULL;
+    priv->n_fields = 0;
+
+    if (priv->field_map) {
+        g_hash_table_destroy(priv->field_map->by_id);
+        g_free(priv->field_map->last_ids);
+        g_free(priv->field_map->last_fields);
+        g_slice_free(BoxedFieldMap, priv->field_map);
+        priv->field_map = NULL;
+    }
+}
+
 static JSBool
 gjs_define_static_methods(JSContext    *context,
                           JSObject     *constructor,
@@ -215,12 +293,42 @@ boxed_get_copy_source(JSContext *context,
     return JS_TRUE;
 }
 
+/* Creates the private of an instance from the private of its
+ * prototype. Pass inline_storage if the struct is going to be allocated
+ * with boxed_new_direct().
+ */
+static Boxed *
+boxed_new_instance_private(Boxed    *proto_priv,
+                           gboolean  inline_storage)
+{
+    Boxed *priv;
+
+    if (inline_storage && proto_priv->inline_size > 0) {
+        priv = g_slice_alloc0(BOXED_INLINE_OFFSET + proto_priv->inline_size);
+        *priv = *proto_priv;
+        priv->has_inline_storage = TRUE;
+    } else {
+        priv = g_slice_new0(Boxed);
+        *priv = *proto_priv;
+    }
+
+    priv->is_prototype = FALSE;
+    g_base_info_ref( (GIBaseInfo*) priv->info);
+
+    GJS_INC_COUNTER(boxed);
+
+    return priv;
+}
+
 static void
 boxed_new_direct(Boxed       *priv)
 {
     g_assert(priv->can_allocate_directly);
 
-    priv->gboxed = g_slice_alloc0(g_struct_info_get_size (priv->info));
+    if (priv->has_inline_storage)
+        priv->gboxed = ((char *) priv) + BOXED_INLINE_OFFSET;
+    else
+        priv->gboxed = gjs_boxed_payload_alloc0(g_struct_info_get_size (priv->info));
     priv->allocated_directly = TRUE;
 
     gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
@@ -228,27 +336,34 @@ boxed_new_direct(Boxed       *priv)
                         g_base_info_get_name ((GIBaseInfo *)priv->info));
 }
 
-/* When initializing a boxed object from a hash of properties, we don't want
- * to do n O(n) lookups, so put temporarily put the fields into a hash table
- * for fast lookup. We could also do this ahead of time and store it on proto->priv.
+/* Looks up a field from the id of a property in a hash of field values.
+ * Field names are interned when the class is defined, so a property id
+ * from any object is the same jsid and the lookup doesn't need the
+ * name.
  */
-static GHashTable *
-get_field_map(GIStructInfo *struct_info)
+static BoxedField *
+lookup_field_by_id(BoxedFieldMap *map,
+                   int            position,
+                   jsid           id)
 {
-    GHashTable *result;
-    int n_fields;
-    int i;
+    BoxedField *field;
 
-    result = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                   NULL, (GDestroyNotify)g_base_info_unref);
-    n_fields = g_struct_info_get_n_fields(struct_info);
+    /* Objects created from the same literal have their properties in the
+     * same order, so the ids can be checked against the previous hash
+     * before hashing them.
+     */
+    if (position < map->n_last && JSID_BITS(map->last_ids[position]) == JSID_BITS(id))
+        return map->last_fields[position];
 
-    for (i = 0; i < n_fields; i++) {
-        GIFieldInfo *field_info = g_struct_info_get_field(struct_info, i);
-        g_hash_table_insert(result, (char *)g_base_info_get_name((GIBaseInfo *)field_info), field_info);
+    field = g_hash_table_lookup(map->by_id, GSIZE_TO_POINTER(JSID_BITS(id)));
+
+    if (field != NULL && position < map->n_fields) {
+        map->last_ids[position] = id;
+        map->last_fields[position] = field;
+        map->n_last = MAX(map->n_last, position + 1);
     }
 
-    return result;
+    return field;
 }
 
 /* Initialize a newly created Boxed from an object that is a "hash" of
@@ -264,10 +379,7 @@ boxed_init_from_props(JSContext   *context,
     JSObject *props;
     JSObject *iter;
     jsid prop_id;
-    GHashTable *field_map;
-    gboolean success;
-
-    success = FALSE;
+    int position;
 
     if (!JSVAL_IS_OBJECT(props_value)) {
         gjs_throw(context, "argument should be a hash with fields to set");
@@ -282,48 +394,39 @@ boxed_init_from_props(JSContext   *context,
         return JS_FALSE;
     }
 
-    field_map = get_field_map(priv->info);
-
     prop_id = JSID_VOID;
     if (!JS_NextProperty(context, iter, &prop_id))
-        goto out;
+        return JS_FALSE;
 
-    while (!JSID_IS_VOID(prop_id)) {
-        GIFieldInfo *field_info;
-        char *name;
+    for (position = 0; !JSID_IS_VOID(prop_id); position++) {
+        BoxedField *field;
         jsval value;
 
-        if (!gjs_get_string_id(context, prop_id, &name))
-            goto out;
+        field = lookup_field_by_id(priv->field_map, position, prop_id);
+        if (field == NULL) {
+            char *name;
+
+            if (!gjs_get_string_id(context, prop_id, &name))
+                return JS_FALSE;
 
-        field_info = g_hash_table_lookup(field_map, name);
-        if (field_info == NULL) {
             gjs_throw(context, "No field %s on boxed type %s",
                       name, g_base_info_get_name((GIBaseInfo *)priv->info));
             g_free(name);
-            goto out;
+            return JS_FALSE;
         }
 
-        if (!gjs_object_require_property(context, props, "property list", prop_id, &value)) {
-            g_free(name);
-            goto out;
-        }
-        g_free(name);
+        if (!gjs_object_require_property(context, props, "property list", prop_id, &value))
+            return JS_FALSE;
 
-        if (!boxed_set_field_from_value(context, priv, field_info, value))
-            goto out;
+        if (!boxed_set_field_from_value(context, priv, field, value))
+            return JS_FALSE;
 
         prop_id = JSID_VOID;
         if (!JS_NextProperty(context, iter, &prop_id))
-            goto out;
+            return JS_FALSE;
     }
 
-    success = TRUE;
-
- out:
-    g_hash_table_destroy(field_map);
-
-    return success;
+    return JS_TRUE;
 }
 
 static JSBool
@@ -434,21 +537,13 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
     Boxed *proto_priv;
     JSObject *proto;
     Boxed *source_priv;
+    gboolean is_copy, inline_storage;
     jsval actual_rval;
     JSBool retval;
 
     GJS_NATIVE_CONSTRUCTOR_PRELUDE(boxed);
 
-    priv = g_slice_new0(Boxed);
-
-    GJS_INC_COUNTER(boxed);
-
     g_assert(priv_from_js(context, object) == NULL);
-    JS_SetPrivate(object, priv);
-
-    gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
-                        "boxed constructor, obj %p priv %p",
-                        object, priv);
 
     proto = JS_GetPrototype(object);
     gjs_debug_lifecycle(GJS_DEBUG_GBOXED, "boxed instance __proto__ is %p", proto);
@@ -463,12 +558,24 @@ GJS_NATIVE_CONSTRUCTOR_DECLARE(boxed)
         return JS_FALSE;
     }
 
-    *priv = *proto_priv;
-    g_base_info_ref( (GIBaseInfo*) priv->info);
+    /* Only reserve inline storage if the struct will be allocated
+     * directly: boxed_new() prefers a zero-args constructor, and boxed
+     * types are copied with g_boxed_copy().
+     */
+    is_copy = argc == 1 &&
+        boxed_get_copy_source(context, proto_priv, argv[0], &source_priv);
+    inline_storage = proto_priv->zero_args_constructor < 0 &&
+        !(is_copy && g_type_is_a (proto_priv->gtype, G_TYPE_BOXED));
+
+    priv = boxed_new_instance_private(proto_priv, inline_storage);
+    JS_SetPrivate(object, priv);
+
+    gjs_debug_lifecycle(GJS_DEBUG_GBOXED,
+                        "boxed constructor, obj %p priv %p",
+                        object, priv);
 
     /* Short-circuit copy-construction in the case where we can use g_boxed_copy or memcpy */
-    if (argc == 1 &&
-        boxed_get_copy_source(context, priv, argv[0], &source_priv)) {
+    if (is_copy) {
 
         if (g_type_is_a (priv->gtype, G_TYPE_BOXED)) {
             priv->gboxed = g_boxed_copy(priv->gtype, source_priv->gboxed);
@@ -521,7 +628,8 @@ boxed_finalize(JSFreeOp *fop,
 
     if (priv->gboxed && !priv->not_owning_gboxed) {
         if (priv->allocated_directly) {
-            g_slice_free1(g_struct_info_get_size (priv->info), priv->gboxed);
+            if (!priv->has_inline_storage)
+                gjs_boxed_payload_free(g_struct_info_get_size (priv->info), priv->gboxed);
         } else {
             if (g_type_is_a (priv->gtype, G_TYPE_BOXED))
                 g_boxed_free (priv->gtype,  priv->gboxed);
@@ -534,69 +642,94 @@ boxed_finalize(JSFreeOp *fop,
         priv->gboxed = NULL;
     }
 
+    g_free(priv->nested_wrappers);
+
+    if (priv->is_prototype)
+        boxed_free_fields(priv);
+
     if (priv->info) {
         g_base_info_unref( (GIBaseInfo*) priv->info);
         priv->info = NULL;
     }
 
     GJS_DEC_COUNTER(boxed);
-    g_slice_free(Boxed, priv);
+    if (priv->has_inline_storage)
+        g_slice_free1(BOXED_INLINE_OFFSET + priv->inline_size, priv);
+    else
+        g_slice_free(Boxed, priv);
 }
 
-static GIFieldInfo *
-get_field_info (JSContext *context,
-                Boxed     *priv,
-                jsid       id)
+static BoxedField *
+get_field (JSContext *context,
+           Boxed     *priv,
+           jsid       id)
 {
     int field_index;
-    jsval id_val;
-
-    if (!JS_IdToValue(context, id, &id_val))
-        return JS_FALSE;
 
-    if (!JSVAL_IS_INT (id_val)) {
+    if (!JSID_IS_INT (id)) {
         gjs_throw(context, "Field index for %s is not an integer",
                   g_base_info_get_name ((GIBaseInfo *)priv->info));
         return NULL;
     }
 
-    field_index = JSVAL_TO_INT(id_val);
-    if (field_index < 0 || field_index >= g_struct_info_get_n_fields (priv->info)) {
+    field_index = JSID_TO_INT(id);
+    if (field_index < 0 || field_index >= priv->n_fields) {
         gjs_throw(context, "Bad field index %d for %s", field_index,
                   g_base_info_get_name ((GIBaseInfo *)priv->info));
         return NULL;
     }
 
-    return g_struct_info_get_field (priv->info, field_index);
+    return &priv->fields[field_index];
+}
+
+static JSObject *
+get_nested_prototype (JSContext  *context,
+                      BoxedField *field)
+{
+    /* The prototype is kept alive by the trace hook of the prototype
+     * owning the field table */
+    if (field->nested_proto == NULL)
+        field->nested_proto = gjs_lookup_generic_prototype(context,
+                                                           (GIBoxedInfo*) field->interface_info);
+
+    return field->nested_proto;
 }
 
 static JSBool
 get_nested_interface_object (JSContext   *context,
                              JSObject    *parent_obj,
                              Boxed       *parent_priv,
-                             GIFieldInfo *field_info,
-                             GITypeInfo  *type_info,
-                             GIBaseInfo  *interface_info,
+                             BoxedField  *field,
                              jsval       *value)
 {
     JSObject *obj;
     JSObject *proto;
-    int offset;
+    int field_index;
     Boxed *priv;
     Boxed *proto_priv;
 
-    if (!struct_is_simple ((GIStructInfo *)interface_info)) {
+    if (!field->nested_is_simple) {
         gjs_throw(context, "Reading field %s.%s is not supported",
                   g_base_info_get_name ((GIBaseInfo *)parent_priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
 
         return JS_FALSE;
     }
 
-    proto = gjs_lookup_generic_prototype(context, (GIBoxedInfo*) interface_info);
-    proto_priv = priv_from_js(context, proto);
+    /* The wrapper only points into the memory of the parent, so there is
+     * no need to create more than one per field.
+     */
+    field_index = field - parent_priv->fields;
+    if (parent_priv->nested_wrappers != NULL &&
+        parent_priv->nested_wrappers[field_index] != NULL) {
+        *value = OBJECT_TO_JSVAL(parent_priv->nested_wrappers[field_index]);
+        return JS_TRUE;
+    }
 
-    offset = g_field_info_get_offset (field_info);
+    proto = get_nested_prototype(context, field);
+    if (proto == NULL)
+        return JS_FALSE;
+    proto_priv = priv_from_js(context, proto);
 
     obj = JS_NewObjectWithGivenProto(context,
                                      JS_GetClass(proto), proto,
@@ -605,16 +738,11 @@ get_nested_interface_object (JSContext   *context,
     if (obj == NULL)
         return JS_FALSE;
 
-    GJS_INC_COUNTER(boxed);
-    priv = g_slice_new0(Boxed);
+    priv = boxed_new_instance_private(proto_priv, FALSE);
     JS_SetPrivate(obj, priv);
-    priv->info = (GIBoxedInfo*) interface_info;
-    g_base_info_ref( (GIBaseInfo*) priv->info);
-    priv->gtype = g_registered_type_info_get_g_type ((GIRegisteredTypeInfo*) interface_info);
-    priv->can_allocate_directly = proto_priv->can_allocate_directly;
 
     /* A structure nested inside a parent object; doesn't have an independent allocation */
-    priv->gboxed = ((char *)parent_priv->gboxed) + offset;
+    priv->gboxed = ((char *)parent_priv->gboxed) + field->offset;
     priv->not_owning_gboxed = TRUE;
 
     /* We never actually read the reserved slot, but we put the parent object
@@ -623,10 +751,132 @@ get_nested_interface_object (JSContext   *context,
     JS_SetReservedSlot(obj, 0,
                        OBJECT_TO_JSVAL (parent_obj));
 
+    if (parent_priv->nested_wrappers == NULL)
+        parent_priv->nested_wrappers = g_new0(JSObject *, parent_priv->n_fields);
+    parent_priv->nested_wrappers[field_index] = obj;
+
     *value = OBJECT_TO_JSVAL(obj);
     return JS_TRUE;
 }
 
+/* Loads a field for which field->size is set. The value is copied into
+ * a GArgument first, since fields of packed structs may be unaligned.
+ */
+static JSBool
+get_field_direct (JSContext  *context,
+                  BoxedField *field,
+                  void       *mem,
+                  jsval      *value)
+{
+    GArgument arg;
+
+    memcpy(&arg, mem, field->size);
+
+    switch (field->tag) {
+    case GI_TYPE_TAG_BOOLEAN:
+        *value = BOOLEAN_TO_JSVAL(!!arg.v_boolean);
+        return JS_TRUE;
+    case GI_TYPE_TAG_INT8:
+        *value = INT_TO_JSVAL(arg.v_int8);
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT8:
+        *value = INT_TO_JSVAL(arg.v_uint8);
+        return JS_TRUE;
+    case GI_TYPE_TAG_INT16:
+        *value = INT_TO_JSVAL(arg.v_int16);
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT16:
+        *value = INT_TO_JSVAL(arg.v_uint16);
+        return JS_TRUE;
+    case GI_TYPE_TAG_INT32:
+        *value = INT_TO_JSVAL(arg.v_int32);
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT32:
+        return JS_NewNumberValue(context, arg.v_uint32, value);
+    case GI_TYPE_TAG_INT64:
+        return JS_NewNumberValue(context, arg.v_int64, value);
+    case GI_TYPE_TAG_UINT64:
+        return JS_NewNumberValue(context, arg.v_uint64, value);
+    case GI_TYPE_TAG_FLOAT:
+        return JS_NewNumberValue(context, arg.v_float, value);
+    case GI_TYPE_TAG_DOUBLE:
+        return JS_NewNumberValue(context, arg.v_double, value);
+    default:
+        g_assert_not_reached();
+        return JS_FALSE;
+    }
+}
+
+/* Converts the common cases of storing an int into an integer field or
+ * a number into a floating point field without going through
+ * gjs_value_to_g_argument(). Returns FALSE if the value needs the full
+ * conversion, including when it would be out of range.
+ */
+static gboolean
+set_field_direct (BoxedField *field,
+                  jsval       value,
+                  GArgument  *arg)
+{
+    if (JSVAL_IS_INT(value)) {
+        gint32 i = JSVAL_TO_INT(value);
+
+        switch (field->tag) {
+        case GI_TYPE_TAG_INT8:
+            if (i < G_MININT8 || i > G_MAXINT8)
+                return FALSE;
+            arg->v_int8 = i;
+            return TRUE;
+        case GI_TYPE_TAG_UINT8:
+            if (i < 0 || i > G_MAXUINT8)
+                return FALSE;
+            arg->v_uint8 = i;
+            return TRUE;
+        case GI_TYPE_TAG_INT16:
+            if (i < G_MININT16 || i > G_MAXINT16)
+                return FALSE;
+            arg->v_int16 = i;
+            return TRUE;
+        case GI_TYPE_TAG_UINT16:
+            if (i < 0 || i > G_MAXUINT16)
+                return FALSE;
+            arg->v_uint16 = i;
+            return TRUE;
+        case GI_TYPE_TAG_INT32:
+            arg->v_int32 = i;
+            return TRUE;
+        case GI_TYPE_TAG_UINT32:
+            if (i < 0)
+                return FALSE;
+            arg->v_uint32 = i;
+            return TRUE;
+        case GI_TYPE_TAG_INT64:
+            arg->v_int64 = i;
+            return TRUE;
+        case GI_TYPE_TAG_UINT64:
+            if (i < 0)
+                return FALSE;
+            arg->v_uint64 = i;
+            return TRUE;
+        case GI_TYPE_TAG_FLOAT:
+            arg->v_float = i;
+            return TRUE;
+        case GI_TYPE_TAG_DOUBLE:
+            arg->v_double = i;
+            return TRUE;
+        default:
+            return FALSE;
+        }
+    } else if (JSVAL_IS_DOUBLE(value) && field->tag == GI_TYPE_TAG_DOUBLE) {
+        arg->v_double = JSVAL_TO_DOUBLE(value);
+        return TRUE;
+    } else if (JSVAL_IS_BOOLEAN(value) && field->tag == GI_TYPE_TAG_BOOLEAN) {
+        arg->v_boolean = JSVAL_TO_BOOLEAN(value);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 static JSBool
 boxed_field_getter (JSContext            *context,
                     JSHandleObject        obj,
@@ -634,92 +884,67 @@ boxed_field_getter (JSContext            *context,
                     JSMutableHandleValue  value)
 {
     Boxed *priv;
-    GIFieldInfo *field_info;
-    GITypeInfo *type_info;
+    BoxedField *field;
     GArgument arg;
-    gboolean success = FALSE;
 
     priv = priv_from_js(context, *obj._);
     if (!priv)
         return JS_FALSE;
 
-    field_info = get_field_info(context, priv, *id._);
-    if (!field_info)
+    field = get_field(context, priv, *id._);
+    if (!field)
         return JS_FALSE;
 
-    type_info = g_field_info_get_type (field_info);
-
     if (priv->gboxed == NULL) { /* direct access to proto field */
         gjs_throw(context, "Can't get field %s.%s from a prototype",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+        return JS_FALSE;
     }
 
-    if (!g_type_info_is_pointer (type_info) &&
-        g_type_info_get_tag (type_info) == GI_TYPE_TAG_INTERFACE) {
-
-        GIBaseInfo *interface_info = g_type_info_get_interface(type_info);
-
-        if (g_base_info_get_type (interface_info) == GI_INFO_TYPE_STRUCT ||
-            g_base_info_get_type (interface_info) == GI_INFO_TYPE_BOXED) {
-
-            success = get_nested_interface_object (context, *obj._, priv,
-                                                   field_info, type_info, interface_info,
-                                                   value._);
-
-            g_base_info_unref ((GIBaseInfo *)interface_info);
+    if (field->size != 0 && field->readable)
+        return get_field_direct(context, field,
+                                ((char *)priv->gboxed) + field->offset,
+                                value._);
 
-            goto out;
-        }
-
-        g_base_info_unref ((GIBaseInfo *)interface_info);
-    }
+    if (field->interface_info != NULL)
+        return get_nested_interface_object (context, *obj._, priv,
+                                            field, value._);
 
-    if (!g_field_info_get_field (field_info, priv->gboxed, &arg)) {
+    if (!g_field_info_get_field (field->info, priv->gboxed, &arg)) {
         gjs_throw(context, "Reading field %s.%s is not supported",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+        return JS_FALSE;
     }
 
-    if (!gjs_value_from_g_argument (context, value._,
-                                    type_info,
-                                    &arg,
-                                    TRUE))
-        goto out;
-
-    success = TRUE;
-
-out:
-    g_base_info_unref ((GIBaseInfo *)field_info);
-    g_base_info_unref ((GIBaseInfo *)type_info);
-
-    return success;
+    return gjs_value_from_g_argument (context, value._,
+                                      field->type_info,
+                                      &arg,
+                                      TRUE);
 }
 
 static JSBool
 set_nested_interface_object (JSContext   *context,
                              Boxed       *parent_priv,
-                             GIFieldInfo *field_info,
-                             GITypeInfo  *type_info,
-                             GIBaseInfo  *interface_info,
+                             BoxedField  *field,
                              jsval        value)
 {
     JSObject *proto;
-    int offset;
     Boxed *proto_priv;
     Boxed *source_priv;
 
-    if (!struct_is_simple ((GIStructInfo *)interface_info)) {
+    if (!field->nested_is_simple) {
         gjs_throw(context, "Writing field %s.%s is not supported",
                   g_base_info_get_name ((GIBaseInfo *)parent_priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
 
         return JS_FALSE;
     }
 
-    proto = gjs_lookup_generic_prototype(context, (GIBoxedInfo*) interface_info);
+    proto = get_nested_prototype(context, field);
+    if (proto == NULL)
+        return JS_FALSE;
     proto_priv = priv_from_js(context, proto);
 
     /* If we can't directly copy from the source object we need
@@ -735,8 +960,7 @@ set_nested_interface_object (JSContext   *context,
             return JS_FALSE;
     }
 
-    offset = g_field_info_get_offset (field_info);
-    memcpy(((char *)parent_priv->gboxed) + offset,
+    memcpy(((char *)parent_priv->gboxed) + field->offset,
            source_priv->gboxed,
            g_struct_info_get_size (source_priv->info));
 
@@ -746,40 +970,35 @@ set_nested_interface_object (JSContext   *context,
 static JSBool
 boxed_set_field_from_value(JSContext   *context,
                            Boxed       *priv,
-                           GIFieldInfo *field_info,
+                           BoxedField  *field,
                            jsval        value)
 {
-    GITypeInfo *type_info;
     GArgument arg;
     gboolean success = FALSE;
     gboolean need_release = FALSE;
 
-    type_info = g_field_info_get_type (field_info);
-
-    if (!g_type_info_is_pointer (type_info) &&
-        g_type_info_get_tag (type_info) == GI_TYPE_TAG_INTERFACE) {
-
-        GIBaseInfo *interface_info = g_type_info_get_interface(type_info);
-
-        if (g_base_info_get_type (interface_info) == GI_INFO_TYPE_STRUCT ||
-            g_base_info_get_type (interface_info) == GI_INFO_TYPE_BOXED) {
-
-            success = set_nested_interface_object (context, priv,
-                                                   field_info, type_info,
-                                                   interface_info, value);
-
-            g_base_info_unref ((GIBaseInfo *)interface_info);
-
-            goto out;
-        }
-
-        g_base_info_unref ((GIBaseInfo *)interface_info);
+    if (field->size != 0 && field->writable) {
+        /* Plain numbers don't need to be released, so there is nothing
+         * to clean up in either case */
+        if (!set_field_direct(field, value, &arg) &&
+            !gjs_value_to_g_argument(context, value,
+                                     field->type_info,
+                                     g_base_info_get_name ((GIBaseInfo *)field->info),
+                                     GJS_ARGUMENT_FIELD,
+                                     GI_TRANSFER_NOTHING,
+                                     TRUE, &arg))
+            return JS_FALSE;
 
+        memcpy(((char *)priv->gboxed) + field->offset, &arg, field->size);
+        return JS_TRUE;
     }
 
+    if (field->interface_info != NULL)
+        return set_nested_interface_object (context, priv, field, value);
+
     if (!gjs_value_to_g_argument(context, value,
-                                 type_info,
-                                 g_base_info_get_name ((GIBaseInfo *)field_info),
+                                 field->type_info,
+                                 g_base_info_get_name ((GIBaseInfo *)field->info),
                                  GJS_ARGUMENT_FIELD,
                                  GI_TRANSFER_NOTHING,
                                  TRUE, &arg))
@@ -787,10 +1006,10 @@ boxed_set_field_from_value(JSContext   *context,
 
     need_release = TRUE;
 
-    if (!g_field_info_set_field (field_info, priv->gboxed, &arg)) {
+    if (!g_field_info_set_field (field->info, priv->gboxed, &arg)) {
         gjs_throw(context, "Writing field %s.%s is not supported",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
         goto out;
     }
 
@@ -799,11 +1018,9 @@ boxed_set_field_from_value(JSContext   *context,
 out:
     if (need_release)
         gjs_g_argument_release (context, GI_TRANSFER_NOTHING,
-                                type_info,
+                                field->type_info,
                                 &arg);
 
-    g_base_info_unref ((GIBaseInfo *)type_info);
-
     return success;
 }
 
@@ -815,29 +1032,23 @@ boxed_field_setter (JSContext            *context,
                     JSMutableHandleValue  value)
 {
     Boxed *priv;
-    GIFieldInfo *field_info;
-    gboolean success = FALSE;
+    BoxedField *field;
 
     priv = priv_from_js(context, *obj._);
     if (!priv)
         return JS_FALSE;
-    field_info = get_field_info(context, priv, *id._);
-    if (!field_info)
+    field = get_field(context, priv, *id._);
+    if (!field)
         return JS_FALSE;
 
     if (priv->gboxed == NULL) { /* direct access to proto field */
         gjs_throw(context, "Can't set field %s.%s on prototype",
                   g_base_info_get_name ((GIBaseInfo *)priv->info),
-                  g_base_info_get_name ((GIBaseInfo *)field_info));
-        goto out;
+                  g_base_info_get_name ((GIBaseInfo *)field->info));
+        return JS_FALSE;
     }
 
-    success = boxed_set_field_from_value (context, priv, field_info, *value._);
-
-out:
-    g_base_info_unref ((GIBaseInfo *)field_info);
-
-    return success;
+    return boxed_set_field_from_value (context, priv, field, *value._);
 }
 
 static JSBool
@@ -845,7 +1056,6 @@ define_boxed_class_fields (JSContext *context,
                            Boxed     *priv,
                            JSObject  *proto)
 {
-    int n_fields = g_struct_info_get_n_fields (priv->info);
     int i;
 
     /* We identify properties with a 'TinyId': a 8-bit numeric value
@@ -867,26 +1077,31 @@ define_boxed_class_fields (JSContext *context,
      * class; doing it lazily in boxed_new_resolve() would be possible
      * as well if doing it ahead of time caused to much start-up
      * memory overhead.
+     *
+     * The TinyId is also the index into priv->fields, which
+     * boxed_fill_fields() already limited to 256 entries.
      */
-    if (n_fields > 256) {
-        g_warning("Only defining the first 256 fields in boxed type '%s'",
-                  g_base_info_get_name ((GIBaseInfo *)priv->info));
-        n_fields = 256;
-    }
-
-    for (i = 0; i < n_fields; i++) {
-        GIFieldInfo *field = g_struct_info_get_field (priv->info, i);
-        const char *field_name = g_base_info_get_name ((GIBaseInfo *)field);
-        gboolean result;
-
-        result = JS_DefinePropertyWithTinyId(context, proto, field_name, i,
-                                             JSVAL_NULL,
-                                             boxed_field_getter, boxed_field_setter,
-                                             JSPROP_PERMANENT | JSPROP_SHARED);
-
-        g_base_info_unref ((GIBaseInfo *)field);
-
-        if (!result)
+    priv->field_map = g_slice_new0(BoxedFieldMap);
+    priv->field_map->by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    priv->field_map->n_fields = priv->n_fields;
+    priv->field_map->last_ids = g_new0(jsid, priv->n_fields);
+    priv->field_map->last_fields = g_new0(BoxedField *, priv->n_fields);
+
+    for (i = 0; i < priv->n_fields; i++) {
+        const char *field_name = g_base_info_get_name ((GIBaseInfo *)priv->fields[i].info);
+        jsid field_id;
+
+        /* Interned strings are never collected, so the ids stay valid as
+         * keys */
+        field_id = gjs_intern_string_to_id(context, field_name);
+        g_hash_table_insert(priv->field_map->by_id,
+                            GSIZE_TO_POINTER(JSID_BITS(field_id)),
+                            &priv->fields[i]);
+
+        if (!JS_DefinePropertyWithTinyId(context, proto, field_name, i,
+                                         JSVAL_NULL,
+                                         boxed_field_getter, boxed_field_setter,
+                                         JSPROP_PERMANENT | JSPROP_SHARED))
             return JS_FALSE;
     }
 
@@ -916,6 +1131,34 @@ to_string_func(JSContext *context,
     return ret;
 }
 
+static void
+boxed_trace(JSTracer *tracer,
+            JSObject *obj)
+{
+    Boxed *priv;
+    int i;
+
+    priv = JS_GetPrivate(obj);
+    if (priv == NULL)
+        return;
+
+    if (priv->is_prototype) {
+        for (i = 0; i < priv->n_fields; i++) {
+            if (priv->fields[i].nested_proto != NULL)
+                JS_CALL_OBJECT_TRACER(tracer, priv->fields[i].nested_proto,
+                                      "boxed nested prototype");
+        }
+    }
+
+    if (priv->nested_wrappers != NULL) {
+        for (i = 0; i < priv->n_fields; i++) {
+            if (priv->nested_wrappers[i] != NULL)
+                JS_CALL_OBJECT_TRACER(tracer, priv->nested_wrappers[i],
+                                      "boxed nested wrapper");
+        }
+    }
+}
+
 /* The bizarre thing about this vtable is that it applies to both
  * instances of the object, and to the prototype that instances of the
  * class have.
@@ -923,12 +1166,15 @@ to_string_func(JSContext *context,
  * We allocate 1 reserved slot; this is typically unused, but if the
  * boxed is for a nested structure inside a parent structure, the
  * reserved slot is used to hold onto the parent Javascript object and
- * make sure it doesn't get freed.
+ * make sure it doesn't get freed. The parent in turn traces the
+ * nested wrappers it has handed out, so that reading the same field
+ * twice gives the same object.
  */
 static struct JSClass gjs_boxed_class = {
     "GObject_Boxed",
     JSCLASS_HAS_PRIVATE |
     JSCLASS_NEW_RESOLVE |
+    JSCLASS_IMPLEMENTS_BARRIERS |
     JSCLASS_HAS_RESERVED_SLOTS(1),
     JS_PropertyStub,
     JS_PropertyStub,
@@ -940,7 +1186,9 @@ static struct JSClass gjs_boxed_class = {
     boxed_finalize,
     NULL,
     NULL,
-    NULL, NULL, NULL
+    NULL,
+    NULL,
+    boxed_trace
 };
 
 static JSPropertySpec gjs_boxed_proto_props[] = {
@@ -1134,6 +1382,82 @@ boxed_fill_prototype_info(JSContext *context,
     }
 }
 
+/* Size of the fields that get_field_direct() and set_field_direct()
+ * handle, or 0 */
+static guint8
+direct_field_size(GITypeInfo *type_info)
+{
+    if (g_type_info_is_pointer(type_info))
+        return 0;
+
+    switch (g_type_info_get_tag(type_info)) {
+    case GI_TYPE_TAG_BOOLEAN:
+        return sizeof(gboolean);
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_UINT8:
+        return sizeof(gint8);
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_UINT16:
+        return sizeof(gint16);
+    case GI_TYPE_TAG_INT32:
+    case GI_TYPE_TAG_UINT32:
+        return sizeof(gint32);
+    case GI_TYPE_TAG_INT64:
+    case GI_TYPE_TAG_UINT64:
+        return sizeof(gint64);
+    case GI_TYPE_TAG_FLOAT:
+        return sizeof(gfloat);
+    case GI_TYPE_TAG_DOUBLE:
+        return sizeof(gdouble);
+    default:
+        return 0;
+    }
+}
+
+static void
+boxed_fill_fields(Boxed *priv)
+{
+    int i, n_fields;
+
+    n_fields = g_struct_info_get_n_fields(priv->info);
+    if (n_fields > 256) {
+        g_warning("Only defining the first 256 fields in boxed type '%s'",
+                  g_base_info_get_name ((GIBaseInfo *)priv->info));
+        n_fields = 256;
+    }
+
+    priv->n_fields = n_fields;
+    priv->fields = g_new0(BoxedField, n_fields);
+
+    for (i = 0; i < n_fields; i++) {
+        BoxedField *field = &priv->fields[i];
+        GIFieldInfoFlags flags;
+
+        field->info = g_struct_info_get_field(priv->info, i);
+        field->type_info = g_field_info_get_type(field->info);
+        field->offset = g_field_info_get_offset(field->info);
+        field->tag = g_type_info_get_tag(field->type_info);
+        field->size = direct_field_size(field->type_info);
+
+        flags = g_field_info_get_flags(field->info);
+        field->readable = (flags & GI_FIELD_IS_READABLE) != 0;
+        field->writable = (flags & GI_FIELD_IS_WRITABLE) != 0;
+
+        if (!g_type_info_is_pointer(field->type_info) &&
+            field->tag == GI_TYPE_TAG_INTERFACE) {
+            GIBaseInfo *interface_info = g_type_info_get_interface(field->type_info);
+
+            if (g_base_info_get_type(interface_info) == GI_INFO_TYPE_STRUCT ||
+                g_base_info_get_type(interface_info) == GI_INFO_TYPE_BOXED) {
+                field->interface_info = interface_info;
+                field->nested_is_simple = struct_is_simple((GIStructInfo *)interface_info);
+            } else {
+                g_base_info_unref(interface_info);
+            }
+        }
+    }
+}
+
 void
 gjs_define_boxed_class(JSContext    *context,
                        JSObject     *in_object,
@@ -1184,7 +1508,12 @@ gjs_define_boxed_class(JSContext    *context,
     gjs_debug(GJS_DEBUG_GBOXED, "Defined class %s prototype is %p class %p in object %p",
               constructor_name, prototype, JS_GetClass(prototype), in_object);
 
+    priv->is_prototype = TRUE;
     priv->can_allocate_directly = struct_is_simple (priv->info);
+    if (priv->can_allocate_directly &&
+        g_struct_info_get_size (priv->info) <= BOXED_INLINE_MAX_SIZE)
+        priv->inline_size = g_struct_info_get_size (priv->info);
+    boxed_fill_fields (priv);
 
     define_boxed_class_fields (context, priv, prototype);
     gjs_define_static_methods (context, constructor, priv->gtype, priv->info);
@@ -1219,11 +1548,12 @@ gjs_boxed_from_c_struct(JSContext             *context,
                                      JS_GetClass(proto), proto,
                                      gjs_get_import_global (context));
 
-    GJS_INC_COUNTER(boxed);
-    priv = g_slice_new0(Boxed);
-
-    *priv = *proto_priv;
-    g_base_info_ref( (GIBaseInfo*) priv->info);
+    /* Inline storage is only used if we end up copying the struct with
+     * boxed_new_direct() below */
+    priv = boxed_new_instance_private(proto_priv,
+                                      (flags & GJS_BOXED_CREATION_NO_COPY) == 0 &&
+                                      !g_type_is_a (proto_priv->gtype, G_TYPE_BOXED) &&
+                                      proto_priv->gtype != G_TYPE_VARIANT);
 
     JS_SetPrivate(obj, priv);
 
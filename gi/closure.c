@@ -38,6 +38,7 @@ typedef struct {
     JSRuntime *runtime;
     JSContext *context;
     JSObject *obj;
+    GjsKeepAliveHandle keep_alive_handle;
     guint unref_on_global_object_finalized : 1;
 } Closure;
 
@@ -81,6 +82,7 @@ invalidate_js_pointers(Closure *c)
     if (c->obj == NULL)
         return;
 
+    gjs_gc_object_barrier(c->runtime, c->obj);
     c->obj = NULL;
     c->context = NULL;
     c->runtime = NULL;
@@ -223,9 +225,8 @@ closure_invalidated(gpointer data,
                           "removing our destroy notifier on global object)",
                           closure);
         gjs_keep_alive_remove_global_child(c->context,
-                                           global_context_finalized,
-                                           c->obj,
-                                           c);
+                                           c->keep_alive_handle);
+        c->keep_alive_handle = 0;
 
         c->obj = NULL;
         c->context = NULL;
@@ -239,6 +240,10 @@ closure_set_invalid(gpointer  data,
 {
     Closure *self = (Closure*) closure;
 
+    /* The object is traced by the wrapper of the signal emitter
+     * until now */
+    if (self->obj != NULL)
+        gjs_gc_object_barrier(self->runtime, self->obj);
     self->obj = NULL;
     self->context = NULL;
     self->runtime = NULL;
@@ -366,10 +371,11 @@ gjs_closure_new(JSContext  *context,
 
     if (root_function) {
         /* Fully manage closure lifetime if so asked */
-        gjs_keep_alive_add_global_child(context,
-                                        global_context_finalized,
-                                        c->obj,
-                                        c);
+        c->keep_alive_handle =
+            gjs_keep_alive_add_global_child(context,
+                                            global_context_finalized,
+                                            c->obj,
+                                            c);
 
         g_closure_add_invalidate_notifier(&c->base, NULL, closure_invalidated);
     } else {
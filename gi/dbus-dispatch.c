@@ -0,0 +1,362 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  The GJS authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/* Direct dispatch of D-Bus method calls to the JS object exported with
+ * Gio.DBusExportedObject.wrapJSObject().
+ *
+ * Without this, every incoming call is emitted as the handle-method-call
+ * signal of the GjsDBusImplementation, with the parameters and the
+ * invocation boxed into GValues and converted back, and looked up by
+ * name again in JS. Here the out signatures are computed once, when the
+ * object is wrapped, and the handler is called with the parameters
+ * already unpacked as its arguments. Its return value (or exception) is
+ * turned into the reply directly.
+ *
+ * Calls for which the object has no plain method (fooAsync() handlers,
+ * or missing methods) still go through the signal.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gjs/gjs-module.h>
+#include <gjs/compat.h>
+#include <gjs/runtime.h>
+#include <libgjs-private/gjs-gdbus-wrapper.h>
+#include "boxed.h"
+#include "closure.h"
+#include "gerror.h"
+#include "object.h"
+#include "variant.h"
+#include "dbus-dispatch.h"
+
+#include <util/log.h>
+
+typedef struct {
+    char  *out_signature;
+    guint  n_out_args;
+} DispatchMethod;
+
+typedef struct {
+    /* The callable of this closure is the exported JS object; it is
+     * only used to trace the object from the wrapper of the
+     * GjsDBusImplementation, like the signal handlers it replaces */
+    GClosure   *object_closure;
+    /* method name -> DispatchMethod */
+    GHashTable *methods;
+} Dispatcher;
+
+static char *
+make_tuple_signature(GDBusArgInfo **args,
+                     guint         *n_args_p)
+{
+    GString *signature;
+    guint n_args = 0;
+
+    signature = g_string_new("(");
+    for (; args != NULL && *args != NULL; args++, n_args++)
+        g_string_append(signature, (*args)->signature);
+    g_string_append_c(signature, ')');
+
+    *n_args_p = n_args;
+    return g_string_free(signature, FALSE);
+}
+
+static void
+dispatch_method_free(gpointer data)
+{
+    DispatchMethod *method = data;
+
+    g_free(method->out_signature);
+    g_slice_free(DispatchMethod, method);
+}
+
+static void
+dispatcher_free(gpointer data)
+{
+    Dispatcher *dispatcher = data;
+
+    g_closure_invalidate(dispatcher->object_closure);
+    g_closure_unref(dispatcher->object_closure);
+    g_hash_table_destroy(dispatcher->methods);
+    g_slice_free(Dispatcher, dispatcher);
+}
+
+static char *
+get_error_property(JSContext  *context,
+                   JSObject   *obj,
+                   const char *name)
+{
+    jsval value;
+    JSString *str;
+    char *utf8;
+
+    if (!JS_GetProperty(context, obj, name, &value) || JSVAL_IS_VOID(value))
+        return NULL;
+
+    str = JS_ValueToString(context, value);
+    if (str == NULL || !gjs_string_to_utf8(context, STRING_TO_JSVAL(str), &utf8))
+        return NULL;
+
+    return utf8;
+}
+
+/* Same conversion that Gio.js does for exceptions thrown by the
+ * handle-method-call handlers */
+static void
+return_exception(JSContext             *context,
+                 GDBusMethodInvocation *invocation)
+{
+    jsval exc;
+    char *name = NULL, *message = NULL;
+
+    if (!JS_GetPendingException(context, &exc)) {
+        g_dbus_method_invocation_return_dbus_error(invocation,
+                                                   "org.gnome.gjs.JSError.Error",
+                                                   "Method call failed");
+        return;
+    }
+
+    JS_ClearPendingException(context);
+
+    if (JSVAL_IS_OBJECT(exc) && !JSVAL_IS_NULL(exc)) {
+        JSObject *exc_obj = JSVAL_TO_OBJECT(exc);
+
+        if (gjs_typecheck_gerror(context, exc_obj, JS_FALSE) ||
+            gjs_typecheck_boxed(context, exc_obj, NULL, G_TYPE_ERROR, JS_FALSE)) {
+            GError *error = gjs_gerror_from_error(context, exc_obj);
+
+            if (error != NULL) {
+                g_dbus_method_invocation_return_gerror(invocation, error);
+                return;
+            }
+        }
+
+        name = get_error_property(context, exc_obj, "name");
+        message = get_error_property(context, exc_obj, "message");
+    } else {
+        JSString *str = JS_ValueToString(context, exc);
+        if (str != NULL)
+            gjs_string_to_utf8(context, STRING_TO_JSVAL(str), &message);
+    }
+    /* in case the conversions above threw too */
+    JS_ClearPendingException(context);
+
+    if (name == NULL || strchr(name, '.') == NULL) {
+        /* likely to be a normal JS error */
+        char *dbus_name = g_strconcat("org.gnome.gjs.JSError.",
+                                      name ? name : "Error", NULL);
+        g_free(name);
+        name = dbus_name;
+    }
+
+    g_dbus_method_invocation_return_dbus_error(invocation, name,
+                                               message ? message : "");
+    g_free(name);
+    g_free(message);
+}
+
+static void
+return_value(JSContext             *context,
+             DispatchMethod        *method,
+             jsval                  retval,
+             GDBusMethodInvocation *invocation)
+{
+    GVariant *variant;
+
+    /* undefined (no return value) is the empty tuple */
+    if (JSVAL_IS_VOID(retval)) {
+        g_dbus_method_invocation_return_value(invocation, NULL);
+        return;
+    }
+
+    if (JSVAL_IS_OBJECT(retval) && !JSVAL_IS_NULL(retval) &&
+        gjs_typecheck_boxed(context, JSVAL_TO_OBJECT(retval), NULL,
+                            G_TYPE_VARIANT, JS_FALSE)) {
+        variant = gjs_c_struct_from_boxed(context, JSVAL_TO_OBJECT(retval));
+        if (variant != NULL) {
+            g_dbus_method_invocation_return_value(invocation, variant);
+            return;
+        }
+    }
+
+    /* if one arg, we don't require the handler wrapping it into an
+     * Array */
+    if (method->n_out_args == 1) {
+        JSObject *array = JS_NewArrayObject(context, 1, &retval);
+
+        retval = array ? OBJECT_TO_JSVAL(array) : JSVAL_VOID;
+    }
+
+    variant = gjs_variant_pack(context, method->out_signature, retval);
+    if (variant == NULL) {
+        JS_ClearPendingException(context);
+        /* if we don't do this, the other side will never see a reply */
+        g_dbus_method_invocation_return_dbus_error(invocation,
+                                                   "org.gnome.gjs.JSError.ValueError",
+                                                   "Service implementation returned an incorrect value type");
+        return;
+    }
+
+    g_dbus_method_invocation_return_value(invocation, variant);
+}
+
+static gboolean
+dispatch_method_call(GjsDBusImplementation *self,
+                     const char            *method_name,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer               user_data)
+{
+    Dispatcher *dispatcher = user_data;
+    DispatchMethod *method;
+    JSContext *context;
+    JSObject *obj;
+    jsval handler, retval;
+    jsval *argv;
+    gsize n_args, i;
+    gboolean handled = FALSE;
+
+    method = g_hash_table_lookup(dispatcher->methods, method_name);
+    if (method == NULL || !gjs_closure_is_valid(dispatcher->object_closure))
+        return FALSE;
+
+    context = gjs_runtime_get_context(gjs_closure_get_runtime(dispatcher->object_closure));
+    obj = gjs_closure_get_callable(dispatcher->object_closure);
+
+    JS_BeginRequest(context);
+
+    /* The handler is looked up for every call, so that methods can
+     * still be replaced or removed after the object was exported */
+    if (!JS_GetProperty(context, obj, method_name, &handler)) {
+        gjs_log_exception(context);
+        goto out;
+    }
+
+    if (!JSVAL_IS_OBJECT(handler) || JSVAL_IS_NULL(handler) ||
+        !JS_ObjectIsFunction(context, JSVAL_TO_OBJECT(handler)))
+        goto out;
+
+    handled = TRUE;
+
+    /* On the stack, so that the unpacked arguments are seen by the
+     * conservative stack scanner; D-Bus limits the number of
+     * arguments anyway */
+    n_args = g_variant_n_children(parameters);
+    argv = g_newa(jsval, n_args);
+    for (i = 0; i < n_args; i++)
+        argv[i] = JSVAL_VOID;
+
+    for (i = 0; i < n_args; i++) {
+        GVariant *child = g_variant_get_child_value(parameters, i);
+        JSBool ok = gjs_variant_unpack(context, child, TRUE, &argv[i]);
+
+        g_variant_unref(child);
+        if (!ok) {
+            return_exception(context, invocation);
+            goto out;
+        }
+    }
+
+    if (!gjs_call_function_value(context, obj, handler, n_args, argv, &retval)) {
+        return_exception(context, invocation);
+        goto out;
+    }
+
+    return_value(context, method, retval, invocation);
+
+ out:
+    JS_EndRequest(context);
+    return handled;
+}
+
+static JSBool
+set_dispatch_func(JSContext *context,
+                  unsigned   argc,
+                  jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *impl_obj, *obj;
+    GObject *gobj;
+    GDBusInterfaceInfo *info;
+    GDBusMethodInfo **methods;
+    Dispatcher *dispatcher;
+
+    if (argc != 2 ||
+        !JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0]) ||
+        !JSVAL_IS_OBJECT(argv[1]) || JSVAL_IS_NULL(argv[1])) {
+        gjs_throw(context, "dbus_implementation_set_dispatch() takes a DBusImplementation and an object");
+        return JS_FALSE;
+    }
+
+    impl_obj = JSVAL_TO_OBJECT(argv[0]);
+    obj = JSVAL_TO_OBJECT(argv[1]);
+
+    if (!gjs_typecheck_object(context, impl_obj,
+                              GJS_TYPE_DBUS_IMPLEMENTATION, JS_TRUE))
+        return JS_FALSE;
+
+    gobj = gjs_g_object_from_object(context, impl_obj);
+    info = g_dbus_interface_skeleton_get_info(G_DBUS_INTERFACE_SKELETON(gobj));
+
+    dispatcher = g_slice_new0(Dispatcher);
+    dispatcher->methods = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, dispatch_method_free);
+
+    for (methods = info->methods; methods != NULL && *methods != NULL; methods++) {
+        DispatchMethod *method = g_slice_new(DispatchMethod);
+
+        method->out_signature = make_tuple_signature((*methods)->out_args,
+                                                     &method->n_out_args);
+        g_hash_table_insert(dispatcher->methods,
+                            g_strdup((*methods)->name), method);
+    }
+
+    dispatcher->object_closure = gjs_closure_new(context, obj,
+                                                 "D-Bus method dispatch", FALSE);
+    g_closure_ref(dispatcher->object_closure);
+    g_closure_sink(dispatcher->object_closure);
+    gjs_object_associate_closure(context, impl_obj, dispatcher->object_closure);
+
+    gjs_dbus_implementation_set_method_dispatch(GJS_DBUS_IMPLEMENTATION(gobj),
+                                                dispatch_method_call,
+                                                dispatcher, dispatcher_free);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+JSBool
+gjs_define_dbus_dispatch_stuff(JSContext *context,
+                               JSObject  *module_obj)
+{
+    if (!JS_DefineFunction(context, module_obj,
+                           "dbus_implementation_set_dispatch",
+                           (JSNative)set_dispatch_func,
+                           2, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    return JS_TRUE;
+}
@@ -29,9 +29,11 @@
 #include "boxed.h"
 #include "union.h"
 #include "gerror.h"
+#include <gjs/byteArray.h>
 #include <gjs/runtime.h>
 #include <gjs/gjs-module.h>
 #include <gjs/compat.h>
+#include <gjs/profiler.h>
 
 #include <util/log.h>
 
@@ -46,14 +48,82 @@
  */
 #define GJS_ARG_INDEX_INVALID G_MAXUINT8
 
+typedef struct _GjsArgCache GjsArgCache;
+
+/* Converts a JS value into an (in) argument for the scalar fast path;
+ * see init_scalar_fast_path().
+ */
+typedef JSBool (*GjsArgMarshaller) (JSContext   *context,
+                                    GjsArgCache *arg_cache,
+                                    jsval        value,
+                                    GArgument   *arg);
+
+/* Everything gjs_invoke_c_function() needs to know about one argument,
+ * computed once from the typelib in init_cached_function_data() so
+ * that the invocation path never has to go back to the GICallableInfo.
+ * @arg_info and @type_info are stack-style infos that borrow from the
+ * (referenced) Function.info, so they must never be unref'd.
+ */
+struct _GjsArgCache {
+    GIArgInfo arg_info;
+    GITypeInfo type_info;
+
+    GjsParamType param_type;
+    GIDirection direction;
+    GITypeTag type_tag;
+    GITransfer transfer;
+    guint may_be_null : 1;
+    guint is_return_value : 1;
+
+    /* Size of the struct/union to allocate for (out caller-allocates),
+     * or 0 if the argument is not caller-allocates.
+     */
+    gsize caller_allocates_size;
+    guint caller_allocates : 1;
+
+    /* gi index of the length argument for C arrays, or -1 */
+    gint8 array_length_pos;
+
+    /* (in) (transfer none) guint8 or gint8 array with a length
+     * argument; a ByteArray passed here is handed to C without copying,
+     * pinned by a reference to its GBytes for the duration of the call.
+     */
+    guint may_borrow_bytes : 1;
+
+    /* (in) (transfer none) GBytes; a ByteArray passed here comes with a
+     * reference of its GBytes, to be dropped after the call.
+     */
+    guint is_bytes : 1;
+
+    /* Only set up for functions using the scalar fast path */
+    GjsArgMarshaller marshaller;
+    GType gtype;
+};
+
 typedef struct {
     GIFunctionInfo *info;
 
-    GjsParamType *param_types;
+    GjsArgCache *args;
+    guint8 gi_argc;
+
+    guint is_method : 1;
+    guint can_throw_gerror : 1;
+    /* All arguments are (in) scalars or GObjects, see init_scalar_fast_path() */
+    guint scalar_fast_path : 1;
+
+    GITypeInfo return_info;
+    GITypeTag return_tag;
+    GITransfer return_transfer;
+    /* gi index of the length argument for a C array return value, or -1 */
+    gint8 return_array_length_pos;
 
     guint8 expected_js_argc;
     guint8 js_out_argc;
     GIFunctionInvoker invoker;
+
+    /* "Namespace.Container.name", built the first time the function is
+     * called while the sampling profiler runs */
+    char *profile_label;
 } Function;
 
 static struct JSClass gjs_function_class;
@@ -171,7 +241,7 @@ gjs_callback_closure(ffi_cif *cif,
     JSContext *context;
     GjsCallbackTrampoline *trampoline;
     int i, n_args, n_jsargs, n_outargs;
-    jsval *jsargs, rval;
+    jsval *values, *jsargs, rval;
     JSObject *this_object;
     GITypeInfo ret_type;
     gboolean success = FALSE;
@@ -188,8 +258,12 @@ gjs_callback_closure(ffi_cif *cif,
 
     g_assert(n_args >= 0);
 
+    /* Keep the arguments and the return value on the argument stack of
+     * the runtime, which the GC traces; the return value is in the last
+     * slot */
     n_outargs = 0;
-    jsargs = (jsval*)g_newa(jsval, n_args);
+    values = gjs_runtime_push_values(trampoline->runtime, n_args + 1);
+    jsargs = values;
     for (i = 0, n_jsargs = 0; i < n_args; i++) {
         GIArgInfo arg_info;
         GITypeInfo type_info;
@@ -259,9 +333,10 @@ gjs_callback_closure(ffi_cif *cif,
                               trampoline->js_function,
                               n_jsargs,
                               jsargs,
-                              &rval)) {
+                              &values[n_args])) {
         goto out;
     }
+    rval = values[n_args];
 
     g_callable_info_load_return_type(trampoline->info, &ret_type);
     ret_type_is_void = g_type_info_get_tag (&ret_type) == GI_TYPE_TAG_VOID;
@@ -372,6 +447,8 @@ out:
         gjs_g_argument_init_default (context, &ret_type, result);
     }
 
+    gjs_runtime_pop_values(trampoline->runtime, values, n_args + 1);
+
     if (trampoline->scope == GI_SCOPE_TYPE_ASYNC) {
         completed_trampolines = g_slist_prepend(completed_trampolines, trampoline);
     }
@@ -563,6 +640,122 @@ gjs_fill_method_instance (JSContext  *context,
     return JS_TRUE;
 }
 
+/* Because we can't free a closure while we're in it, we defer
+ * freeing until the next time a C function is invoked.  What
+ * we should really do instead is queue it for a GC thread.
+ */
+static void
+release_completed_trampolines(void)
+{
+    GSList *iter;
+
+    if (completed_trampolines == NULL)
+        return;
+
+    for (iter = completed_trampolines; iter; iter = iter->next) {
+        GjsCallbackTrampoline *trampoline = iter->data;
+        gjs_callback_trampoline_unref(trampoline);
+    }
+    g_slist_free(completed_trampolines);
+    completed_trampolines = NULL;
+}
+
+static void
+throw_too_few_arguments(JSContext *context,
+                        Function  *function,
+                        unsigned   js_argc)
+{
+    gjs_throw(context, "Too few arguments to %s %s.%s expected %d got %d",
+              function->is_method ? "method" : "function",
+              g_base_info_get_namespace( (GIBaseInfo*) function->info),
+              g_base_info_get_name( (GIBaseInfo*) function->info),
+              function->expected_js_argc,
+              js_argc);
+}
+
+/* See comment for GjsFFIReturnValue above */
+static gpointer
+get_return_value_pointer(GITypeTag         return_tag,
+                         GIFFIReturnValue *return_value)
+{
+    if (return_tag == GI_TYPE_TAG_FLOAT)
+        return &return_value->v_float;
+    else if (return_tag == GI_TYPE_TAG_DOUBLE)
+        return &return_value->v_double;
+    else if (return_tag == GI_TYPE_TAG_INT64 || return_tag == GI_TYPE_TAG_UINT64)
+        return &return_value->v_uint64;
+    else
+        return &return_value->v_long;
+}
+
+/* Fast path for functions whose arguments are all (in) scalars, enums
+ * or GObjects, and whose return value (if any) needs no release; see
+ * init_scalar_fast_path(). Each argument's marshaller writes straight
+ * into the ffi argument buffer, and since nothing is ever allocated
+ * there's no release pass and no out argument bookkeeping.
+ */
+static JSBool
+gjs_invoke_c_function_scalar(JSContext      *context,
+                             Function       *function,
+                             JSObject       *obj, /* "this" object */
+                             unsigned        js_argc,
+                             jsval          *js_argv,
+                             jsval          *js_rval)
+{
+    GArgument *in_arg_cvalues;
+    gpointer *ffi_arg_pointers;
+    GIFFIReturnValue return_value;
+    gpointer return_value_p;
+    GArgument return_gargument;
+    guint8 c_argc, c_arg_pos, gi_arg_pos;
+
+    release_completed_trampolines();
+
+    if (js_argc < function->expected_js_argc) {
+        throw_too_few_arguments(context, function, js_argc);
+        return JS_FALSE;
+    }
+
+    c_argc = function->invoker.cif.nargs;
+    in_arg_cvalues = g_newa(GArgument, c_argc);
+    ffi_arg_pointers = g_newa(gpointer, c_argc);
+
+    c_arg_pos = 0;
+    if (function->is_method) {
+        if (!gjs_fill_method_instance(context, obj,
+                                      function, &in_arg_cvalues[0]))
+            return JS_FALSE;
+        ffi_arg_pointers[0] = &in_arg_cvalues[0];
+        ++c_arg_pos;
+    }
+
+    /* Every argument is (in) and PARAM_NORMAL, so the JS and GI
+     * argument positions are the same.
+     */
+    for (gi_arg_pos = 0; gi_arg_pos < function->gi_argc; gi_arg_pos++, c_arg_pos++) {
+        GjsArgCache *arg_cache = &function->args[gi_arg_pos];
+
+        ffi_arg_pointers[c_arg_pos] = &in_arg_cvalues[c_arg_pos];
+        if (!arg_cache->marshaller(context, arg_cache, js_argv[gi_arg_pos],
+                                   &in_arg_cvalues[c_arg_pos]))
+            return JS_FALSE;
+    }
+
+    g_assert_cmpuint(c_arg_pos, ==, c_argc);
+
+    return_value_p = get_return_value_pointer(function->return_tag, &return_value);
+    ffi_call(&(function->invoker.cif), function->invoker.native_address, return_value_p, ffi_arg_pointers);
+
+    if (function->return_tag == GI_TYPE_TAG_VOID) {
+        *js_rval = JSVAL_VOID;
+        return JS_TRUE;
+    }
+
+    gi_type_info_extract_ffi_return_value(&function->return_info, &return_value, &return_gargument);
+    return gjs_value_from_g_argument(context, js_rval, &function->return_info,
+                                     &return_gargument, TRUE);
+}
+
 static JSBool
 gjs_invoke_c_function(JSContext      *context,
                       Function       *function,
@@ -580,12 +773,19 @@ gjs_invoke_c_function(JSContext      *context,
      * @ffi_arg_pointers: For passing data to FFI, we need to create another layer
      *  of indirection; this array is a pointer to an element in in_arg_cvalues
      *  or out_arg_cvalues.
+     * @pinned_bytes: for (in) arrays pointing into the data of a
+     *  ByteArray, a reference to that data, dropped after the call. The
+     *  ByteArray makes a copy if JS changes it while C is using it.
+     * @bytes_ref_cvalues: TRUE for (in) GBytes taken from a ByteArray,
+     *  which hold a reference to drop.
      * @return_value: The actual return value of the C function, i.e. not an (out) param
      */
     GArgument *in_arg_cvalues;
     GArgument *out_arg_cvalues;
     GArgument *inout_original_arg_cvalues;
     gpointer *ffi_arg_pointers;
+    GBytes **pinned_bytes;
+    gboolean *bytes_ref_cvalues;
     GIFFIReturnValue return_value;
     gpointer return_value_p; /* Will point inside the union return_value */
     GArgument return_gargument;
@@ -594,36 +794,22 @@ gjs_invoke_c_function(JSContext      *context,
     guint8 gi_argc, gi_arg_pos;
     guint8 c_argc, c_arg_pos;
     guint8 js_arg_pos;
-    gboolean can_throw_gerror;
     gboolean did_throw_gerror = FALSE;
     GError *local_error = NULL;
     gboolean failed, postinvoke_release_failed;
 
     gboolean is_method;
-    GITypeInfo return_info;
     GITypeTag return_tag;
     jsval *return_values = NULL;
     guint8 next_rval = 0; /* index into return_values */
-    GSList *iter;
 
-    /* Because we can't free a closure while we're in it, we defer
-     * freeing until the next time a C function is invoked.  What
-     * we should really do instead is queue it for a GC thread.
-     */
-    if (completed_trampolines) {
-        for (iter = completed_trampolines; iter; iter = iter->next) {
-            GjsCallbackTrampoline *trampoline = iter->data;
-            gjs_callback_trampoline_unref(trampoline);
-        }
-        g_slist_free(completed_trampolines);
-        completed_trampolines = NULL;
-    }
+    release_completed_trampolines();
 
-    is_method = g_callable_info_is_method(function->info);
-    can_throw_gerror = g_callable_info_can_throw_gerror(function->info);
+    is_method = function->is_method;
+    return_tag = function->return_tag;
 
     c_argc = function->invoker.cif.nargs;
-    gi_argc = g_callable_info_get_n_args( (GICallableInfo*) function->info);
+    gi_argc = function->gi_argc;
 
     /* @c_argc is the number of arguments that the underlying C
      * function takes. @gi_argc is the number of arguments the
@@ -639,22 +825,18 @@ gjs_invoke_c_function(JSContext      *context,
      */
 
     if (js_argc < function->expected_js_argc) {
-        gjs_throw(context, "Too few arguments to %s %s.%s expected %d got %d",
-                  is_method ? "method" : "function",
-                  g_base_info_get_namespace( (GIBaseInfo*) function->info),
-                  g_base_info_get_name( (GIBaseInfo*) function->info),
-                  function->expected_js_argc,
-                  js_argc);
+        throw_too_few_arguments(context, function, js_argc);
         return JS_FALSE;
     }
 
-    g_callable_info_load_return_type( (GICallableInfo*) function->info, &return_info);
-    return_tag = g_type_info_get_tag(&return_info);
-
     in_arg_cvalues = g_newa(GArgument, c_argc);
     ffi_arg_pointers = g_newa(gpointer, c_argc);
     out_arg_cvalues = g_newa(GArgument, c_argc);
     inout_original_arg_cvalues = g_newa(GArgument, c_argc);
+    pinned_bytes = g_newa(GBytes *, c_argc);
+    memset(pinned_bytes, 0, c_argc * sizeof(GBytes *));
+    bytes_ref_cvalues = g_newa(gboolean, c_argc);
+    memset(bytes_ref_cvalues, 0, c_argc * sizeof(gboolean));
 
     failed = FALSE;
     c_arg_pos = 0; /* index into in_arg_cvalues, etc */
@@ -670,83 +852,43 @@ gjs_invoke_c_function(JSContext      *context,
 
     processed_c_args = c_arg_pos;
     for (gi_arg_pos = 0; gi_arg_pos < gi_argc; gi_arg_pos++, c_arg_pos++) {
-        GIDirection direction;
-        GIArgInfo arg_info;
+        GjsArgCache *arg_cache = &function->args[gi_arg_pos];
+        GIDirection direction = arg_cache->direction;
         gboolean arg_removed = FALSE;
 
         /* gjs_debug(GJS_DEBUG_GFUNCTION, "gi_arg_pos: %d c_arg_pos: %d js_arg_pos: %d", gi_arg_pos, c_arg_pos, js_arg_pos); */
 
-        g_callable_info_load_arg( (GICallableInfo*) function->info, gi_arg_pos, &arg_info);
-        direction = g_arg_info_get_direction(&arg_info);
-
         g_assert_cmpuint(c_arg_pos, <, c_argc);
         ffi_arg_pointers[c_arg_pos] = &in_arg_cvalues[c_arg_pos];
 
         if (direction == GI_DIRECTION_OUT) {
-            if (g_arg_info_is_caller_allocates(&arg_info)) {
-                GITypeTag type_tag;
-                GITypeInfo ainfo;
-
-                g_arg_info_load_type(&arg_info, &ainfo);
-                type_tag = g_type_info_get_tag(&ainfo);
-
-                switch (type_tag) {
-                case GI_TYPE_TAG_INTERFACE:
-                    {
-                        GIBaseInfo* interface_info;
-                        GIInfoType interface_type;
-                        gsize size;
-
-                        interface_info = g_type_info_get_interface(&ainfo);
-                        g_assert(interface_info != NULL);
-
-                        interface_type = g_base_info_get_type(interface_info);
-
-                        if (interface_type == GI_INFO_TYPE_STRUCT) {
-                            size = g_struct_info_get_size((GIStructInfo*)interface_info);
-                        } else if (interface_type == GI_INFO_TYPE_UNION) {
-                            size = g_union_info_get_size((GIUnionInfo*)interface_info);
-                        } else {
-                            failed = TRUE;
-                        }
-
-                        g_base_info_unref((GIBaseInfo*)interface_info);
-
-                        if (!failed) {
-                            in_arg_cvalues[c_arg_pos].v_pointer = g_slice_alloc0(size);
-                            out_arg_cvalues[c_arg_pos].v_pointer = in_arg_cvalues[c_arg_pos].v_pointer;
-                        }
-                        break;
-                    }
-                default:
+            if (arg_cache->caller_allocates) {
+                if (arg_cache->caller_allocates_size > 0) {
+                    in_arg_cvalues[c_arg_pos].v_pointer = gjs_boxed_payload_alloc0(arg_cache->caller_allocates_size);
+                    out_arg_cvalues[c_arg_pos].v_pointer = in_arg_cvalues[c_arg_pos].v_pointer;
+                } else {
                     failed = TRUE;
+                    gjs_throw(context, "Unsupported type %s for (out caller-allocates)",
+                              g_type_tag_to_string(arg_cache->type_tag));
                 }
-                if (failed)
-                    gjs_throw(context, "Unsupported type %s for (out caller-allocates)", g_type_tag_to_string(type_tag));
             } else {
                 out_arg_cvalues[c_arg_pos].v_pointer = NULL;
                 in_arg_cvalues[c_arg_pos].v_pointer = &out_arg_cvalues[c_arg_pos];
             }
         } else {
             GArgument *in_value;
-            GITypeInfo ainfo;
-            GjsParamType param_type;
-
-            g_arg_info_load_type(&arg_info, &ainfo);
 
             in_value = &in_arg_cvalues[c_arg_pos];
 
-            param_type = function->param_types[gi_arg_pos];
-
-            switch (param_type) {
+            switch (arg_cache->param_type) {
             case PARAM_CALLBACK: {
                 GICallableInfo *callable_info;
-                GIScopeType scope = g_arg_info_get_scope(&arg_info);
+                GIScopeType scope = g_arg_info_get_scope(&arg_cache->arg_info);
                 GjsCallbackTrampoline *trampoline;
                 ffi_closure *closure;
                 jsval value = js_argv[js_arg_pos];
 
-                if (JSVAL_IS_NULL(value) && g_arg_info_may_be_null(&arg_info)) {
+                if (JSVAL_IS_NULL(value) && arg_cache->may_be_null) {
                     closure = NULL;
                     trampoline = NULL;
                 } else {
@@ -754,14 +896,14 @@ gjs_invoke_c_function(JSContext      *context,
                         gjs_throw(context, "Error invoking %s.%s: Expected function for callback argument %s, got %s",
                                   g_base_info_get_namespace( (GIBaseInfo*) function->info),
                                   g_base_info_get_name( (GIBaseInfo*) function->info),
-                                  g_base_info_get_name( (GIBaseInfo*) &arg_info),
+                                  g_base_info_get_name( (GIBaseInfo*) &arg_cache->arg_info),
                                   JS_GetTypeName(context,
                                                  JS_TypeOfValue(context, value)));
                         failed = TRUE;
                         break;
                     }
 
-                    callable_info = (GICallableInfo*) g_type_info_get_interface(&ainfo);
+                    callable_info = (GICallableInfo*) g_type_info_get_interface(&arg_cache->type_info);
                     trampoline = gjs_callback_trampoline_new(context,
                                                              value,
                                                              callable_info,
@@ -771,16 +913,16 @@ gjs_invoke_c_function(JSContext      *context,
                     g_base_info_unref(callable_info);
                 }
 
-                gint destroy_pos = g_arg_info_get_destroy(&arg_info);
-                gint closure_pos = g_arg_info_get_closure(&arg_info);
+                gint destroy_pos = g_arg_info_get_destroy(&arg_cache->arg_info);
+                gint closure_pos = g_arg_info_get_closure(&arg_cache->arg_info);
                 if (destroy_pos >= 0) {
                     gint c_pos = is_method ? destroy_pos + 1 : destroy_pos;
-                    g_assert (function->param_types[destroy_pos] == PARAM_SKIPPED);
+                    g_assert (function->args[destroy_pos].param_type == PARAM_SKIPPED);
                     in_arg_cvalues[c_pos].v_pointer = trampoline ? gjs_destroy_notify_callback : NULL;
                 }
                 if (closure_pos >= 0) {
                     gint c_pos = is_method ? closure_pos + 1 : closure_pos;
-                    g_assert (function->param_types[closure_pos] == PARAM_SKIPPED);
+                    g_assert (function->args[closure_pos].param_type == PARAM_SKIPPED);
                     in_arg_cvalues[c_pos].v_pointer = trampoline;
                 }
 
@@ -796,22 +938,35 @@ gjs_invoke_c_function(JSContext      *context,
                 arg_removed = TRUE;
                 break;
             case PARAM_ARRAY: {
-                GIArgInfo array_length_arg;
-
-                gint array_length_pos = g_type_info_get_array_length(&ainfo);
+                gint array_length_pos = arg_cache->array_length_pos;
+                GjsArgCache *length_cache = &function->args[array_length_pos];
+                jsval value = js_argv[js_arg_pos];
                 gsize length;
 
-                if (!gjs_value_to_explicit_array(context, js_argv[js_arg_pos], &arg_info,
-                                                 in_value, &length)) {
+                if (arg_cache->may_borrow_bytes &&
+                    !JSVAL_IS_NULL(value) && JSVAL_IS_OBJECT(value) &&
+                    gjs_typecheck_bytearray(context, JSVAL_TO_OBJECT(value), FALSE)) {
+                    GBytes *bytes;
+
+                    /* The callee may call back into JS, which may then
+                     * resize or write to the ByteArray */
+                    bytes = gjs_byte_array_get_bytes(context, JSVAL_TO_OBJECT(value));
+                    in_value->v_pointer = (gpointer) g_bytes_get_data(bytes, &length);
+                    pinned_bytes[c_arg_pos] = bytes;
+                } else if (!gjs_value_to_explicit_array(context, value, &arg_cache->arg_info,
+                                                        in_value, &length)) {
                     failed = TRUE;
                     break;
                 }
 
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-
                 array_length_pos += is_method ? 1 : 0;
-                if (!gjs_value_to_arg(context, INT_TO_JSVAL(length), &array_length_arg,
+                if (!gjs_value_to_arg(context, INT_TO_JSVAL(length), &length_cache->arg_info,
                                       in_arg_cvalues + array_length_pos)) {
+                    /* Not released below, since the argument failed */
+                    if (pinned_bytes[c_arg_pos] != NULL) {
+                        g_bytes_unref(pinned_bytes[c_arg_pos]);
+                        pinned_bytes[c_arg_pos] = NULL;
+                    }
                     failed = TRUE;
                     break;
                 }
@@ -835,11 +990,21 @@ gjs_invoke_c_function(JSContext      *context,
             case PARAM_NORMAL:
                 /* Ok, now just convert argument normally */
                 g_assert_cmpuint(js_arg_pos, <, js_argc);
-                if (!gjs_value_to_arg(context, js_argv[js_arg_pos], &arg_info,
-                                      in_value)) {
+                if (!gjs_value_to_g_argument(context, js_argv[js_arg_pos],
+                                             &arg_cache->type_info,
+                                             g_base_info_get_name( (GIBaseInfo*) &arg_cache->arg_info),
+                                             (arg_cache->is_return_value ?
+                                              GJS_ARGUMENT_RETURN_VALUE : GJS_ARGUMENT_ARGUMENT),
+                                             arg_cache->transfer,
+                                             arg_cache->may_be_null,
+                                             in_value)) {
                     failed = TRUE;
                     break;
                 }
+
+                if (arg_cache->is_bytes && in_value->v_pointer != NULL &&
+                    gjs_typecheck_bytearray(context, JSVAL_TO_OBJECT(js_argv[js_arg_pos]), FALSE))
+                    bytes_ref_cvalues[c_arg_pos] = TRUE;
             }
 
             if (direction == GI_DIRECTION_INOUT && !arg_removed && !failed) {
@@ -869,7 +1034,7 @@ gjs_invoke_c_function(JSContext      *context,
         goto release;
     }
 
-    if (can_throw_gerror) {
+    if (function->can_throw_gerror) {
         g_assert_cmpuint(c_arg_pos, <, c_argc);
         in_arg_cvalues[c_arg_pos].v_pointer = &local_error;
         ffi_arg_pointers[c_arg_pos] = &(in_arg_cvalues[c_arg_pos]);
@@ -882,21 +1047,13 @@ gjs_invoke_c_function(JSContext      *context,
     g_assert_cmpuint(c_arg_pos, ==, c_argc);
     g_assert_cmpuint(gi_arg_pos, ==, gi_argc);
 
-    /* See comment for GjsFFIReturnValue above */
-    if (return_tag == GI_TYPE_TAG_FLOAT)
-        return_value_p = &return_value.v_float;
-    else if (return_tag == GI_TYPE_TAG_DOUBLE)
-        return_value_p = &return_value.v_double;
-    else if (return_tag == GI_TYPE_TAG_INT64 || return_tag == GI_TYPE_TAG_UINT64)
-        return_value_p = &return_value.v_uint64;
-    else
-        return_value_p = &return_value.v_long;
+    return_value_p = get_return_value_pointer(return_tag, &return_value);
     ffi_call(&(function->invoker.cif), function->invoker.native_address, return_value_p, ffi_arg_pointers);
 
     /* Return value and out arguments are valid only if invocation doesn't
      * return error. In arguments need to be released always.
      */
-    if (can_throw_gerror) {
+    if (function->can_throw_gerror) {
         did_throw_gerror = local_error != NULL;
     } else {
         did_throw_gerror = FALSE;
@@ -906,55 +1063,51 @@ gjs_invoke_c_function(JSContext      *context,
 
     /* Only process return values if the function didn't throw */
     if (function->js_out_argc > 0 && !did_throw_gerror) {
-        return_values = g_newa(jsval, function->js_out_argc);
-        gjs_set_values(context, return_values, function->js_out_argc, JSVAL_VOID);
-        gjs_root_value_locations(context, return_values, function->js_out_argc);
+        return_values = gjs_runtime_push_values(JS_GetRuntime(context),
+                                                function->js_out_argc);
 
         if (return_tag != GI_TYPE_TAG_VOID) {
-            GITransfer transfer = g_callable_info_get_caller_owns((GICallableInfo*) function->info);
+            GITransfer transfer = function->return_transfer;
             gboolean arg_failed;
             gint array_length_pos;
 
             g_assert_cmpuint(next_rval, <, function->js_out_argc);
 
-            gi_type_info_extract_ffi_return_value(&return_info, &return_value, &return_gargument);
+            gi_type_info_extract_ffi_return_value(&function->return_info, &return_value, &return_gargument);
 
-            array_length_pos = g_type_info_get_array_length(&return_info);
+            array_length_pos = function->return_array_length_pos;
             if (array_length_pos >= 0) {
-                GIArgInfo array_length_arg;
-                GITypeInfo arg_type_info;
+                GjsArgCache *length_cache = &function->args[array_length_pos];
                 jsval length;
 
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-                g_arg_info_load_type(&array_length_arg, &arg_type_info);
                 array_length_pos += is_method ? 1 : 0;
                 arg_failed = !gjs_value_from_g_argument(context, &length,
-                                                        &arg_type_info,
+                                                        &length_cache->type_info,
                                                         &out_arg_cvalues[array_length_pos],
                                                         TRUE);
                 if (!arg_failed) {
                     arg_failed = !gjs_value_from_explicit_array(context,
                                                                 &return_values[next_rval],
-                                                                &return_info,
+                                                                &function->return_info,
                                                                 &return_gargument,
                                                                 JSVAL_TO_INT(length));
                 }
                 if (!arg_failed &&
                     !gjs_g_argument_release_out_array(context,
                                                       transfer,
-                                                      &return_info,
+                                                      &function->return_info,
                                                       JSVAL_TO_INT(length),
                                                       &return_gargument))
                     failed = TRUE;
             } else {
                 arg_failed = !gjs_value_from_g_argument(context, &return_values[next_rval],
-                                                        &return_info, &return_gargument,
+                                                        &function->return_info, &return_gargument,
                                                         TRUE);
                 /* Free GArgument, the jsval should have ref'd or copied it */
                 if (!arg_failed &&
                     !gjs_g_argument_release(context,
                                             transfer,
-                                            &return_info,
+                                            &function->return_info,
                                             &return_gargument))
                     failed = TRUE;
             }
@@ -972,16 +1125,9 @@ release:
     c_arg_pos = is_method ? 1 : 0;
     postinvoke_release_failed = FALSE;
     for (gi_arg_pos = 0; gi_arg_pos < gi_argc && c_arg_pos < processed_c_args; gi_arg_pos++, c_arg_pos++) {
-        GIDirection direction;
-        GIArgInfo arg_info;
-        GITypeInfo arg_type_info;
-        GjsParamType param_type;
-
-        g_callable_info_load_arg( (GICallableInfo*) function->info, gi_arg_pos, &arg_info);
-        direction = g_arg_info_get_direction(&arg_info);
-
-        g_arg_info_load_type(&arg_info, &arg_type_info);
-        param_type = function->param_types[gi_arg_pos];
+        GjsArgCache *arg_cache = &function->args[gi_arg_pos];
+        GIDirection direction = arg_cache->direction;
+        GjsParamType param_type = arg_cache->param_type;
 
         if (direction == GI_DIRECTION_IN || direction == GI_DIRECTION_INOUT) {
             GArgument *arg;
@@ -989,7 +1135,7 @@ release:
 
             if (direction == GI_DIRECTION_IN) {
                 arg = &in_arg_cvalues[c_arg_pos];
-                transfer = g_arg_info_get_ownership_transfer(&arg_info);
+                transfer = arg_cache->transfer;
             } else {
                 arg = &inout_original_arg_cvalues[c_arg_pos];
                 /* For inout, transfer refers to what we get back from the function; for
@@ -1008,25 +1154,26 @@ release:
                     gjs_callback_trampoline_unref(trampoline);
                     arg->v_pointer = NULL;
                 }
+            } else if (pinned_bytes[c_arg_pos] != NULL) {
+                g_bytes_unref(pinned_bytes[c_arg_pos]);
+            } else if (bytes_ref_cvalues[c_arg_pos]) {
+                g_bytes_unref(arg->v_pointer);
             } else if (param_type == PARAM_ARRAY) {
                 gsize length;
-                GIArgInfo array_length_arg;
-                GITypeInfo array_length_type;
-                gint array_length_pos = g_type_info_get_array_length(&arg_type_info);
+                gint array_length_pos = arg_cache->array_length_pos;
+                GjsArgCache *length_cache;
 
                 g_assert(array_length_pos >= 0);
 
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-                g_arg_info_load_type(&array_length_arg, &array_length_type);
-
+                length_cache = &function->args[array_length_pos];
                 array_length_pos += is_method ? 1 : 0;
 
                 length = get_length_from_arg(in_arg_cvalues + array_length_pos,
-                                             g_type_info_get_tag(&array_length_type));
+                                             length_cache->type_tag);
 
                 if (!gjs_g_argument_release_in_array(context,
                                                      transfer,
-                                                     &arg_type_info,
+                                                     &arg_cache->type_info,
                                                      length,
                                                      arg)) {
                     postinvoke_release_failed = TRUE;
@@ -1034,7 +1181,7 @@ release:
             } else if (param_type == PARAM_NORMAL) {
                 if (!gjs_g_argument_release_in_arg(context,
                                                    transfer,
-                                                   &arg_type_info,
+                                                   &arg_cache->type_info,
                                                    arg)) {
                     postinvoke_release_failed = TRUE;
                 }
@@ -1053,35 +1200,31 @@ release:
             gboolean arg_failed;
             gint array_length_pos;
             jsval array_length;
-            GITransfer transfer;
 
             g_assert(next_rval < function->js_out_argc);
 
             arg = &out_arg_cvalues[c_arg_pos];
 
-            array_length_pos = g_type_info_get_array_length(&arg_type_info);
+            array_length_pos = arg_cache->array_length_pos;
             if (array_length_pos >= 0) {
-                GIArgInfo array_length_arg;
-                GITypeInfo array_length_type_info;
+                GjsArgCache *length_cache = &function->args[array_length_pos];
 
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-                g_arg_info_load_type(&array_length_arg, &array_length_type_info);
                 array_length_pos += is_method ? 1 : 0;
                 arg_failed = !gjs_value_from_g_argument(context, &array_length,
-                                                        &array_length_type_info,
+                                                        &length_cache->type_info,
                                                         &out_arg_cvalues[array_length_pos],
                                                         TRUE);
                 if (!arg_failed) {
                     arg_failed = !gjs_value_from_explicit_array(context,
                                                                 &return_values[next_rval],
-                                                                &arg_type_info,
+                                                                &arg_cache->type_info,
                                                                 arg,
                                                                 JSVAL_TO_INT(array_length));
                 }
             } else {
                 arg_failed = !gjs_value_from_g_argument(context,
                                                         &return_values[next_rval],
-                                                        &arg_type_info,
+                                                        &arg_cache->type_info,
                                                         arg,
                                                         TRUE);
             }
@@ -1095,44 +1238,27 @@ release:
              * here we release the memory allocated above.  It would be
              * better to special case this and directly hand JS the boxed
              * object and tell gjs_boxed it owns the memory, but for now
-             * this works OK.  We could also alloca() the structure instead
-             * of slice allocating.
+             * this works OK.  The structure comes from the payload free
+             * lists, so the allocation is cheap.
              */
-            if (g_arg_info_is_caller_allocates(&arg_info)) {
-                GITypeTag type_tag;
-                GIBaseInfo* interface_info;
-                GIInfoType interface_type;
-                gsize size;
-
-                type_tag = g_type_info_get_tag(&arg_type_info);
-                g_assert(type_tag == GI_TYPE_TAG_INTERFACE);
-                interface_info = g_type_info_get_interface(&arg_type_info);
-                interface_type = g_base_info_get_type(interface_info);
-                if (interface_type == GI_INFO_TYPE_STRUCT) {
-                    size = g_struct_info_get_size((GIStructInfo*)interface_info);
-                } else if (interface_type == GI_INFO_TYPE_UNION) {
-                    size = g_union_info_get_size((GIUnionInfo*)interface_info);
-                } else {
-                    g_assert_not_reached();
-                }
-
-                g_slice_free1(size, out_arg_cvalues[c_arg_pos].v_pointer);
-                g_base_info_unref((GIBaseInfo*)interface_info);
+            if (arg_cache->caller_allocates) {
+                g_assert(arg_cache->caller_allocates_size > 0);
+                gjs_boxed_payload_free(arg_cache->caller_allocates_size,
+                                       out_arg_cvalues[c_arg_pos].v_pointer);
             }
 
             /* Free GArgument, the jsval should have ref'd or copied it */
-            transfer = g_arg_info_get_ownership_transfer(&arg_info);
             if (!arg_failed) {
                 if (array_length_pos >= 0) {
                     gjs_g_argument_release_out_array(context,
-                                                     transfer,
-                                                     &arg_type_info,
+                                                     arg_cache->transfer,
+                                                     &arg_cache->type_info,
                                                      JSVAL_TO_INT(array_length),
                                                      arg);
                 } else {
                     gjs_g_argument_release(context,
-                                           transfer,
-                                           &arg_type_info,
+                                           arg_cache->transfer,
+                                           &arg_cache->type_info,
                                            arg);
                 }
             }
@@ -1165,10 +1291,14 @@ release:
                 *js_rval = OBJECT_TO_JSVAL(array);
             }
         }
-
-        gjs_unroot_value_locations(context, return_values, function->js_out_argc);
     }
 
+    /* The value stack is strictly LIFO, so this has to happen on
+     * failure too, or the next pop further up the stack aborts */
+    if (return_values != NULL)
+        gjs_runtime_pop_values(JS_GetRuntime(context), return_values,
+                               function->js_out_argc);
+
     if (!failed && did_throw_gerror) {
         gjs_throw_g_error(context, local_error);
         return JS_FALSE;
@@ -1179,6 +1309,23 @@ release:
     }
 }
 
+static char *
+format_profile_label(Function *function)
+{
+    GIBaseInfo *info = (GIBaseInfo *) function->info;
+    GIBaseInfo *container = g_base_info_get_container(info);
+
+    if (container != NULL)
+        return g_strdup_printf("%s.%s.%s",
+                               g_base_info_get_namespace(info),
+                               g_base_info_get_name(container),
+                               g_base_info_get_name(info));
+
+    return g_strdup_printf("%s.%s",
+                           g_base_info_get_namespace(info),
+                           g_base_info_get_name(info));
+}
+
 static JSBool
 function_call(JSContext *context,
               unsigned   js_argc,
@@ -1188,6 +1335,7 @@ function_call(JSContext *context,
     JSObject *object = JS_THIS_OBJECT(context, vp);
     JSObject *callee = JSVAL_TO_OBJECT(JS_CALLEE(context, vp));
     JSBool success;
+    gboolean profiled;
     Function *priv;
     jsval retval;
 
@@ -1199,8 +1347,21 @@ function_call(JSContext *context,
     if (priv == NULL)
         return JS_TRUE; /* we are the prototype, or have the wrong class */
 
+    profiled = gjs_profiler_is_sampling();
+    if (G_UNLIKELY(profiled)) {
+        if (priv->profile_label == NULL)
+            priv->profile_label = format_profile_label(priv);
+        gjs_profiler_push_native(priv->profile_label, &retval);
+    }
+
+    if (priv->scalar_fast_path)
+        success = gjs_invoke_c_function_scalar(context, priv, object, js_argc, js_argv, &retval);
+    else
+        success = gjs_invoke_c_function(context, priv, object, js_argc, js_argv, &retval);
+
+    if (G_UNLIKELY(profiled))
+        gjs_profiler_pop_native();
 
-    success = gjs_invoke_c_function(context, priv, object, js_argc, js_argv, &retval);
     if (success)
         JS_SET_RVAL(context, vp, retval);
 
@@ -1217,8 +1378,9 @@ uninit_cached_function_data (Function *function)
 {
     if (function->info)
         g_base_info_unref( (GIBaseInfo*) function->info);
-    if (function->param_types)
-        g_free(function->param_types);
+    if (function->args)
+        g_free(function->args);
+    g_free(function->profile_label);
 
     g_function_invoker_destroy(&function->invoker);
 }
@@ -1256,17 +1418,13 @@ get_num_arguments (JSContext *context,
     if (priv == NULL)
         return JS_FALSE;
 
-    n_args = g_callable_info_get_n_args(priv->info);
+    n_args = priv->gi_argc;
     n_jsargs = 0;
     for (i = 0; i < n_args; i++) {
-        GIArgInfo arg_info;
-
-        if (priv->param_types[i] == PARAM_SKIPPED)
+        if (priv->args[i].param_type == PARAM_SKIPPED)
             continue;
 
-        g_callable_info_load_arg(priv->info, i, &arg_info);
-
-        if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_OUT)
+        if (priv->args[i].direction == GI_DIRECTION_OUT)
             continue;
     }
 
@@ -1305,25 +1463,23 @@ function_to_string (JSContext *context,
 
     free = TRUE;
 
-    n_args = g_callable_info_get_n_args(priv->info);
+    n_args = priv->gi_argc;
     n_jsargs = 0;
     arg_names_str = g_string_new("");
     for (i = 0; i < n_args; i++) {
-        GIArgInfo arg_info;
+        GjsArgCache *arg_cache = &priv->args[i];
 
-        if (priv->param_types[i] == PARAM_SKIPPED)
+        if (arg_cache->param_type == PARAM_SKIPPED)
             continue;
 
-        g_callable_info_load_arg(priv->info, i, &arg_info);
-
-        if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_OUT)
+        if (arg_cache->direction == GI_DIRECTION_OUT)
             continue;
 
         if (n_jsargs > 0)
             g_string_append(arg_names_str, ", ");
 
         n_jsargs++;
-        g_string_append(arg_names_str, g_base_info_get_name(&arg_info));
+        g_string_append(arg_names_str, g_base_info_get_name((GIBaseInfo*) &arg_cache->arg_info));
     }
     arg_names = g_string_free(arg_names_str, FALSE);
 
@@ -1387,6 +1543,334 @@ static JSFunctionSpec gjs_function_proto_funcs[] = {
     JS_FS_END
 };
 
+/* Fills in everything about argument @index of @info that does not
+ * depend on the other arguments; param_type is worked out afterwards by
+ * init_cached_function_data() since it needs the whole signature.
+ */
+static void
+init_arg_cache(GjsArgCache    *arg_cache,
+               GICallableInfo *info,
+               int             index)
+{
+    g_callable_info_load_arg(info, index, &arg_cache->arg_info);
+    g_arg_info_load_type(&arg_cache->arg_info, &arg_cache->type_info);
+
+    arg_cache->direction = g_arg_info_get_direction(&arg_cache->arg_info);
+    arg_cache->type_tag = g_type_info_get_tag(&arg_cache->type_info);
+    arg_cache->transfer = g_arg_info_get_ownership_transfer(&arg_cache->arg_info);
+    arg_cache->may_be_null = g_arg_info_may_be_null(&arg_cache->arg_info);
+    arg_cache->is_return_value = g_arg_info_is_return_value(&arg_cache->arg_info);
+    arg_cache->array_length_pos = -1;
+
+    if (arg_cache->type_tag == GI_TYPE_TAG_ARRAY &&
+        g_type_info_get_array_type(&arg_cache->type_info) == GI_ARRAY_TYPE_C)
+        arg_cache->array_length_pos = g_type_info_get_array_length(&arg_cache->type_info);
+
+    if (arg_cache->direction == GI_DIRECTION_OUT &&
+        g_arg_info_is_caller_allocates(&arg_cache->arg_info)) {
+        arg_cache->caller_allocates = TRUE;
+
+        /* Unsupported types are left with a size of 0, and we throw
+         * when the function is actually invoked.
+         */
+        if (arg_cache->type_tag == GI_TYPE_TAG_INTERFACE) {
+            GIBaseInfo *interface_info;
+            GIInfoType interface_type;
+
+            interface_info = g_type_info_get_interface(&arg_cache->type_info);
+            g_assert(interface_info != NULL);
+
+            interface_type = g_base_info_get_type(interface_info);
+            if (interface_type == GI_INFO_TYPE_STRUCT)
+                arg_cache->caller_allocates_size = g_struct_info_get_size((GIStructInfo*)interface_info);
+            else if (interface_type == GI_INFO_TYPE_UNION)
+                arg_cache->caller_allocates_size = g_union_info_get_size((GIUnionInfo*)interface_info);
+
+            g_base_info_unref(interface_info);
+        }
+    }
+}
+
+static JSBool
+marshal_generic_in(JSContext   *context,
+                   GjsArgCache *arg_cache,
+                   jsval        value,
+                   GArgument   *arg)
+{
+    return gjs_value_to_g_argument(context, value,
+                                   &arg_cache->type_info,
+                                   g_base_info_get_name( (GIBaseInfo*) &arg_cache->arg_info),
+                                   GJS_ARGUMENT_ARGUMENT,
+                                   arg_cache->transfer,
+                                   arg_cache->may_be_null,
+                                   arg);
+}
+
+/* The scalar marshallers below only handle the common case of a JS
+ * value that already has the right representation, and defer to
+ * gjs_value_to_g_argument() for everything else so that coercions and
+ * error messages stay exactly the same.
+ */
+static JSBool
+marshal_int_in(JSContext   *context,
+               GjsArgCache *arg_cache,
+               jsval        value,
+               GArgument   *arg)
+{
+    gint32 i;
+
+    if (!JSVAL_IS_INT(value))
+        return marshal_generic_in(context, arg_cache, value, arg);
+
+    i = JSVAL_TO_INT(value);
+
+    switch (arg_cache->type_tag) {
+    case GI_TYPE_TAG_INT8:
+        if (i < G_MININT8 || i > G_MAXINT8)
+            break;
+        arg->v_int8 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT8:
+        if (i < 0 || i > G_MAXUINT8)
+            break;
+        arg->v_uint8 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_INT16:
+        if (i < G_MININT16 || i > G_MAXINT16)
+            break;
+        arg->v_int16 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT16:
+        if (i < 0 || i > G_MAXUINT16)
+            break;
+        arg->v_uint16 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_INT32:
+        arg->v_int32 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT32:
+        if (i < 0)
+            break;
+        arg->v_uint32 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_INT64:
+        arg->v_int64 = i;
+        return JS_TRUE;
+    case GI_TYPE_TAG_UINT64:
+        if (i < 0)
+            break;
+        arg->v_uint64 = i;
+        return JS_TRUE;
+    default:
+        g_assert_not_reached();
+    }
+
+    /* Out of range, let the generic code report it */
+    return marshal_generic_in(context, arg_cache, value, arg);
+}
+
+static JSBool
+marshal_double_in(JSContext   *context,
+                  GjsArgCache *arg_cache,
+                  jsval        value,
+                  GArgument   *arg)
+{
+    if (JSVAL_IS_DOUBLE(value))
+        arg->v_double = JSVAL_TO_DOUBLE(value);
+    else if (JSVAL_IS_INT(value))
+        arg->v_double = JSVAL_TO_INT(value);
+    else
+        return marshal_generic_in(context, arg_cache, value, arg);
+
+    return JS_TRUE;
+}
+
+static JSBool
+marshal_float_in(JSContext   *context,
+                 GjsArgCache *arg_cache,
+                 jsval        value,
+                 GArgument   *arg)
+{
+    if (JSVAL_IS_INT(value)) {
+        arg->v_float = JSVAL_TO_INT(value);
+        return JS_TRUE;
+    } else if (JSVAL_IS_DOUBLE(value)) {
+        double v = JSVAL_TO_DOUBLE(value);
+
+        if (v <= G_MAXFLOAT && v >= - G_MAXFLOAT) {
+            arg->v_float = v;
+            return JS_TRUE;
+        }
+    }
+
+    return marshal_generic_in(context, arg_cache, value, arg);
+}
+
+static JSBool
+marshal_boolean_in(JSContext   *context,
+                   GjsArgCache *arg_cache,
+                   jsval        value,
+                   GArgument   *arg)
+{
+    if (!JSVAL_IS_BOOLEAN(value))
+        return marshal_generic_in(context, arg_cache, value, arg);
+
+    arg->v_boolean = JSVAL_TO_BOOLEAN(value);
+    return JS_TRUE;
+}
+
+static JSBool
+marshal_object_in(JSContext   *context,
+                  GjsArgCache *arg_cache,
+                  jsval        value,
+                  GArgument   *arg)
+{
+    if (!JSVAL_IS_NULL(value) && JSVAL_IS_OBJECT(value) &&
+        gjs_typecheck_object(context, JSVAL_TO_OBJECT(value),
+                             arg_cache->gtype, JS_FALSE)) {
+        arg->v_pointer = gjs_g_object_from_object(context, JSVAL_TO_OBJECT(value));
+        if (arg->v_pointer != NULL)
+            return JS_TRUE;
+    }
+
+    /* null, wrong type, or already disposed: generic code handles
+     * (and reports) all of those.
+     */
+    return marshal_generic_in(context, arg_cache, value, arg);
+}
+
+/* Returns the fast-path marshaller for an (in) argument, or NULL if
+ * the argument might need to be released after the call.
+ */
+static GjsArgMarshaller
+get_scalar_marshaller(GjsArgCache *arg_cache)
+{
+    switch (arg_cache->type_tag) {
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_UINT8:
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_UINT16:
+    case GI_TYPE_TAG_INT32:
+    case GI_TYPE_TAG_UINT32:
+    case GI_TYPE_TAG_INT64:
+    case GI_TYPE_TAG_UINT64:
+        return marshal_int_in;
+    case GI_TYPE_TAG_FLOAT:
+        return marshal_float_in;
+    case GI_TYPE_TAG_DOUBLE:
+        return marshal_double_in;
+    case GI_TYPE_TAG_BOOLEAN:
+        return marshal_boolean_in;
+    case GI_TYPE_TAG_INTERFACE: {
+        GIBaseInfo *interface_info;
+        GIInfoType interface_type;
+        GjsArgMarshaller marshaller = NULL;
+
+        interface_info = g_type_info_get_interface(&arg_cache->type_info);
+        interface_type = g_base_info_get_type(interface_info);
+
+        if (interface_type == GI_INFO_TYPE_ENUM ||
+            interface_type == GI_INFO_TYPE_FLAGS) {
+            /* Needs the validity checks from the generic code, but never
+             * needs releasing.
+             */
+            marshaller = marshal_generic_in;
+        } else if ((interface_type == GI_INFO_TYPE_OBJECT ||
+                    interface_type == GI_INFO_TYPE_INTERFACE) &&
+                   arg_cache->transfer == GI_TRANSFER_NOTHING) {
+            GType gtype = g_registered_type_info_get_g_type((GIRegisteredTypeInfo*)interface_info);
+
+            if (g_type_is_a(gtype, G_TYPE_OBJECT) || g_type_is_a(gtype, G_TYPE_INTERFACE)) {
+                arg_cache->gtype = gtype;
+                marshaller = marshal_object_in;
+            }
+        }
+
+        g_base_info_unref(interface_info);
+        return marshaller;
+    }
+    default:
+        return NULL;
+    }
+}
+
+/* Whether the return value can be converted and then simply dropped,
+ * i.e. gjs_g_argument_release() would be a no-op for it.
+ */
+static gboolean
+return_value_is_scalar(Function *function)
+{
+    switch (function->return_tag) {
+    case GI_TYPE_TAG_VOID:
+    case GI_TYPE_TAG_BOOLEAN:
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_UINT8:
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_UINT16:
+    case GI_TYPE_TAG_INT32:
+    case GI_TYPE_TAG_UINT32:
+    case GI_TYPE_TAG_INT64:
+    case GI_TYPE_TAG_UINT64:
+    case GI_TYPE_TAG_FLOAT:
+    case GI_TYPE_TAG_DOUBLE:
+        return TRUE;
+    case GI_TYPE_TAG_INTERFACE: {
+        GIBaseInfo *interface_info;
+        GIInfoType interface_type;
+        gboolean result;
+
+        interface_info = g_type_info_get_interface(&function->return_info);
+        interface_type = g_base_info_get_type(interface_info);
+        result = interface_type == GI_INFO_TYPE_ENUM ||
+            interface_type == GI_INFO_TYPE_FLAGS ||
+            ((interface_type == GI_INFO_TYPE_OBJECT ||
+              interface_type == GI_INFO_TYPE_INTERFACE) &&
+             function->return_transfer == GI_TRANSFER_NOTHING);
+        g_base_info_unref(interface_info);
+
+        return result;
+    }
+    default:
+        return FALSE;
+    }
+}
+
+/* Most setters and getters take and return nothing but numbers,
+ * booleans, enums and GObjects; for those we can bind
+ * gjs_invoke_c_function_scalar() instead of the generic invoker.
+ * Setting GJS_DISABLE_FAST_MARSHALLING in the environment turns this
+ * off, for comparison and debugging.
+ */
+static void
+init_scalar_fast_path(Function *function)
+{
+    static int disabled = -1;
+    guint8 i;
+
+    if (G_UNLIKELY(disabled < 0))
+        disabled = g_getenv("GJS_DISABLE_FAST_MARSHALLING") != NULL;
+
+    if (disabled)
+        return;
+
+    if (function->can_throw_gerror || !return_value_is_scalar(function))
+        return;
+
+    for (i = 0; i < function->gi_argc; i++) {
+        GjsArgCache *arg_cache = &function->args[i];
+
+        if (arg_cache->direction != GI_DIRECTION_IN ||
+            arg_cache->param_type != PARAM_NORMAL)
+            return;
+
+        arg_cache->marshaller = get_scalar_marshaller(arg_cache);
+        if (arg_cache->marshaller == NULL)
+            return;
+    }
+
+    function->scalar_fast_path = TRUE;
+}
+
 static gboolean
 init_cached_function_data (JSContext      *context,
                            Function       *function,
@@ -1433,52 +1917,59 @@ init_cached_function_data (JSContext      *context,
         function->js_out_argc += 1;
 
     n_args = g_callable_info_get_n_args((GICallableInfo*) info);
-    function->param_types = g_new0(GjsParamType, n_args);
+    function->gi_argc = n_args;
+    function->args = g_new0(GjsArgCache, n_args);
+    for (i = 0; i < n_args; i++)
+        init_arg_cache(&function->args[i], info, i);
+
+    function->is_method = g_callable_info_is_method(info);
+    function->can_throw_gerror = g_callable_info_can_throw_gerror(info);
+    function->return_info = return_type;
+    function->return_tag = g_type_info_get_tag(&return_type);
+    function->return_transfer = g_callable_info_get_caller_owns(info);
 
     array_length_pos = g_type_info_get_array_length(&return_type);
+    function->return_array_length_pos = array_length_pos;
     if (array_length_pos >= 0 && array_length_pos < n_args)
-        function->param_types[array_length_pos] = PARAM_SKIPPED;
+        function->args[array_length_pos].param_type = PARAM_SKIPPED;
 
     for (i = 0; i < n_args; i++) {
         GIDirection direction;
-        GIArgInfo arg_info;
-        GITypeInfo type_info;
+        GIArgInfo *arg_info;
         int destroy = -1;
         int closure = -1;
         GITypeTag type_tag;
 
-        if (function->param_types[i] == PARAM_SKIPPED)
+        if (function->args[i].param_type == PARAM_SKIPPED)
             continue;
 
-        g_callable_info_load_arg((GICallableInfo*) info, i, &arg_info);
-        g_arg_info_load_type(&arg_info, &type_info);
-
-        direction = g_arg_info_get_direction(&arg_info);
-        type_tag = g_type_info_get_tag(&type_info);
+        arg_info = &function->args[i].arg_info;
+        direction = function->args[i].direction;
+        type_tag = function->args[i].type_tag;
 
         if (type_tag == GI_TYPE_TAG_INTERFACE) {
             GIBaseInfo* interface_info;
             GIInfoType interface_type;
 
-            interface_info = g_type_info_get_interface(&type_info);
+            interface_info = g_type_info_get_interface(&function->args[i].type_info);
             interface_type = g_base_info_get_type(interface_info);
             if (interface_type == GI_INFO_TYPE_CALLBACK) {
                 if (strcmp(g_base_info_get_name(interface_info), "DestroyNotify") == 0 &&
                     strcmp(g_base_info_get_namespace(interface_info), "GLib") == 0) {
                     /* Skip GDestroyNotify if they appear before the respective callback */
-                    function->param_types[i] = PARAM_SKIPPED;
+                    function->args[i].param_type = PARAM_SKIPPED;
                 } else {
-                    function->param_types[i] = PARAM_CALLBACK;
+                    function->args[i].param_type = PARAM_CALLBACK;
                     function->expected_js_argc += 1;
 
-                    destroy = g_arg_info_get_destroy(&arg_info);
-                    closure = g_arg_info_get_closure(&arg_info);
+                    destroy = g_arg_info_get_destroy(arg_info);
+                    closure = g_arg_info_get_closure(arg_info);
 
                     if (destroy >= 0 && destroy < n_args)
-                        function->param_types[destroy] = PARAM_SKIPPED;
+                        function->args[destroy].param_type = PARAM_SKIPPED;
 
                     if (closure >= 0 && closure < n_args)
-                        function->param_types[closure] = PARAM_SKIPPED;
+                        function->args[closure].param_type = PARAM_SKIPPED;
 
                     if (destroy >= 0 && closure < 0) {
                         gjs_throw(context, "Function %s.%s has a GDestroyNotify but no user_data, not supported",
@@ -1488,25 +1979,43 @@ init_cached_function_data (JSContext      *context,
                         return JS_FALSE;
                     }
                 }
+            } else if ((interface_type == GI_INFO_TYPE_STRUCT ||
+                        interface_type == GI_INFO_TYPE_BOXED) &&
+                       direction == GI_DIRECTION_IN &&
+                       function->args[i].transfer == GI_TRANSFER_NOTHING) {
+                GType gtype = g_registered_type_info_get_g_type((GIRegisteredTypeInfo*) interface_info);
+
+                function->args[i].is_bytes = g_type_is_a(gtype, G_TYPE_BYTES);
             }
             g_base_info_unref(interface_info);
         } else if (type_tag == GI_TYPE_TAG_ARRAY) {
-            if (g_type_info_get_array_type(&type_info) == GI_ARRAY_TYPE_C) {
-                array_length_pos = g_type_info_get_array_length(&type_info);
+            if (g_type_info_get_array_type(&function->args[i].type_info) == GI_ARRAY_TYPE_C) {
+                array_length_pos = function->args[i].array_length_pos;
 
                 if (array_length_pos >= 0 && array_length_pos < n_args) {
-                    GIArgInfo length_arg_info;
-
-                    g_callable_info_load_arg((GICallableInfo*) info, array_length_pos, &length_arg_info);
-                    if (g_arg_info_get_direction(&length_arg_info) != direction) {
+                    if (function->args[array_length_pos].direction != direction) {
                         gjs_throw(context, "Function %s.%s has an array with different-direction length arg, not supported",
                                   g_base_info_get_namespace( (GIBaseInfo*) info),
                                   g_base_info_get_name( (GIBaseInfo*) info));
                         return JS_FALSE;
                     }
 
-                    function->param_types[array_length_pos] = PARAM_SKIPPED;
-                    function->param_types[i] = PARAM_ARRAY;
+                    function->args[array_length_pos].param_type = PARAM_SKIPPED;
+                    function->args[i].param_type = PARAM_ARRAY;
+
+                    if (direction == GI_DIRECTION_IN &&
+                        function->args[i].transfer == GI_TRANSFER_NOTHING) {
+                        GITypeInfo *param_info;
+                        GITypeTag element_tag;
+
+                        param_info = g_type_info_get_param_type(&function->args[i].type_info, 0);
+                        element_tag = g_type_info_get_tag(param_info);
+                        g_base_info_unref((GIBaseInfo*) param_info);
+
+                        function->args[i].may_borrow_bytes =
+                            (element_tag == GI_TYPE_TAG_UINT8 ||
+                             element_tag == GI_TYPE_TAG_INT8);
+                    }
 
                     if (array_length_pos < i) {
                         /* we already collected array_length_pos, remove it */
@@ -1519,8 +2028,8 @@ init_cached_function_data (JSContext      *context,
             }
         }
 
-        if (function->param_types[i] == PARAM_NORMAL ||
-            function->param_types[i] == PARAM_ARRAY) {
+        if (function->args[i].param_type == PARAM_NORMAL ||
+            function->args[i].param_type == PARAM_ARRAY) {
             if (direction == GI_DIRECTION_IN || direction == GI_DIRECTION_INOUT)
                 function->expected_js_argc += 1;
             if (direction == GI_DIRECTION_OUT || direction == GI_DIRECTION_INOUT)
@@ -1528,6 +2037,8 @@ init_cached_function_data (JSContext      *context,
         }
     }
 
+    init_scalar_fast_path(function);
+
     function->info = info;
 
     g_base_info_ref((GIBaseInfo*) function->info);
@@ -130,8 +130,11 @@ gjs_gtype_create_gtype_wrapper (JSContext *context,
     gjs_gtype_create_proto(context, global, "GIRepositoryGType", NULL);
 
     object = g_type_get_qdata(gtype, gjs_get_gtype_wrapper_quark());
-    if (object != NULL)
+    if (object != NULL) {
+        /* weak pointer, see gjs_gc_object_barrier() */
+        gjs_gc_object_barrier(JS_GetRuntime(context), object);
         goto out;
+    }
 
     object = JS_NewObject(context, &gjs_gtype_class, NULL, NULL);
     if (object == NULL)
@@ -30,16 +30,27 @@
 #include <gjs/runtime.h>
 
 #include <util/log.h>
-#include <util/glib.h>
 
+/* Children live in a slot vector, so that a GC traces them with a
+ * linear scan over one array. A GjsKeepAliveHandle is the index of a
+ * child's slot plus one; removed slots are chained into a free list
+ * through next_free and reused by the next additions, so handles stay
+ * valid until their child is removed.
+ */
 typedef struct {
     GjsUnrootedFunc notify;
     JSObject *child;
     void *data;
+    guint next_free; /* handle of the next free slot, if this one is free */
+    guint in_use : 1;
 } Child;
 
 typedef struct {
-    GHashTable *children;
+    Child *slots;
+    guint n_slots;
+    guint n_allocated;
+    guint n_children;
+    guint free_head; /* handle of the first free slot, 0 if none */
     unsigned int inside_finalize : 1;
     unsigned int inside_trace : 1;
 } KeepAlive;
@@ -48,35 +59,47 @@ static struct JSClass gjs_keep_alive_class;
 
 GJS_DEFINE_PRIV_FROM_JS(KeepAlive, gjs_keep_alive_class)
 
-static guint
-child_hash(gconstpointer  v)
+static Child *
+child_from_handle(KeepAlive          *priv,
+                  GjsKeepAliveHandle  handle)
 {
-    const Child *child = v;
+    if (handle == 0 || handle > priv->n_slots)
+        return NULL;
 
-    return
-        GPOINTER_TO_UINT(child->notify) ^
-        GPOINTER_TO_UINT(child->child) ^
-        GPOINTER_TO_UINT(child->data);
+    return &priv->slots[handle - 1];
 }
 
-static gboolean
-child_equal (gconstpointer  v1,
-             gconstpointer  v2)
+static GjsKeepAliveHandle
+child_alloc(KeepAlive *priv)
 {
-    const Child *child1 = v1;
-    const Child *child2 = v2;
+    GjsKeepAliveHandle handle;
+
+    if (priv->free_head != 0) {
+        handle = priv->free_head;
+        priv->free_head = priv->slots[handle - 1].next_free;
+        return handle;
+    }
 
-    /* notify is most likely to be equal, so check it last */
-    return child1->data == child2->data &&
-        child1->child == child2->child &&
-        child1->notify == child2->notify;
+    if (priv->n_slots == priv->n_allocated) {
+        priv->n_allocated = MAX(16, priv->n_allocated * 2);
+        priv->slots = g_renew(Child, priv->slots, priv->n_allocated);
+    }
+
+    return ++priv->n_slots;
 }
 
 static void
-child_free(void *data)
+child_free(KeepAlive          *priv,
+           GjsKeepAliveHandle  handle)
 {
-    Child *child = data;
-    g_slice_free(Child, child);
+    Child *child = &priv->slots[handle - 1];
+
+    child->notify = NULL;
+    child->child = NULL;
+    child->data = NULL;
+    child->in_use = FALSE;
+    child->next_free = priv->free_head;
+    priv->free_head = handle;
 }
 
 GJS_NATIVE_CONSTRUCTOR_DEFINE_ABSTRACT(keep_alive)
@@ -86,8 +109,7 @@ keep_alive_finalize(JSFreeOp *fop,
                     JSObject *obj)
 {
     KeepAlive *priv;
-    void *key;
-    void *value;
+    guint i;
 
     priv = JS_GetPrivate(obj);
 
@@ -99,40 +121,23 @@ keep_alive_finalize(JSFreeOp *fop,
 
     priv->inside_finalize = TRUE;
 
-    while (gjs_g_hash_table_steal_one(priv->children,
-                                      &key, &value)) {
-        Child *child = value;
-        if (child->notify)
-            (* child->notify) (child->child, child->data);
+    for (i = 0; i < priv->n_slots; i++) {
+        Child *child = &priv->slots[i];
 
-        child_free(child);
+        if (child->in_use && child->notify)
+            (* child->notify) (child->child, child->data);
     }
 
-    g_hash_table_destroy(priv->children);
+    g_free(priv->slots);
     g_slice_free(KeepAlive, priv);
 }
 
-static void
-trace_foreach(void *key,
-              void *value,
-              void *data)
-{
-    Child *child = value;
-    JSTracer *tracer = data;
-
-    if (child->child != NULL) {
-        jsval val;
-        JS_SET_TRACING_DETAILS(tracer, NULL, "keep-alive", 0);
-        val = OBJECT_TO_JSVAL(child->child);
-        JS_CallTracer(tracer, JSVAL_TO_TRACEABLE (val), JSTRACE_OBJECT);
-    }
-}
-
 static void
 keep_alive_trace(JSTracer *tracer,
                  JSObject *obj)
 {
     KeepAlive *priv;
+    Child *child, *end;
 
     priv = JS_GetPrivate(obj);
 
@@ -141,7 +146,14 @@ keep_alive_trace(JSTracer *tracer,
 
     g_assert(!priv->inside_trace);
     priv->inside_trace = TRUE;
-    g_hash_table_foreach(priv->children, trace_foreach, tracer);
+
+    /* free slots have child == NULL */
+    end = priv->slots + priv->n_slots;
+    for (child = priv->slots; child < end; child++) {
+        if (child->child != NULL)
+            JS_CALL_OBJECT_TRACER(tracer, child->child, "keep-alive");
+    }
+
     priv->inside_trace = FALSE;
 }
 
@@ -151,7 +163,8 @@ keep_alive_trace(JSTracer *tracer,
  */
 static struct JSClass gjs_keep_alive_class = {
     "__private_GjsKeepAlive", /* means "new __private_GjsKeepAlive()" works */
-    JSCLASS_HAS_PRIVATE,
+    JSCLASS_HAS_PRIVATE |
+    JSCLASS_IMPLEMENTS_BARRIERS,
     JS_PropertyStub,
     JS_PropertyStub,
     JS_PropertyStub,
@@ -247,7 +260,6 @@ gjs_keep_alive_new(JSContext *context)
     }
 
     priv = g_slice_new0(KeepAlive);
-    priv->children = g_hash_table_new_full(child_hash, child_equal, NULL, child_free);
 
     g_assert(priv_from_js(context, keep_alive) == NULL);
     JS_SetPrivate(keep_alive, priv);
@@ -261,7 +273,7 @@ gjs_keep_alive_new(JSContext *context)
     return keep_alive;
 }
 
-void
+GjsKeepAliveHandle
 gjs_keep_alive_add_child(JSContext         *context,
                          JSObject          *keep_alive,
                          GjsUnrootedFunc  notify,
@@ -269,6 +281,7 @@ gjs_keep_alive_add_child(JSContext         *context,
                          void              *data)
 {
     KeepAlive *priv;
+    GjsKeepAliveHandle handle;
     Child *child;
 
     g_assert(keep_alive != NULL);
@@ -279,32 +292,29 @@ gjs_keep_alive_add_child(JSContext         *context,
 
     g_assert(priv != NULL);
 
-    g_return_if_fail(!priv->inside_trace);
-    g_return_if_fail(!priv->inside_finalize);
+    g_return_val_if_fail(!priv->inside_trace, 0);
+    g_return_val_if_fail(!priv->inside_finalize, 0);
 
-    child = g_slice_new0(Child);
+    handle = child_alloc(priv);
+    child = &priv->slots[handle - 1];
     child->notify = notify;
     child->child = obj;
     child->data = data;
+    child->next_free = 0;
+    child->in_use = TRUE;
 
-    /* this is sort of an expensive check, probably */
-    g_return_if_fail(g_hash_table_lookup(priv->children, child) == NULL);
+    priv->n_children++;
 
-    /* this overwrites any identical-by-value previous child,
-     * but there should not be one.
-     */
-    g_hash_table_replace(priv->children, child, child);
+    return handle;
 }
 
 void
-gjs_keep_alive_remove_child(JSContext         *context,
-                            JSObject          *keep_alive,
-                            GjsUnrootedFunc  notify,
-                            JSObject          *obj,
-                            void              *data)
+gjs_keep_alive_remove_child(JSContext          *context,
+                            JSObject           *keep_alive,
+                            GjsKeepAliveHandle  handle)
 {
     KeepAlive *priv;
-    Child child;
+    Child *child;
 
     JS_BeginRequest(context);
     priv = priv_from_js(context, keep_alive);
@@ -315,12 +325,24 @@ gjs_keep_alive_remove_child(JSContext         *context,
     g_return_if_fail(!priv->inside_trace);
     g_return_if_fail(!priv->inside_finalize);
 
-    child.notify = notify;
-    child.child = obj;
-    child.data = data;
+    child = child_from_handle(priv, handle);
+    g_return_if_fail(child != NULL && child->in_use);
+
+    /* The child may only be reachable from here */
+    gjs_gc_object_barrier(JS_GetRuntime(context), child->child);
+    child_free(priv, handle);
+    priv->n_children--;
 
-    g_hash_table_remove(priv->children,
-                        &child);
+    /* Handles can't move, so the vector is only given back once it
+     * is empty
+     */
+    if (priv->n_children == 0) {
+        g_free(priv->slots);
+        priv->slots = NULL;
+        priv->n_slots = 0;
+        priv->n_allocated = 0;
+        priv->free_head = 0;
+    }
 }
 
 static JSObject*
@@ -353,30 +375,31 @@ gjs_keep_alive_get_global(JSContext *context)
     return gjs_keep_alive_create(context);
 }
 
-void
+GjsKeepAliveHandle
 gjs_keep_alive_add_global_child(JSContext         *context,
                                 GjsUnrootedFunc  notify,
                                 JSObject          *child,
                                 void              *data)
 {
     JSObject *keep_alive;
+    GjsKeepAliveHandle handle;
 
     JS_BeginRequest(context);
 
     keep_alive = gjs_keep_alive_get_global(context);
 
-    gjs_keep_alive_add_child(context,
-                             keep_alive,
-                             notify, child, data);
+    handle = gjs_keep_alive_add_child(context,
+                                      keep_alive,
+                                      notify, child, data);
 
     JS_EndRequest(context);
+
+    return handle;
 }
 
 void
-gjs_keep_alive_remove_global_child(JSContext         *context,
-                                   GjsUnrootedFunc  notify,
-                                   JSObject          *child,
-                                   void              *data)
+gjs_keep_alive_remove_global_child(JSContext          *context,
+                                   GjsKeepAliveHandle  handle)
 {
     JSObject *keep_alive;
 
@@ -388,9 +411,7 @@ gjs_keep_alive_remove_global_child(JSContext         *context,
         g_error("no keep_alive property on the global object, have you "
                 "previously added this child?");
 
-    gjs_keep_alive_remove_child(context,
-                                gjs_keep_alive_get_global(context),
-                                notify, child, data);
+    gjs_keep_alive_remove_child(context, keep_alive, handle);
 
     JS_EndRequest(context);
 }
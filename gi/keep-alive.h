@@ -47,32 +47,33 @@ G_BEGIN_DECLS
  * All three fields (notify, child, and data) are optional, so you can have
  * no JSObject - just notification+data - and you can have no notifier,
  * only the keep-alive capability.
+ *
+ * Adding a child returns a handle that is needed to remove it again;
+ * 0 is never a valid handle.
  */
 
 typedef void (* GjsUnrootedFunc) (JSObject *obj,
                                   void     *data);
 
+typedef guint GjsKeepAliveHandle;
+
 
-JSObject* gjs_keep_alive_new                       (JSContext         *context);
-void      gjs_keep_alive_add_child                 (JSContext         *context,
-                                                    JSObject          *keep_alive,
-                                                    GjsUnrootedFunc  notify,
-                                                    JSObject          *child,
-                                                    void              *data);
-void      gjs_keep_alive_remove_child              (JSContext         *context,
-                                                    JSObject          *keep_alive,
-                                                    GjsUnrootedFunc  notify,
-                                                    JSObject          *child,
-                                                    void              *data);
-JSObject* gjs_keep_alive_get_global                (JSContext         *context);
-void      gjs_keep_alive_add_global_child          (JSContext         *context,
-                                                    GjsUnrootedFunc  notify,
-                                                    JSObject          *child,
-                                                    void              *data);
-void      gjs_keep_alive_remove_global_child       (JSContext         *context,
-                                                    GjsUnrootedFunc  notify,
-                                                    JSObject          *child,
-                                                    void              *data);
+JSObject*          gjs_keep_alive_new                 (JSContext          *context);
+GjsKeepAliveHandle gjs_keep_alive_add_child           (JSContext          *context,
+                                                       JSObject           *keep_alive,
+                                                       GjsUnrootedFunc     notify,
+                                                       JSObject           *child,
+                                                       void               *data);
+void               gjs_keep_alive_remove_child        (JSContext          *context,
+                                                       JSObject           *keep_alive,
+                                                       GjsKeepAliveHandle  handle);
+JSObject*          gjs_keep_alive_get_global          (JSContext          *context);
+GjsKeepAliveHandle gjs_keep_alive_add_global_child    (JSContext          *context,
+                                                       GjsUnrootedFunc     notify,
+                                                       JSObject           *child,
+                                                       void               *data);
+void               gjs_keep_alive_remove_global_child (JSContext          *context,
+                                                       GjsKeepAliveHandle  handle);
 
 G_END_DECLS
 
@@ -37,6 +37,8 @@
 #include "value.h"
 #include "keep-alive.h"
 #include "closure.h"
+#include "variant.h"
+#include "dbus-dispatch.h"
 #include "gjs_gi_trace.h"
 
 #include <gjs/gjs-module.h>
@@ -52,6 +54,7 @@ typedef struct {
     GIObjectInfo *info;
     GObject *gobj; /* NULL if we are the prototype and not an instance */
     JSObject *keep_alive; /* NULL if we are not added to it */
+    GjsKeepAliveHandle keep_alive_handle;
     GType gtype;
 
     /* a list of all signal connections, used when tracing */
@@ -60,6 +63,10 @@ typedef struct {
     /* the GObjectClass wrapped by this JS Object (only used for
        prototypes) */
     GTypeClass *klass;
+
+    /* jsid -> GParamSpec, or NULL if the id is not a GObject property
+       that we handle (only used for prototypes) */
+    GHashTable *param_cache;
 } ObjectInstance;
 
 typedef struct {
@@ -76,12 +83,32 @@ typedef enum
 
 typedef struct
 {
+    GList            link;
     JSContext       *context;
     GObject         *gobj;
     ToggleDirection  direction;
     guint            needs_unref : 1;
 } ToggleRefNotifyOperation;
 
+/* Toggle notifications that couldn't be handled right away, in the
+ * order they happened. Any thread may push; only the JS thread pops,
+ * from a single idle handler that is attached while the queue is
+ * non-empty.
+ *
+ * n_queued is the length of the queue. It only changes with the lock
+ * held, but is read atomically without it, so that the common case of
+ * nothing being queued doesn't touch the lock at all.
+ */
+typedef struct
+{
+    GMutex        lock;
+    GQueue        operations;
+    guint         idle_id;
+    volatile gint n_queued;
+} ToggleQueue;
+
+#define TOGGLE_BATCH_SIZE 64
+
 enum {
     PROP_0,
     PROP_JS_HANDLED,
@@ -92,7 +119,7 @@ static GHashTable *class_init_properties;
 
 static struct JSClass gjs_object_instance_class;
 static GThread *gjs_eval_thread;
-static volatile gint pending_idle_toggles;
+static ToggleQueue toggle_queue;
 
 GJS_DEFINE_PRIV_FROM_JS(ObjectInstance, gjs_object_instance_class)
 
@@ -137,23 +164,15 @@ gjs_object_priv_quark (void)
 }
 
 static GQuark
-gjs_toggle_down_quark (void)
-{
-    static GQuark val = 0;
-    if (G_UNLIKELY (!val))
-        val = g_quark_from_static_string ("gjs::toggle-down-quark");
-
-    return val;
-}
-
-static GQuark
-gjs_toggle_up_quark (void)
+gjs_toggle_queued_quark (ToggleDirection direction)
 {
-    static GQuark val = 0;
-    if (G_UNLIKELY (!val))
-        val = g_quark_from_static_string ("gjs::toggle-up-quark");
+    static GQuark vals[2] = { 0, 0 };
+    if (G_UNLIKELY (!vals[direction]))
+        vals[direction] = g_quark_from_static_string (direction == TOGGLE_UP ?
+                                                      "gjs::toggle-up-queued" :
+                                                      "gjs::toggle-down-queued");
 
-    return val;
+    return vals[direction];
 }
 
 /* Plain g_type_query fails and leaves @query uninitialized for
@@ -180,6 +199,36 @@ throw_priv_is_null_error(JSContext *context)
               " up to the parent _init properly?");
 }
 
+/* js_prop_name is only used to report a non-writable property, and
+ * may be NULL otherwise */
+static ValueFromPropertyResult
+init_g_param_from_param_spec(JSContext  *context,
+                             const char *js_prop_name,
+                             jsval       js_value,
+                             GParamSpec *param_spec,
+                             GParameter *parameter)
+{
+    if ((param_spec->flags & G_PARAM_WRITABLE) == 0) {
+        /* prevent setting the prop even in JS */
+        gjs_throw(context, "Property %s (GObject %s) is not writable",
+                     js_prop_name, param_spec->name);
+        return SOME_ERROR_OCCURRED;
+    }
+
+    gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
+                     "Syncing to GObject prop %s", param_spec->name);
+
+    g_value_init(&parameter->value, G_PARAM_SPEC_VALUE_TYPE(param_spec));
+    if (!gjs_value_to_g_value(context, js_value, &parameter->value)) {
+        g_value_unset(&parameter->value);
+        return SOME_ERROR_OCCURRED;
+    }
+
+    parameter->name = param_spec->name;
+
+    return VALUE_WAS_SET;
+}
+
 static ValueFromPropertyResult
 init_g_param_from_property(JSContext  *context,
                            const char *js_prop_name,
@@ -213,27 +262,8 @@ init_g_param_from_property(JSContext  *context,
         g_param_spec_get_qdata(param_spec, gjs_is_custom_property_quark()))
         return NO_SUCH_G_PROPERTY;
 
-
-    if ((param_spec->flags & G_PARAM_WRITABLE) == 0) {
-        /* prevent setting the prop even in JS */
-        gjs_throw(context, "Property %s (GObject %s) is not writable",
-                     js_prop_name, param_spec->name);
-        return SOME_ERROR_OCCURRED;
-    }
-
-    gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Syncing %s to GObject prop %s",
-                     js_prop_name, param_spec->name);
-
-    g_value_init(&parameter->value, G_PARAM_SPEC_VALUE_TYPE(param_spec));
-    if (!gjs_value_to_g_value(context, js_value, &parameter->value)) {
-        g_value_unset(&parameter->value);
-        return SOME_ERROR_OCCURRED;
-    }
-
-    parameter->name = param_spec->name;
-
-    return VALUE_WAS_SET;
+    return init_g_param_from_param_spec(context, js_prop_name, js_value,
+                                        param_spec, parameter);
 }
 
 static inline ObjectInstance *
@@ -243,6 +273,65 @@ proto_priv_from_js(JSContext *context,
     return priv_from_js(context, JS_GetPrototype(obj));
 }
 
+/* Finds the GParamSpec that the JS property @id of the wrapper @obj
+ * refers to, or NULL if it is not a GObject property (or one overridden
+ * in JS, which we must not forward to GObject to avoid infinite
+ * recursion). Results, including negative ones, are cached on the
+ * prototype keyed by the interned id, so repeated accesses cost one
+ * hash lookup and no allocation.
+ */
+static GParamSpec *
+find_param_spec(JSContext      *context,
+                JSObject       *obj,
+                ObjectInstance *priv,
+                jsid            id)
+{
+    ObjectInstance *proto_priv;
+    GHashTable *cache = NULL;
+    gpointer key = GSIZE_TO_POINTER(JSID_BITS(id));
+    gpointer cached;
+    char *name;
+    char *gname;
+    GParamSpec *param;
+
+    if (!JSID_IS_STRING(id))
+        return NULL;
+
+    /* The cache is only valid for instances of exactly the prototype's
+     * type; anything else (e.g. a changed __proto__) takes the slow path.
+     */
+    proto_priv = proto_priv_from_js(context, obj);
+    if (proto_priv != NULL && proto_priv->gtype == priv->gtype) {
+        if (proto_priv->param_cache == NULL)
+            proto_priv->param_cache = g_hash_table_new(NULL, NULL);
+
+        cache = proto_priv->param_cache;
+        if (g_hash_table_lookup_extended(cache, key, NULL, &cached))
+            return cached;
+    }
+
+    if (!gjs_get_string_id(context, id, &name))
+        return NULL;
+
+    gname = gjs_hyphen_from_camel(name);
+    param = g_object_class_find_property(G_OBJECT_GET_CLASS(priv->gobj),
+                                         gname);
+    gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
+                     "Looked up prop '%s' as '%s' on %s: %p",
+                     name, gname, g_type_name(priv->gtype), param);
+    g_free(gname);
+    g_free(name);
+
+    if (param != NULL &&
+        g_param_spec_get_qdata(param, gjs_is_custom_property_quark()))
+        param = NULL;
+
+    if (cache != NULL)
+        g_hash_table_insert(cache, key, param);
+
+    return param;
+}
+
 /* a hook on getting a property; set value_p to override property's value.
  * Return value is JS_FALSE on OOM/exception.
  */
@@ -253,63 +342,44 @@ object_instance_get_prop(JSContext            *context,
                          JSMutableHandleValue  value_p)
 {
     ObjectInstance *priv;
-    char *name;
-    char *gname;
     GParamSpec *param;
     GValue gvalue = { 0, };
-    JSBool ret = JS_TRUE;
-
-    if (!gjs_get_string_id(context, *id._, &name))
-        return JS_TRUE; /* not resolved, but no error */
 
     priv = priv_from_js(context, *obj._);
     gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Get prop '%s' hook obj %p priv %p", name, *obj._, priv);
+                     "Get prop hook obj %p priv %p", *obj._, priv);
 
     if (priv == NULL) {
         /* If we reach this point, either object_instance_new_resolve
          * did not throw (so name == "_init"), or the property actually
          * exists and it's not something we should be concerned with */
-        goto out;
+        return JS_TRUE;
     }
     if (priv->gobj == NULL) /* prototype, not an instance. */
-        goto out;
-
-    gname = gjs_hyphen_from_camel(name);
-    param = g_object_class_find_property(G_OBJECT_GET_CLASS(priv->gobj),
-                                         gname);
-    g_free(gname);
+        return JS_TRUE;
 
+    param = find_param_spec(context, *obj._, priv, *id._);
     if (param == NULL) {
         /* leave value_p as it was */
-        goto out;
+        return JS_TRUE;
     }
 
-    /* Do not fetch JS overridden properties from GObject, to avoid
-     * infinite recursion. */
-    if (g_param_spec_get_qdata(param, gjs_is_custom_property_quark()))
-        goto out;
-
     if ((param->flags & G_PARAM_READABLE) == 0)
-        goto out;
+        return JS_TRUE;
 
     gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Overriding %s with GObject prop %s",
-                     name, param->name);
+                     "Overriding with GObject prop %s", param->name);
 
     g_value_init(&gvalue, G_PARAM_SPEC_VALUE_TYPE(param));
     g_object_get_property(priv->gobj, param->name,
                           &gvalue);
     if (!gjs_value_from_g_value(context, value_p._, &gvalue)) {
         g_value_unset(&gvalue);
-        ret = JS_FALSE;
-        goto out;
+        return JS_FALSE;
     }
     g_value_unset(&gvalue);
 
- out:
-    g_free(name);
-    return ret;
+    return JS_TRUE;
 }
 
 /* a hook on setting a property; set value_p to override property value to
@@ -323,29 +393,37 @@ object_instance_set_prop(JSContext            *context,
                          JSMutableHandleValue  value_p)
 {
     ObjectInstance *priv;
-    char *name;
+    GParamSpec *param_spec;
+    char *name = NULL;
     GParameter param = { NULL, { 0, }};
     JSBool ret = JS_TRUE;
 
-    if (!gjs_get_string_id(context, *id._, &name))
-        return JS_TRUE; /* not resolved, but no error */
-
     priv = priv_from_js(context, *obj._);
     gjs_debug_jsprop(GJS_DEBUG_GOBJECT,
-                     "Set prop '%s' hook obj %p priv %p", name, *obj._, priv);
+                     "Set prop hook obj %p priv %p", *obj._, priv);
 
     if (priv == NULL) {
         /* see the comment in object_instance_get_prop() on this */
-        goto out;
+        return JS_TRUE;
     }
     if (priv->gobj == NULL) /* prototype, not an instance. */
-        goto out;
+        return JS_TRUE;
+
+    param_spec = find_param_spec(context, *obj._, priv, *id._);
+    if (param_spec == NULL) {
+        /* not a GObject prop, so nothing else to do */
+        return JS_TRUE;
+    }
 
-    switch (init_g_param_from_property(context, name,
-                                       *value_p._,
-                                       G_TYPE_FROM_INSTANCE(priv->gobj),
-                                       &param,
-                                       FALSE /* constructing */)) {
+    /* The JS name is only needed for the error message */
+    if ((param_spec->flags & G_PARAM_WRITABLE) == 0 &&
+        !gjs_get_string_id(context, *id._, &name))
+        return JS_FALSE;
+
+    switch (init_g_param_from_param_spec(context, name,
+                                         *value_p._,
+                                         param_spec,
+                                         &param)) {
     case SOME_ERROR_OCCURRED:
         ret = JS_FALSE;
     case NO_SUCH_G_PROPERTY:
@@ -768,64 +846,62 @@ gobj_no_longer_kept_alive_func(JSObject *obj,
                         obj);
 
     priv->keep_alive = NULL;
+    priv->keep_alive_handle = 0;
 }
 
-static GQuark
-get_qdata_key_for_toggle_direction(ToggleDirection direction)
+/* The operation queued for @gobj in @direction, if any, is kept on the
+ * object so that it can be taken out of the queue without a search.
+ * Must be called with toggle_queue.lock held.
+ */
+static ToggleRefNotifyOperation *
+get_queued_toggle(GObject         *gobj,
+                  ToggleDirection  direction)
 {
-    GQuark quark;
-
-    switch (direction) {
-        case TOGGLE_UP:
-            quark = gjs_toggle_up_quark();
-            break;
-        case TOGGLE_DOWN:
-            quark = gjs_toggle_down_quark();
-            break;
-        default:
-            g_assert_not_reached();
-    }
-
-    return quark;
+    return g_object_get_qdata(gobj, gjs_toggle_queued_quark(direction));
 }
 
-static gboolean
-clear_toggle_idle_source(GObject          *gobj,
-                         ToggleDirection   direction)
+/* Must be called with toggle_queue.lock held */
+static void
+set_queued_toggle(GObject                  *gobj,
+                  ToggleDirection           direction,
+                  ToggleRefNotifyOperation *operation)
 {
-    GQuark qdata_key;
-
-    qdata_key = get_qdata_key_for_toggle_direction(direction);
-
-    return g_object_steal_qdata(gobj, qdata_key) != NULL;
+    g_object_set_qdata(gobj, gjs_toggle_queued_quark(direction), operation);
 }
 
-static gboolean
-toggle_idle_source_is_queued(GObject          *gobj,
-                             ToggleDirection   direction)
+static void
+toggle_ref_notify_operation_free(ToggleRefNotifyOperation *operation)
 {
-    GQuark qdata_key;
-
-    qdata_key = get_qdata_key_for_toggle_direction(direction);
-
-    return g_object_get_qdata(gobj, qdata_key) != NULL;
+    if (operation->needs_unref)
+        g_object_unref (operation->gobj);
+    g_slice_free(ToggleRefNotifyOperation, operation);
 }
 
 static gboolean
 cancel_toggle_idle(GObject         *gobj,
                    ToggleDirection  direction)
 {
-    GQuark qdata_key;
-    GSource *source;
+    ToggleRefNotifyOperation *operation;
 
-    qdata_key = get_qdata_key_for_toggle_direction(direction);
+    /* Called for every wrapper that is finalized */
+    if (g_atomic_int_get(&toggle_queue.n_queued) == 0)
+        return FALSE;
 
-    source = g_object_steal_qdata(gobj, qdata_key);
+    g_mutex_lock(&toggle_queue.lock);
 
-    if (source)
-        g_source_destroy(source);
+    operation = get_queued_toggle(gobj, direction);
+    if (operation) {
+        g_queue_unlink(&toggle_queue.operations, &operation->link);
+        set_queued_toggle(gobj, direction, NULL);
+        g_atomic_int_add(&toggle_queue.n_queued, -1);
+    }
+
+    g_mutex_unlock(&toggle_queue.lock);
 
-    return source != 0;
+    if (operation)
+        toggle_ref_notify_operation_free(operation);
+
+    return operation != NULL;
 }
 
 static void
@@ -849,10 +925,9 @@ handle_toggle_down(JSContext *context,
     if (priv->keep_alive != NULL) {
         gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "Removing object from keep alive");
         gjs_keep_alive_remove_child(context, priv->keep_alive,
-                                    gobj_no_longer_kept_alive_func,
-                                    obj,
-                                    priv);
+                                    priv->keep_alive_handle);
         priv->keep_alive = NULL;
+        priv->keep_alive_handle = 0;
     }
 }
 
@@ -884,6 +959,8 @@ handle_toggle_up(JSContext *context,
         goto out;
     }
 
+    gjs_gc_object_barrier(JS_GetRuntime(context), obj);
+
     priv = priv_from_js(context, obj);
 
     gjs_debug_lifecycle(GJS_DEBUG_GOBJECT,
@@ -896,10 +973,11 @@ handle_toggle_up(JSContext *context,
     if (priv->keep_alive == NULL) {
         gjs_debug_lifecycle(GJS_DEBUG_GOBJECT, "Adding object to keep alive");
         priv->keep_alive = gjs_keep_alive_get_global(context);
-        gjs_keep_alive_add_child(context, priv->keep_alive,
-                                 gobj_no_longer_kept_alive_func,
-                                 obj,
-                                 priv);
+        priv->keep_alive_handle =
+            gjs_keep_alive_add_child(context, priv->keep_alive,
+                                     gobj_no_longer_kept_alive_func,
+                                     obj,
+                                     priv);
     }
 
 out:
@@ -907,16 +985,9 @@ out:
         gjs_unblock_gc();
 }
 
-static gboolean
-idle_handle_toggle(gpointer data)
+static void
+handle_queued_toggle(ToggleRefNotifyOperation *operation)
 {
-    ToggleRefNotifyOperation *operation = data;
-
-    if (!clear_toggle_idle_source(operation->gobj, operation->direction)) {
-        /* Already cleared, the JSObject is going away, abort mission */
-        goto out;
-    }
-
     switch (operation->direction) {
         case TOGGLE_UP:
             handle_toggle_up(operation->context, operation->gobj, FALSE);
@@ -927,18 +998,63 @@ idle_handle_toggle(gpointer data)
         default:
             g_assert_not_reached();
     }
-
-out:
-    return FALSE;
 }
 
+/* Handles everything in the toggle queue, taking the lock once per
+ * batch rather than once per notification. An operation stops counting
+ * as queued for its object as soon as it's popped, which is what the
+ * original per-object idles did when they were dispatched; the ordering
+ * of the queue is what keeps a down and a following up for the same
+ * object in sequence.
+ */
 static void
-toggle_ref_notify_operation_free(ToggleRefNotifyOperation *operation)
+drain_toggle_queue(void)
 {
-    if (operation->needs_unref)
-        g_object_unref (operation->gobj);
-    g_slice_free(ToggleRefNotifyOperation, operation);
-    g_atomic_int_add(&pending_idle_toggles, -1);
+    ToggleRefNotifyOperation *batch[TOGGLE_BATCH_SIZE];
+    guint i, n_batch;
+
+    do {
+        g_mutex_lock(&toggle_queue.lock);
+        for (n_batch = 0; n_batch < TOGGLE_BATCH_SIZE; n_batch++) {
+            GList *link;
+            ToggleRefNotifyOperation *operation;
+
+            link = g_queue_pop_head_link(&toggle_queue.operations);
+            if (link == NULL)
+                break;
+
+            operation = link->data;
+            set_queued_toggle(operation->gobj, operation->direction, NULL);
+            batch[n_batch] = operation;
+        }
+        g_atomic_int_add(&toggle_queue.n_queued, -(gint) n_batch);
+        g_mutex_unlock(&toggle_queue.lock);
+
+        for (i = 0; i < n_batch; i++) {
+            handle_queued_toggle(batch[i]);
+            toggle_ref_notify_operation_free(batch[i]);
+        }
+    } while (n_batch == TOGGLE_BATCH_SIZE);
+}
+
+static gboolean
+idle_handle_toggles(gpointer data)
+{
+    gboolean more;
+
+    drain_toggle_queue();
+
+    /* Toggles may have been queued from another thread since the
+     * last batch; only detach once the queue is seen empty under the
+     * lock, so that queue_toggle_idle() knows to attach a new idle.
+     */
+    g_mutex_lock(&toggle_queue.lock);
+    more = !g_queue_is_empty(&toggle_queue.operations);
+    if (!more)
+        toggle_queue.idle_id = 0;
+    g_mutex_unlock(&toggle_queue.lock);
+
+    return more;
 }
 
 static void
@@ -947,10 +1063,9 @@ queue_toggle_idle(GObject         *gobj,
                   ToggleDirection  direction)
 {
     ToggleRefNotifyOperation *operation;
-    GQuark qdata_key;
-    GSource *source;
 
     operation = g_slice_new0(ToggleRefNotifyOperation);
+    operation->link.data = operation;
     operation->context = context;
     operation->direction = direction;
 
@@ -979,21 +1094,19 @@ queue_toggle_idle(GObject         *gobj,
             g_assert_not_reached();
     }
 
-    qdata_key = get_qdata_key_for_toggle_direction(direction);
+    g_mutex_lock(&toggle_queue.lock);
 
-    source = g_idle_source_new();
-    g_source_set_priority(source, G_PRIORITY_HIGH);
-    g_source_set_callback(source,
-                          idle_handle_toggle,
-                          operation,
-                          (GDestroyNotify) toggle_ref_notify_operation_free);
+    g_queue_push_tail_link(&toggle_queue.operations, &operation->link);
+    g_assert(get_queued_toggle(gobj, direction) == NULL);
+    set_queued_toggle(gobj, direction, operation);
+    g_atomic_int_inc(&toggle_queue.n_queued);
 
-    g_atomic_int_inc(&pending_idle_toggles);
-    g_object_set_qdata (gobj, qdata_key, source);
-    g_source_attach (source, NULL);
+    if (toggle_queue.idle_id == 0)
+        toggle_queue.idle_id = g_idle_add_full(G_PRIORITY_HIGH,
+                                               idle_handle_toggles,
+                                               NULL, NULL);
 
-    /* object qdata is piggy-backing off the main loop's ref of the source */
-    g_source_unref (source);
+    g_mutex_unlock(&toggle_queue.lock);
 }
 
 static void
@@ -1030,8 +1143,14 @@ wrapped_gobj_toggle_notify(gpointer      data,
     if (gjs_eval_thread == g_thread_self())
         gc_blocked = gjs_try_block_gc();
 
-    toggle_up_queued = toggle_idle_source_is_queued(gobj, TOGGLE_UP);
-    toggle_down_queued = toggle_idle_source_is_queued(gobj, TOGGLE_DOWN);
+    if (g_atomic_int_get(&toggle_queue.n_queued) > 0) {
+        g_mutex_lock(&toggle_queue.lock);
+        toggle_up_queued = get_queued_toggle(gobj, TOGGLE_UP) != NULL;
+        toggle_down_queued = get_queued_toggle(gobj, TOGGLE_DOWN) != NULL;
+        g_mutex_unlock(&toggle_queue.lock);
+    } else {
+        toggle_up_queued = toggle_down_queued = FALSE;
+    }
 
     if (is_last_ref) {
         /* We've transitions from 2 -> 1 references,
@@ -1078,10 +1197,8 @@ wrapped_gobj_toggle_notify(gpointer      data,
 void
 gjs_object_process_pending_toggles (void)
 {
-    while (g_main_context_pending (NULL) &&
-           g_atomic_int_get (&pending_idle_toggles) > 0) {
-        g_main_context_iteration (NULL, FALSE);
-    }
+    /* The idle, if attached, finds the queue empty and detaches itself */
+    drain_toggle_queue();
 }
 
 static ObjectInstance *
@@ -1144,11 +1261,12 @@ associate_js_gobject (JSContext      *context,
      * wrappee).
      */
     priv->keep_alive = gjs_keep_alive_get_global(context);
-    gjs_keep_alive_add_child(context,
-                             priv->keep_alive,
-                             gobj_no_longer_kept_alive_func,
-                             object,
-                             priv);
+    priv->keep_alive_handle =
+        gjs_keep_alive_add_child(context,
+                                 priv->keep_alive,
+                                 gobj_no_longer_kept_alive_func,
+                                 object,
+                                 priv);
 
     g_object_add_toggle_ref(gobj,
                             wrapped_gobj_toggle_notify,
@@ -1303,6 +1421,21 @@ object_instance_trace(JSTracer *tracer,
 
         gjs_closure_trace(cd->closure, tracer);
     }
+
+    /* Keep the interned ids in the property cache alive, so that
+     * they can't be collected and reused for a different string. */
+    if (priv->param_cache != NULL) {
+        GHashTableIter cache_iter;
+        gpointer key;
+
+        g_hash_table_iter_init(&cache_iter, priv->param_cache);
+        while (g_hash_table_iter_next(&cache_iter, &key, NULL)) {
+            jsid id;
+
+            JSID_BITS(id) = GPOINTER_TO_SIZE(key);
+            JS_CallTracer(tracer, JSID_TO_STRING(id), JSTRACE_STRING);
+        }
+    }
 }
 
 static void
@@ -1366,9 +1499,7 @@ object_instance_finalize(JSFreeOp  *fop,
         {
             JSContext *context = JS_NewContext(fop->runtime, 8192);
             gjs_keep_alive_remove_child(context, priv->keep_alive,
-                                        gobj_no_longer_kept_alive_func,
-                                        obj,
-                                        priv);
+                                        priv->keep_alive_handle);
             JS_DestroyContext(context);
         }
     }
@@ -1383,6 +1514,8 @@ object_instance_finalize(JSFreeOp  *fop,
         priv->klass = NULL;
     }
 
+    g_clear_pointer(&priv->param_cache, g_hash_table_destroy);
+
     GJS_DEC_COUNTER(object);
     g_slice_free(ObjectInstance, priv);
 }
@@ -1461,6 +1594,37 @@ signal_connection_invalidated (gpointer  user_data,
     g_slice_free(ConnectData, connect_data);
 }
 
+/**
+ * gjs_object_associate_closure:
+ * @context: a #JSContext
+ * @obj: the JS wrapper of a #GObject instance
+ * @closure: a closure made with gjs_closure_new() and %FALSE root_function
+ *
+ * Ties the lifetime of the JS callable of @closure to @obj, the same way
+ * as for a signal handler connected with connect(): it is traced by @obj
+ * until @closure is invalidated or @obj is finalized, whichever comes
+ * first.
+ */
+void
+gjs_object_associate_closure(JSContext *context,
+                             JSObject  *obj,
+                             GClosure  *closure)
+{
+    ObjectInstance *priv;
+    ConnectData *connect_data;
+
+    priv = priv_from_js(context, obj);
+    g_assert(priv != NULL && priv->gobj != NULL);
+
+    connect_data = g_slice_new(ConnectData);
+    priv->signals = g_list_prepend(priv->signals, connect_data);
+    connect_data->obj = priv;
+    connect_data->link = priv->signals;
+    /* This is a weak reference, and will be cleared when the closure is invalidated */
+    connect_data->closure = closure;
+    g_closure_add_invalidate_notifier(closure, connect_data, signal_connection_invalidated);
+}
+
 static JSBool
 real_connect_func(JSContext *context,
                   unsigned   argc,
@@ -1476,7 +1640,6 @@ real_connect_func(JSContext *context,
     char *signal_name;
     GQuark signal_detail;
     jsval retval;
-    ConnectData *connect_data;
     JSBool ret = JS_FALSE;
 
     if (!do_base_typecheck(context, obj, JS_TRUE))
@@ -1513,11 +1676,10 @@ real_connect_func(JSContext *context,
         return JS_FALSE;
     }
 
-    if (!g_signal_parse_name(signal_name,
-                             G_OBJECT_TYPE(priv->gobj),
-                             &signal_id,
-                             &signal_detail,
-                             TRUE)) {
+    if (!gjs_signal_parse_name(G_OBJECT_TYPE(priv->gobj),
+                               signal_name,
+                               &signal_id,
+                               &signal_detail)) {
         gjs_throw(context, "No signal '%s' on object '%s'",
                      signal_name,
                      g_type_name(G_OBJECT_TYPE(priv->gobj)));
@@ -1528,13 +1690,7 @@ real_connect_func(JSContext *context,
     if (closure == NULL)
         goto out;
 
-    connect_data = g_slice_new(ConnectData);
-    priv->signals = g_list_prepend(priv->signals, connect_data);
-    connect_data->obj = priv;
-    connect_data->link = priv->signals;
-    /* This is a weak reference, and will be cleared when the closure is invalidated */
-    connect_data->closure = closure;
-    g_closure_add_invalidate_notifier(closure, connect_data, signal_connection_invalidated);
+    gjs_object_associate_closure(context, obj, closure);
 
     id = g_signal_connect_closure_by_id(priv->gobj,
                                         signal_id,
@@ -1625,7 +1781,8 @@ emit_func(JSContext *context,
     ObjectInstance *priv;
     guint signal_id;
     GQuark signal_detail;
-    GSignalQuery signal_query;
+    const GjsSignalInfo *signal_info;
+    guint n_params;
     char *signal_name;
     GValue *instance_and_args;
     GValue rvalue = G_VALUE_INIT;
@@ -1662,45 +1819,45 @@ emit_func(JSContext *context,
     if (!gjs_string_to_utf8(context, argv[0], &signal_name))
         return JS_FALSE;
 
-    if (!g_signal_parse_name(signal_name,
-                             G_OBJECT_TYPE(priv->gobj),
-                             &signal_id,
-                             &signal_detail,
-                             FALSE)) {
+    if (!gjs_signal_parse_name(G_OBJECT_TYPE(priv->gobj),
+                               signal_name,
+                               &signal_id,
+                               &signal_detail)) {
         gjs_throw(context, "No signal '%s' on object '%s'",
                      signal_name,
                      g_type_name(G_OBJECT_TYPE(priv->gobj)));
         goto out;
     }
 
-    g_signal_query(signal_id, &signal_query);
+    signal_info = gjs_signal_info_get(signal_id);
+    n_params = signal_info->query.n_params;
 
-    if ((argc - 1) != signal_query.n_params) {
+    if ((argc - 1) != n_params) {
         gjs_throw(context, "Signal '%s' on %s requires %d args got %d",
                      signal_name,
                      g_type_name(G_OBJECT_TYPE(priv->gobj)),
-                     signal_query.n_params,
+                     n_params,
                      argc - 1);
         goto out;
     }
 
-    if (signal_query.return_type != G_TYPE_NONE) {
-        g_value_init(&rvalue, signal_query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE);
+    if (signal_info->return_type != G_TYPE_NONE) {
+        g_value_init(&rvalue, signal_info->return_type);
     }
 
-    instance_and_args = g_newa(GValue, signal_query.n_params + 1);
-    memset(instance_and_args, 0, sizeof(GValue) * (signal_query.n_params + 1));
+    instance_and_args = g_newa(GValue, n_params + 1);
+    memset(instance_and_args, 0, sizeof(GValue) * (n_params + 1));
 
     g_value_init(&instance_and_args[0], G_TYPE_FROM_INSTANCE(priv->gobj));
     g_value_set_instance(&instance_and_args[0], priv->gobj);
 
     failed = FALSE;
-    for (i = 0; i < signal_query.n_params; ++i) {
+    for (i = 0; i < n_params; ++i) {
         GValue *value;
         value = &instance_and_args[i + 1];
 
-        g_value_init(value, signal_query.param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE);
-        if ((signal_query.param_types[i] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0)
+        g_value_init(value, signal_info->param_types[i]);
+        if (signal_info->static_scope[i])
             failed = !gjs_value_to_g_value_no_copy(context, argv[i+1], value);
         else
             failed = !gjs_value_to_g_value(context, argv[i+1], value);
@@ -1714,7 +1871,7 @@ emit_func(JSContext *context,
                        &rvalue);
     }
 
-    if (signal_query.return_type != G_TYPE_NONE) {
+    if (signal_info->return_type != G_TYPE_NONE) {
         if (!gjs_value_from_g_value(context,
                                     &retval,
                                     &rvalue))
@@ -1725,7 +1882,7 @@ emit_func(JSContext *context,
         retval = JSVAL_VOID;
     }
 
-    for (i = 0; i < (signal_query.n_params + 1); ++i) {
+    for (i = 0; i < (n_params + 1); ++i) {
         g_value_unset(&instance_and_args[i]);
     }
 
@@ -1771,7 +1928,8 @@ to_string_func(JSContext *context,
 static struct JSClass gjs_object_instance_class = {
     "GObject_Object",
     JSCLASS_HAS_PRIVATE |
-    JSCLASS_NEW_RESOLVE,
+    JSCLASS_NEW_RESOLVE |
+    JSCLASS_IMPLEMENTS_BARRIERS,
     JS_PropertyStub,
     JS_PropertyStub,
     object_instance_get_prop,
@@ -1857,6 +2015,107 @@ gjs_define_static_methods(JSContext    *context,
     return JS_TRUE;
 }
 
+static gchar *
+hyphen_to_underscore (gchar *string)
+{
+    gchar *str, *s;
+    str = s = g_strdup(string);
+    while (*(str++) != '\0') {
+        if (*str == '-')
+            *str = '_';
+    }
+    return s;
+}
+
+/* In property accessor mode (GJS_ENABLE_PROPERTY_ACCESSORS set in the
+ * environment), GObject properties are real JS accessor properties on
+ * each prototype instead of being intercepted by the class-wide get/set
+ * hooks. Ordinary JS properties and method lookups then don't go
+ * through our hooks at all, and SpiderMonkey's property caches can
+ * handle them.
+ */
+static gboolean
+use_property_accessors(void)
+{
+    static int enabled = -1;
+
+    if (G_UNLIKELY(enabled < 0)) {
+        enabled = g_getenv("GJS_ENABLE_PROPERTY_ACCESSORS") != NULL;
+
+        /* No object of the class exists yet, so it's safe to swap
+         * out the hooks here. */
+        if (enabled) {
+            gjs_object_instance_class.getProperty = JS_PropertyStub;
+            gjs_object_instance_class.setProperty = JS_StrictPropertyStub;
+        }
+    }
+
+    return enabled;
+}
+
+static JSBool
+define_property_accessor(JSContext  *context,
+                         JSObject   *prototype,
+                         const char *name)
+{
+    JSBool found;
+
+    /* Don't shadow a method or another accessor with the same name */
+    if (!JS_AlreadyHasOwnProperty(context, prototype, name, &found))
+        return JS_FALSE;
+    if (found)
+        return JS_TRUE;
+
+    return JS_DefineProperty(context, prototype, name, JSVAL_VOID,
+                             object_instance_get_prop,
+                             object_instance_set_prop,
+                             JSPROP_SHARED);
+}
+
+/* Defines accessors for the properties that @priv's type itself
+ * installs, under each of the names the get/set hooks would accept:
+ * "foo-bar", "foo_bar" and "fooBar". Inherited properties are found on
+ * the parent prototypes, and properties overridden in JS are left to
+ * the JS class definition.
+ */
+static JSBool
+define_property_accessors(JSContext      *context,
+                          JSObject       *prototype,
+                          ObjectInstance *priv)
+{
+    GParamSpec **properties;
+    guint n_properties, i;
+    JSBool ret = JS_TRUE;
+
+    properties = g_object_class_list_properties(G_OBJECT_CLASS(priv->klass),
+                                                &n_properties);
+
+    for (i = 0; i < n_properties && ret; i++) {
+        GParamSpec *param = properties[i];
+        char *underscore_name;
+        char *camel_name;
+
+        if (param->owner_type != priv->gtype)
+            continue;
+
+        if (g_param_spec_get_qdata(param, gjs_is_custom_property_quark()))
+            continue;
+
+        underscore_name = hyphen_to_underscore((gchar *) param->name);
+        camel_name = gjs_camel_from_hyphen(param->name);
+
+        ret = define_property_accessor(context, prototype, param->name) &&
+            define_property_accessor(context, prototype, underscore_name) &&
+            define_property_accessor(context, prototype, camel_name);
+
+        g_free(underscore_name);
+        g_free(camel_name);
+    }
+
+    g_free(properties);
+    return ret;
+}
+
 void
 gjs_define_object_class(JSContext      *context,
                         JSObject       *in_object,
@@ -1932,6 +2191,8 @@ gjs_define_object_class(JSContext      *context,
         constructor_name = g_type_name(gtype);
     }
 
+    use_property_accessors();
+
     if (!gjs_init_class_dynamic(context, in_object,
                                 parent_proto,
                                 ns, constructor_name,
@@ -1965,6 +2226,10 @@ gjs_define_object_class(JSContext      *context,
     if (info)
         gjs_define_static_methods(context, constructor, gtype, info);
 
+    if (use_property_accessors() &&
+        !define_property_accessors(context, prototype, priv))
+        g_error("Can't define property accessors for %s", constructor_name);
+
     value = OBJECT_TO_JSVAL(gjs_gtype_create_gtype_wrapper(context, gtype));
     JS_DefineProperty(context, constructor, "$gtype", value,
                       NULL, NULL, JSPROP_PERMANENT);
@@ -1997,6 +2262,10 @@ gjs_object_from_g_object(JSContext    *context,
 
     obj = peek_js_obj(gobj);
 
+    /* The wrapper isn't traced while it isn't kept alive, so an
+     * incremental GC may not have seen it yet */
+    gjs_gc_object_barrier(JS_GetRuntime(context), obj);
+
     if (obj == NULL) {
         /* We have to create a wrapper */
         JSObject *proto;
@@ -2293,18 +2562,6 @@ gjs_hook_up_vfunc(JSContext *cx,
     return JS_TRUE;
 }
 
-static gchar *
-hyphen_to_underscore (gchar *string)
-{
-    gchar *str, *s;
-    str = s = g_strdup(string);
-    while (*(str++) != '\0') {
-        if (*str == '-')
-            *str = '_';
-    }
-    return s;
-}
-
 static void
 gjs_object_get_gproperty (GObject    *object,
                           guint       property_id,
@@ -2694,5 +2951,11 @@ gjs_define_private_gi_stuff(JSContext *context,
                            6, GJS_MODULE_PROP_FLAGS))
         return JS_FALSE;
 
+    if (!gjs_define_variant_stuff(context, module_obj))
+        return JS_FALSE;
+
+    if (!gjs_define_dbus_dispatch_stuff(context, module_obj))
+        return JS_FALSE;
+
     return JS_TRUE;
 }
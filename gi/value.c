@@ -45,9 +45,103 @@ static JSBool gjs_value_from_g_value_internal(JSContext    *context,
                                               jsval        *value_p,
                                               const GValue *gvalue,
                                               gboolean      no_copy,
-                                              GSignalQuery *signal_query,
+                                              const GSignalQuery *signal_query,
                                               gint          arg_n);
 
+/* Signal infos indexed by signal id. Signals are never unregistered for
+ * the types we deal with, so the entries are never freed.
+ */
+static GPtrArray *signal_infos;
+
+/* GType -> (detailed signal name -> SignalLookup) */
+static GHashTable *signal_lookups;
+
+typedef struct {
+    guint signal_id;
+    GQuark detail;
+} SignalLookup;
+
+const GjsSignalInfo *
+gjs_signal_info_get(guint signal_id)
+{
+    GjsSignalInfo *info;
+    guint i;
+
+    if (signal_infos == NULL)
+        signal_infos = g_ptr_array_new();
+
+    if (signal_id < signal_infos->len) {
+        info = g_ptr_array_index(signal_infos, signal_id);
+        if (info != NULL)
+            return info;
+    }
+
+    info = g_slice_new0(GjsSignalInfo);
+    g_signal_query(signal_id, &info->query);
+    if (info->query.signal_id == 0) {
+        g_slice_free(GjsSignalInfo, info);
+        return NULL;
+    }
+
+    info->query.param_types = g_memdup(info->query.param_types,
+                                       sizeof(GType) * info->query.n_params);
+    info->param_types = g_new(GType, info->query.n_params);
+    info->static_scope = g_new(gboolean, info->query.n_params);
+    for (i = 0; i < info->query.n_params; i++) {
+        info->param_types[i] = info->query.param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+        info->static_scope[i] = (info->query.param_types[i] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0;
+    }
+    info->return_type = info->query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+
+    if (signal_id >= signal_infos->len)
+        g_ptr_array_set_size(signal_infos, signal_id + 1);
+    g_ptr_array_index(signal_infos, signal_id) = info;
+
+    return info;
+}
+
+/* Like g_signal_parse_name(), but remembers the result for each type.
+ * The detail quark is always created, since the result is shared by
+ * connect() and emit().
+ */
+gboolean
+gjs_signal_parse_name(GType       gtype,
+                      const char *detailed_signal,
+                      guint      *signal_id_p,
+                      GQuark     *detail_p)
+{
+    GHashTable *lookups;
+    SignalLookup *lookup;
+
+    if (signal_lookups == NULL)
+        signal_lookups = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    lookups = g_hash_table_lookup(signal_lookups, GSIZE_TO_POINTER(gtype));
+    if (lookups == NULL) {
+        lookups = g_hash_table_new(g_str_hash, g_str_equal);
+        g_hash_table_insert(signal_lookups, GSIZE_TO_POINTER(gtype), lookups);
+    }
+
+    lookup = g_hash_table_lookup(lookups, detailed_signal);
+    if (lookup == NULL) {
+        guint signal_id;
+        GQuark detail;
+
+        if (!g_signal_parse_name(detailed_signal, gtype,
+                                 &signal_id, &detail, TRUE))
+            return FALSE;
+
+        lookup = g_slice_new(SignalLookup);
+        lookup->signal_id = signal_id;
+        lookup->detail = detail;
+        g_hash_table_insert(lookups, g_strdup(detailed_signal), lookup);
+    }
+
+    *signal_id_p = lookup->signal_id;
+    *detail_p = lookup->detail;
+    return TRUE;
+}
+
 static void
 closure_marshal(GClosure        *closure,
                 GValue          *return_value,
@@ -60,9 +154,9 @@ closure_marshal(GClosure        *closure,
     JSContext *context;
     int argc;
     jsval *argv;
-    jsval rval;
+    jsval *rval_p;
     int i;
-    GSignalQuery signal_query = { 0, };
+    const GjsSignalInfo *signal_info = NULL;
 
     gjs_debug_marshal(GJS_DEBUG_GCLOSURE,
                       "Marshal closure %p",
@@ -77,18 +171,11 @@ closure_marshal(GClosure        *closure,
     context = gjs_runtime_get_context(runtime);
     JS_BeginRequest(context);
 
+    /* The arguments and the return value go on the argument stack of
+     * the runtime, which is traced as a whole; rval is the last slot */
     argc = n_param_values;
-    rval = JSVAL_VOID;
-    if (argc > 0) {
-        argv = g_newa(jsval, n_param_values);
-
-        gjs_set_values(context, argv, argc, JSVAL_VOID);
-        gjs_root_value_locations(context, argv, argc);
-    } else {
-        /* squash a compiler warning */
-        argv = NULL;
-    }
-    JS_AddValueRoot(context, &rval);
+    argv = gjs_runtime_push_values(runtime, argc + 1);
+    rval_p = &argv[argc];
 
     if (marshal_data) {
         /* we are used for a signal handler */
@@ -96,15 +183,15 @@ closure_marshal(GClosure        *closure,
 
         signal_id = GPOINTER_TO_UINT(marshal_data);
 
-        g_signal_query(signal_id, &signal_query);
+        signal_info = gjs_signal_info_get(signal_id);
 
-        if (!signal_query.signal_id) {
+        if (signal_info == NULL) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Signal handler being called on invalid signal");
             goto cleanup;
         }
 
-        if (signal_query.n_params + 1 != n_param_values) {
+        if (signal_info->query.n_params + 1 != n_param_values) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Signal handler being called with wrong number of parameters");
             goto cleanup;
@@ -117,11 +204,13 @@ closure_marshal(GClosure        *closure,
 
         no_copy = FALSE;
 
-        if (i >= 1 && signal_query.signal_id) {
-            no_copy = (signal_query.param_types[i - 1] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0;
+        if (i >= 1 && signal_info != NULL) {
+            no_copy = signal_info->static_scope[i - 1];
         }
 
-        if (!gjs_value_from_g_value_internal(context, &argv[i], gval, no_copy, &signal_query, i)) {
+        if (!gjs_value_from_g_value_internal(context, &argv[i], gval, no_copy,
+                                             signal_info ? &signal_info->query : NULL,
+                                             i)) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Unable to convert arg %d in order to invoke closure",
                       i);
@@ -130,15 +219,15 @@ closure_marshal(GClosure        *closure,
         }
     }
 
-    gjs_closure_invoke(closure, argc, argv, &rval);
+    gjs_closure_invoke(closure, argc, argv, rval_p);
 
     if (return_value != NULL) {
-        if (JSVAL_IS_VOID(rval)) {
+        if (JSVAL_IS_VOID(*rval_p)) {
             /* something went wrong invoking, error should be set already */
             goto cleanup;
         }
 
-        if (!gjs_value_to_g_value(context, rval, return_value)) {
+        if (!gjs_value_to_g_value(context, *rval_p, return_value)) {
             gjs_debug(GJS_DEBUG_GCLOSURE,
                       "Unable to convert return value when invoking closure");
             gjs_log_exception(context);
@@ -147,9 +236,7 @@ closure_marshal(GClosure        *closure,
     }
 
  cleanup:
-    if (argc > 0)
-        gjs_unroot_value_locations(context, argv, argc);
-    JS_RemoveValueRoot(context, &rval);
+    gjs_runtime_pop_values(runtime, argv, argc + 1);
     JS_EndRequest(context);
 }
 
@@ -633,7 +720,7 @@ gjs_value_from_g_value_internal(JSContext    *context,
                                 jsval        *value_p,
                                 const GValue *gvalue,
                                 gboolean      no_copy,
-                                GSignalQuery *signal_query,
+                                const GSignalQuery *signal_query,
                                 gint          arg_n)
 {
     GType gtype;
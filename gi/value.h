@@ -46,6 +46,24 @@ GClosure*  gjs_closure_new_for_signal   (JSContext    *context,
                                          const char   *description,
                                          guint         signal_id);
 
+/* What we need to know about a signal to marshal its arguments, kept
+ * around so that g_signal_query() isn't called on every emission.
+ * query.param_types still has G_SIGNAL_TYPE_STATIC_SCOPE set, param_types
+ * has it masked out, and static_scope tells which parameters had it.
+ */
+typedef struct {
+    GSignalQuery query;
+    GType *param_types;
+    gboolean *static_scope;
+    GType return_type;
+} GjsSignalInfo;
+
+const GjsSignalInfo *gjs_signal_info_get (guint         signal_id);
+gboolean   gjs_signal_parse_name        (GType         gtype,
+                                         const char   *detailed_signal,
+                                         guint        *signal_id_p,
+                                         GQuark       *detail_p);
+
 G_END_DECLS
 
 #endif  /* __GJS_VALUE_H__ */
@@ -0,0 +1,1120 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  The GJS authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Conversion between JS values and GVariant, backing the GLib.Variant
+ * overrides (new GLib.Variant(), unpack() and deep_unpack()).
+ *
+ * Packing walks the signature and the JS value together and builds the
+ * whole tree with GVariantBuilder, so no intermediate GLib.Variant
+ * wrappers are created for the children. Arrays of fixed-size basic
+ * types (ai, ad, ay...) are converted in one go with
+ * g_variant_new_fixed_array() and g_variant_get_fixed_array(), and can
+ * be given as typed arrays or ByteArrays with a matching element type.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <gjs/gjs-module.h>
+#include <gjs/compat.h>
+#include <gjs/runtime.h>
+#include <gjs/byteArray.h>
+#include "boxed.h"
+#include "variant.h"
+
+#include <util/log.h>
+
+#include <girepository.h>
+
+#define TYPE_STRING_ARGS(type)                                  \
+    (int) g_variant_type_get_string_length(type),               \
+    g_variant_type_peek_string(type)
+
+/* Storage for one element of a fixed-size basic type; every member
+ * starts at offset 0, so the first fixed_element_size() bytes are the
+ * serialized element */
+typedef union {
+    guint8  v_uint8;
+    gint16  v_int16;
+    guint16 v_uint16;
+    gint32  v_int32;
+    guint32 v_uint32;
+    gint64  v_int64;
+    guint64 v_uint64;
+    double  v_double;
+} FixedValue;
+
+static GVariant *pack_value   (JSContext          *context,
+                               const GVariantType *type,
+                               jsval               value);
+static JSBool    unpack_value (JSContext          *context,
+                               GVariant           *variant,
+                               gboolean            deep,
+                               jsval              *value_p);
+
+static GIStructInfo *
+get_variant_info(void)
+{
+    static GIStructInfo *info = NULL;
+
+    if (G_UNLIKELY(info == NULL))
+        info = (GIStructInfo*) g_irepository_find_by_gtype(NULL, G_TYPE_VARIANT);
+
+    return info;
+}
+
+static JSBool
+variant_to_value(JSContext *context,
+                 GVariant  *variant,
+                 jsval     *value_p)
+{
+    GIStructInfo *info;
+    JSObject *obj;
+
+    info = get_variant_info();
+    if (info == NULL) {
+        gjs_throw(context, "GLib.Variant is not available");
+        return JS_FALSE;
+    }
+
+    obj = gjs_boxed_from_c_struct(context, info, variant,
+                                  GJS_BOXED_CREATION_NONE);
+    if (obj == NULL)
+        return JS_FALSE;
+
+    *value_p = OBJECT_TO_JSVAL(obj);
+    return JS_TRUE;
+}
+
+static gsize
+fixed_element_size(char type_char)
+{
+    switch (type_char) {
+    case 'b':
+    case 'y':
+        return 1;
+    case 'n':
+    case 'q':
+        return 2;
+    case 'i':
+    case 'u':
+    case 'h':
+        return 4;
+    case 'x':
+    case 't':
+    case 'd':
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static gboolean
+typed_array_matches(char              type_char,
+                    GjsTypedArrayType array_type)
+{
+    switch (type_char) {
+    case 'y':
+        return array_type == GJS_TYPED_ARRAY_UINT8 ||
+            array_type == GJS_TYPED_ARRAY_UINT8_CLAMPED;
+    case 'n':
+        return array_type == GJS_TYPED_ARRAY_INT16;
+    case 'q':
+        return array_type == GJS_TYPED_ARRAY_UINT16;
+    case 'i':
+    case 'h':
+        return array_type == GJS_TYPED_ARRAY_INT32;
+    case 'u':
+        return array_type == GJS_TYPED_ARRAY_UINT32;
+    case 'd':
+        return array_type == GJS_TYPED_ARRAY_FLOAT64;
+    default:
+        return FALSE;
+    }
+}
+
+static JSBool
+get_length(JSContext *context,
+           JSObject  *obj,
+           guint32   *length_p)
+{
+    jsval length_val;
+
+    if (!gjs_object_get_property_const(context, obj, GJS_STRING_LENGTH,
+                                       &length_val))
+        return JS_FALSE;
+
+    return JS_ValueToECMAUint32(context, length_val, length_p);
+}
+
+static JSObject *
+value_to_container(JSContext          *context,
+                   const GVariantType *type,
+                   jsval               value)
+{
+    if (!JSVAL_IS_OBJECT(value) || JSVAL_IS_NULL(value)) {
+        gjs_throw_custom(context, "TypeError",
+                         "Expected an object for GVariant type '%.*s'",
+                         TYPE_STRING_ARGS(type));
+        return NULL;
+    }
+
+    return JSVAL_TO_OBJECT(value);
+}
+
+/* Integers are checked against the range of the type, and never
+ * wrapped around. NaN is rejected by the comparisons too. The bounds
+ * are exclusive because G_MAXINT64 and G_MAXUINT64 round up to a power
+ * of two as doubles, which doesn't fit in the integer type.
+ */
+static JSBool
+integer_from_value(JSContext *context,
+                   char       type_char,
+                   jsval      value,
+                   double     min,
+                   double     max_exclusive,
+                   double    *d_p)
+{
+    if (!JS_ValueToNumber(context, value, d_p))
+        return JS_FALSE;
+
+    if (!(*d_p >= min && *d_p < max_exclusive)) {
+        gjs_throw(context, "value is out of range for GVariant type '%c'",
+                  type_char);
+        return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
+/* Same conversions as gjs_value_to_g_argument() does for the
+ * corresponding GI types, but with stricter range checks */
+static JSBool
+fixed_from_value(JSContext  *context,
+                 char        type_char,
+                 jsval       value,
+                 FixedValue *fixed)
+{
+    JSBool b;
+    double d;
+
+    switch (type_char) {
+    case 'b':
+        if (!JS_ValueToBoolean(context, value, &b))
+            return JS_FALSE;
+        fixed->v_uint8 = b ? 1 : 0;
+        return JS_TRUE;
+
+    case 'y':
+        if (!integer_from_value(context, type_char, value, 0, 256., &d))
+            return JS_FALSE;
+        fixed->v_uint8 = (guint8) d;
+        return JS_TRUE;
+
+    case 'n':
+        if (!integer_from_value(context, type_char, value,
+                                -32768., 32768., &d))
+            return JS_FALSE;
+        fixed->v_int16 = (gint16) d;
+        return JS_TRUE;
+
+    case 'q':
+        if (!integer_from_value(context, type_char, value, 0, 65536., &d))
+            return JS_FALSE;
+        fixed->v_uint16 = (guint16) d;
+        return JS_TRUE;
+
+    case 'i':
+    case 'h':
+        if (!integer_from_value(context, type_char, value,
+                                -2147483648., 2147483648., &d))
+            return JS_FALSE;
+        fixed->v_int32 = (gint32) d;
+        return JS_TRUE;
+
+    case 'u':
+        if (!integer_from_value(context, type_char, value,
+                                0, 4294967296., &d))
+            return JS_FALSE;
+        fixed->v_uint32 = (guint32) d;
+        return JS_TRUE;
+
+    case 'x':
+        if (!integer_from_value(context, type_char, value,
+                                -9223372036854775808.,
+                                9223372036854775808., &d))
+            return JS_FALSE;
+        fixed->v_int64 = (gint64) d;
+        return JS_TRUE;
+
+    case 't':
+        if (!integer_from_value(context, type_char, value,
+                                0, 18446744073709551616., &d))
+            return JS_FALSE;
+        fixed->v_uint64 = (guint64) d;
+        return JS_TRUE;
+
+    case 'd':
+        if (!JS_ValueToNumber(context, value, &d))
+            return JS_FALSE;
+        fixed->v_double = d;
+        return JS_TRUE;
+
+    default:
+        g_assert_not_reached();
+    }
+
+    return JS_FALSE;
+}
+
+static GVariant *
+fixed_to_variant(char              type_char,
+                 const FixedValue *fixed)
+{
+    switch (type_char) {
+    case 'b':
+        return g_variant_new_boolean(fixed->v_uint8);
+    case 'y':
+        return g_variant_new_byte(fixed->v_uint8);
+    case 'n':
+        return g_variant_new_int16(fixed->v_int16);
+    case 'q':
+        return g_variant_new_uint16(fixed->v_uint16);
+    case 'i':
+        return g_variant_new_int32(fixed->v_int32);
+    case 'h':
+        return g_variant_new_handle(fixed->v_int32);
+    case 'u':
+        return g_variant_new_uint32(fixed->v_uint32);
+    case 'x':
+        return g_variant_new_int64(fixed->v_int64);
+    case 't':
+        return g_variant_new_uint64(fixed->v_uint64);
+    case 'd':
+        return g_variant_new_double(fixed->v_double);
+    default:
+        g_assert_not_reached();
+        return NULL;
+    }
+}
+
+static JSBool
+fixed_to_value(JSContext        *context,
+               char              type_char,
+               const FixedValue *fixed,
+               jsval            *value_p)
+{
+    switch (type_char) {
+    case 'b':
+        *value_p = BOOLEAN_TO_JSVAL(fixed->v_uint8 != 0);
+        return JS_TRUE;
+    case 'y':
+        *value_p = INT_TO_JSVAL(fixed->v_uint8);
+        return JS_TRUE;
+    case 'n':
+        *value_p = INT_TO_JSVAL(fixed->v_int16);
+        return JS_TRUE;
+    case 'q':
+        *value_p = INT_TO_JSVAL(fixed->v_uint16);
+        return JS_TRUE;
+    case 'i':
+    case 'h':
+        *value_p = INT_TO_JSVAL(fixed->v_int32);
+        return JS_TRUE;
+    case 'u':
+        return JS_NewNumberValue(context, fixed->v_uint32, value_p);
+    case 'x':
+        return JS_NewNumberValue(context, (double) fixed->v_int64, value_p);
+    case 't':
+        return JS_NewNumberValue(context, (double) fixed->v_uint64, value_p);
+    case 'd':
+        return JS_NewNumberValue(context, fixed->v_double, value_p);
+    default:
+        g_assert_not_reached();
+        return JS_FALSE;
+    }
+}
+
+static GVariant *
+pack_string(JSContext *context,
+            char       type_char,
+            jsval      value)
+{
+    GVariant *result = NULL;
+    char *str;
+
+    if (!gjs_string_to_utf8(context, value, &str))
+        return NULL;
+
+    switch (type_char) {
+    case 's':
+        result = g_variant_new_string(str);
+        break;
+    case 'o':
+        if (g_variant_is_object_path(str))
+            result = g_variant_new_object_path(str);
+        else
+            gjs_throw(context, "'%s' is not a valid D-Bus object path", str);
+        break;
+    case 'g':
+        if (g_variant_is_signature(str))
+            result = g_variant_new_signature(str);
+        else
+            gjs_throw(context, "'%s' is not a valid D-Bus signature", str);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    g_free(str);
+    return result;
+}
+
+static GVariant *
+pack_variant(JSContext *context,
+             jsval      value)
+{
+    JSObject *obj;
+    GVariant *child;
+
+    if (!JSVAL_IS_OBJECT(value) || JSVAL_IS_NULL(value)) {
+        gjs_throw_custom(context, "TypeError",
+                         "Expected a GLib.Variant for GVariant type 'v'");
+        return NULL;
+    }
+
+    obj = JSVAL_TO_OBJECT(value);
+    if (!gjs_typecheck_boxed(context, obj, NULL, G_TYPE_VARIANT, JS_TRUE))
+        return NULL;
+
+    child = gjs_c_struct_from_boxed(context, obj);
+    if (child == NULL) {
+        gjs_throw(context, "Cannot pack the GLib.Variant prototype");
+        return NULL;
+    }
+
+    return g_variant_new_variant(child);
+}
+
+static GVariant *
+pack_fixed_array(JSContext          *context,
+                 const GVariantType *type,
+                 char                elem_char,
+                 JSObject           *obj)
+{
+    const GVariantType *elem_type;
+    GjsTypedArrayType array_type;
+    gsize size;
+    void *data;
+    guint8 *buffer;
+    guint32 length, i;
+    GVariant *result;
+
+    elem_type = g_variant_type_element(type);
+    size = fixed_element_size(elem_char);
+
+    if (gjs_typed_array_peek_data(context, obj, &array_type, &data, &length) &&
+        typed_array_matches(elem_char, array_type))
+        return g_variant_new_fixed_array(elem_type, data, length, size);
+
+    if (elem_char == 'y' && gjs_typecheck_bytearray(context, obj, JS_FALSE)) {
+        guint8 *bytes;
+        gsize len;
+
+        gjs_byte_array_peek_data(context, obj, &bytes, &len);
+        return g_variant_new_fixed_array(elem_type, bytes, len, 1);
+    }
+
+    if (!get_length(context, obj, &length))
+        return NULL;
+
+    buffer = g_malloc(length * size);
+    for (i = 0; i < length; i++) {
+        FixedValue fixed;
+        jsval elem;
+
+        if (!JS_GetElement(context, obj, i, &elem) ||
+            !fixed_from_value(context, elem_char, elem, &fixed)) {
+            g_free(buffer);
+            return NULL;
+        }
+
+        memcpy(buffer + i * size, &fixed, size);
+    }
+
+    result = g_variant_new_fixed_array(elem_type, buffer, length, size);
+    g_free(buffer);
+
+    return result;
+}
+
+static GVariant *
+pack_dict(JSContext          *context,
+          const GVariantType *type,
+          JSObject           *obj)
+{
+    const GVariantType *key_type, *value_type;
+    GVariantBuilder builder;
+    JSObject *iter;
+    jsid prop_id;
+
+    key_type = g_variant_type_key(g_variant_type_element(type));
+    value_type = g_variant_type_value(g_variant_type_element(type));
+
+    iter = JS_NewPropertyIterator(context, obj);
+    if (iter == NULL)
+        return NULL;
+
+    prop_id = JSID_VOID;
+    if (!JS_NextProperty(context, iter, &prop_id))
+        return NULL;
+
+    g_variant_builder_init(&builder, type);
+
+    while (!JSID_IS_VOID(prop_id)) {
+        jsval key_js, val_js;
+        JSString *key_str;
+        GVariant *key, *value;
+
+        /* Numeric ids come back as integers, but the keys of a JS
+         * object are always strings */
+        if (!JS_IdToValue(context, prop_id, &key_js))
+            goto fail;
+
+        key_str = JS_ValueToString(context, key_js);
+        if (key_str == NULL)
+            goto fail;
+
+        key = pack_value(context, key_type, STRING_TO_JSVAL(key_str));
+        if (key == NULL)
+            goto fail;
+
+        if (!JS_GetPropertyById(context, obj, prop_id, &val_js) ||
+            (value = pack_value(context, value_type, val_js)) == NULL) {
+            g_variant_unref(g_variant_ref_sink(key));
+            goto fail;
+        }
+
+        g_variant_builder_add_value(&builder,
+                                    g_variant_new_dict_entry(key, value));
+
+        prop_id = JSID_VOID;
+        if (!JS_NextProperty(context, iter, &prop_id))
+            goto fail;
+    }
+
+    return g_variant_builder_end(&builder);
+
+ fail:
+    g_variant_builder_clear(&builder);
+    return NULL;
+}
+
+static GVariant *
+pack_array(JSContext          *context,
+           const GVariantType *type,
+           jsval               value)
+{
+    const GVariantType *elem_type;
+    GVariantBuilder builder;
+    JSObject *obj;
+    guint32 length, i;
+    char elem_char;
+
+    elem_type = g_variant_type_element(type);
+    elem_char = g_variant_type_peek_string(elem_type)[0];
+
+    if (elem_char == 'y' && JSVAL_IS_STRING(value)) {
+        GVariant *result;
+        char *str;
+
+        if (!gjs_string_to_utf8(context, value, &str))
+            return NULL;
+
+        result = g_variant_new_fixed_array(elem_type, str, strlen(str), 1);
+        g_free(str);
+        return result;
+    }
+
+    obj = value_to_container(context, type, value);
+    if (obj == NULL)
+        return NULL;
+
+    if (g_variant_type_is_dict_entry(elem_type))
+        return pack_dict(context, type, obj);
+
+    if (fixed_element_size(elem_char) != 0)
+        return pack_fixed_array(context, type, elem_char, obj);
+
+    if (!get_length(context, obj, &length))
+        return NULL;
+
+    g_variant_builder_init(&builder, type);
+
+    for (i = 0; i < length; i++) {
+        GVariant *child;
+        jsval elem;
+
+        if (!JS_GetElement(context, obj, i, &elem) ||
+            (child = pack_value(context, elem_type, elem)) == NULL) {
+            g_variant_builder_clear(&builder);
+            return NULL;
+        }
+
+        g_variant_builder_add_value(&builder, child);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+static GVariant *
+pack_tuple(JSContext          *context,
+           const GVariantType *type,
+           jsval               value)
+{
+    const GVariantType *item_type;
+    GVariantBuilder builder;
+    JSObject *obj;
+    guint32 length, i;
+    gsize n_items;
+
+    obj = value_to_container(context, type, value);
+    if (obj == NULL)
+        return NULL;
+
+    if (!get_length(context, obj, &length))
+        return NULL;
+
+    n_items = g_variant_type_n_items(type);
+    if (length < n_items) {
+        gjs_throw_custom(context, "TypeError",
+                         "GVariant type '%.*s' needs %u elements, got %u",
+                         TYPE_STRING_ARGS(type), (guint) n_items, length);
+        return NULL;
+    }
+
+    g_variant_builder_init(&builder, type);
+
+    for (item_type = g_variant_type_first(type), i = 0;
+         item_type != NULL;
+         item_type = g_variant_type_next(item_type), i++) {
+        GVariant *child;
+        jsval elem;
+
+        if (!JS_GetElement(context, obj, i, &elem) ||
+            (child = pack_value(context, item_type, elem)) == NULL) {
+            g_variant_builder_clear(&builder);
+            return NULL;
+        }
+
+        g_variant_builder_add_value(&builder, child);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+static GVariant *
+pack_dict_entry(JSContext          *context,
+                const GVariantType *type,
+                jsval               value)
+{
+    JSObject *obj;
+    GVariant *key, *child;
+    jsval elem;
+
+    obj = value_to_container(context, type, value);
+    if (obj == NULL)
+        return NULL;
+
+    if (!JS_GetElement(context, obj, 0, &elem) ||
+        (key = pack_value(context, g_variant_type_key(type), elem)) == NULL)
+        return NULL;
+
+    if (!JS_GetElement(context, obj, 1, &elem) ||
+        (child = pack_value(context, g_variant_type_value(type), elem)) == NULL) {
+        g_variant_unref(g_variant_ref_sink(key));
+        return NULL;
+    }
+
+    return g_variant_new_dict_entry(key, child);
+}
+
+/* Returns a floating reference, or NULL with an exception pending */
+static GVariant *
+pack_value(JSContext          *context,
+           const GVariantType *type,
+           jsval               value)
+{
+    char type_char;
+
+    type_char = g_variant_type_peek_string(type)[0];
+
+    switch (type_char) {
+    case 'b':
+    case 'y':
+    case 'n':
+    case 'q':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 't':
+    case 'h':
+    case 'd': {
+        FixedValue fixed;
+
+        if (!fixed_from_value(context, type_char, value, &fixed))
+            return NULL;
+        return fixed_to_variant(type_char, &fixed);
+    }
+
+    case 's':
+    case 'o':
+    case 'g':
+        return pack_string(context, type_char, value);
+
+    case 'v':
+        return pack_variant(context, value);
+
+    case 'm': {
+        GVariant *child;
+
+        if (JSVAL_IS_NULL(value) || JSVAL_IS_VOID(value))
+            return g_variant_new_maybe(g_variant_type_element(type), NULL);
+
+        child = pack_value(context, g_variant_type_element(type), value);
+        if (child == NULL)
+            return NULL;
+        return g_variant_new_maybe(NULL, child);
+    }
+
+    case 'a':
+        return pack_array(context, type, value);
+
+    case '(':
+        return pack_tuple(context, type, value);
+
+    case '{':
+        return pack_dict_entry(context, type, value);
+
+    default:
+        g_assert_not_reached();
+        return NULL;
+    }
+}
+
+/**
+ * gjs_variant_pack:
+ * @context: a #JSContext
+ * @signature: a GVariant type string
+ * @value: the JS value to pack
+ *
+ * Builds a #GVariant of type @signature out of @value, following the
+ * rules of new GLib.Variant().
+ *
+ * Returns: (transfer floating): the new variant, or %NULL with an
+ * exception pending
+ */
+GVariant *
+gjs_variant_pack(JSContext  *context,
+                 const char *signature,
+                 jsval       value)
+{
+    const GVariantType *type;
+    const char *end;
+
+    if (!g_variant_type_string_scan(signature, NULL, &end)) {
+        gjs_throw_custom(context, "TypeError",
+                         "Invalid GVariant signature '%s'", signature);
+        return NULL;
+    }
+
+    if (*end != '\0') {
+        gjs_throw_custom(context, "TypeError",
+                         "Invalid GVariant signature '%s' (more than one single complete type)",
+                         signature);
+        return NULL;
+    }
+
+    type = G_VARIANT_TYPE(signature);
+    if (!g_variant_type_is_definite(type)) {
+        gjs_throw_custom(context, "TypeError",
+                         "Invalid GVariant signature '%s' (not a definite type)",
+                         signature);
+        return NULL;
+    }
+
+    return pack_value(context, type, value);
+}
+
+/* Takes ownership of @child */
+static JSBool
+unpack_child(JSContext *context,
+             GVariant  *child,
+             gboolean   deep,
+             jsval     *value_p)
+{
+    JSBool ret;
+
+    if (deep)
+        ret = unpack_value(context, child, TRUE, value_p);
+    else
+        ret = variant_to_value(context, child, value_p);
+
+    g_variant_unref(child);
+    return ret;
+}
+
+static JSBool
+unpack_fixed_array(JSContext *context,
+                   GVariant  *variant,
+                   char       elem_char,
+                   jsval     *value_p)
+{
+    const guint8 *data;
+    gsize size, n_elements, i;
+    jsval *elems;
+    JSObject *array;
+
+    size = fixed_element_size(elem_char);
+    data = g_variant_get_fixed_array(variant, &n_elements, size);
+
+    /* The elements are all numbers or booleans, so there is nothing in
+     * the buffer for the GC to worry about */
+    elems = g_new(jsval, n_elements);
+    for (i = 0; i < n_elements; i++) {
+        FixedValue fixed;
+
+        memcpy(&fixed, data + i * size, size);
+        if (!fixed_to_value(context, elem_char, &fixed, &elems[i])) {
+            g_free(elems);
+            return JS_FALSE;
+        }
+    }
+
+    array = JS_NewArrayObject(context, n_elements, elems);
+    g_free(elems);
+    if (array == NULL)
+        return JS_FALSE;
+
+    *value_p = OBJECT_TO_JSVAL(array);
+    return JS_TRUE;
+}
+
+static JSBool
+unpack_dict(JSContext *context,
+            GVariant  *variant,
+            gboolean   deep,
+            jsval     *value_p)
+{
+    JSObject *obj;
+    gsize n_children, i;
+
+    obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (obj == NULL)
+        return JS_FALSE;
+
+    n_children = g_variant_n_children(variant);
+    for (i = 0; i < n_children; i++) {
+        GVariant *entry, *key, *child;
+        jsval key_js, val_js;
+        jsid id;
+        JSBool ok;
+
+        entry = g_variant_get_child_value(variant, i);
+        key = g_variant_get_child_value(entry, 0);
+        child = g_variant_get_child_value(entry, 1);
+        g_variant_unref(entry);
+
+        /* The key is always unpacked, or it couldn't be a property name */
+        ok = unpack_value(context, key, TRUE, &key_js) &&
+            JS_ValueToId(context, key_js, &id);
+        g_variant_unref(key);
+
+        if (!ok) {
+            g_variant_unref(child);
+            return JS_FALSE;
+        }
+
+        if (!unpack_child(context, child, deep, &val_js) ||
+            !JS_SetPropertyById(context, obj, id, &val_js))
+            return JS_FALSE;
+    }
+
+    *value_p = OBJECT_TO_JSVAL(obj);
+    return JS_TRUE;
+}
+
+static JSBool
+unpack_container(JSContext *context,
+                 GVariant  *variant,
+                 gboolean   deep,
+                 jsval     *value_p)
+{
+    JSObject *array;
+    gsize n_children, i;
+
+    array = JS_NewArrayObject(context, 0, NULL);
+    if (array == NULL)
+        return JS_FALSE;
+
+    n_children = g_variant_n_children(variant);
+    for (i = 0; i < n_children; i++) {
+        jsval elem;
+
+        if (!unpack_child(context, g_variant_get_child_value(variant, i),
+                          deep, &elem) ||
+            !JS_SetElement(context, array, i, &elem))
+            return JS_FALSE;
+    }
+
+    *value_p = OBJECT_TO_JSVAL(array);
+    return JS_TRUE;
+}
+
+static JSBool
+unpack_array(JSContext *context,
+             GVariant  *variant,
+             gboolean   deep,
+             jsval     *value_p)
+{
+    const GVariantType *elem_type;
+    char elem_char;
+
+    elem_type = g_variant_type_element(g_variant_get_type(variant));
+    elem_char = g_variant_type_peek_string(elem_type)[0];
+
+    if (g_variant_type_is_dict_entry(elem_type))
+        return unpack_dict(context, variant, deep, value_p);
+
+    if (elem_char == 'y') {
+        GBytes *bytes;
+        JSObject *obj;
+
+        bytes = g_variant_get_data_as_bytes(variant);
+        obj = gjs_byte_array_from_bytes(context, bytes);
+        g_bytes_unref(bytes);
+        if (obj == NULL)
+            return JS_FALSE;
+
+        *value_p = OBJECT_TO_JSVAL(obj);
+        return JS_TRUE;
+    }
+
+    /* A shallow unpack gives back the elements as GLib.Variant */
+    if (deep && fixed_element_size(elem_char) != 0)
+        return unpack_fixed_array(context, variant, elem_char, value_p);
+
+    return unpack_container(context, variant, deep, value_p);
+}
+
+static JSBool
+unpack_value(JSContext *context,
+             GVariant  *variant,
+             gboolean   deep,
+             jsval     *value_p)
+{
+    switch (g_variant_classify(variant)) {
+    case G_VARIANT_CLASS_BOOLEAN:
+        *value_p = BOOLEAN_TO_JSVAL(g_variant_get_boolean(variant));
+        return JS_TRUE;
+    case G_VARIANT_CLASS_BYTE:
+        *value_p = INT_TO_JSVAL(g_variant_get_byte(variant));
+        return JS_TRUE;
+    case G_VARIANT_CLASS_INT16:
+        *value_p = INT_TO_JSVAL(g_variant_get_int16(variant));
+        return JS_TRUE;
+    case G_VARIANT_CLASS_UINT16:
+        *value_p = INT_TO_JSVAL(g_variant_get_uint16(variant));
+        return JS_TRUE;
+    case G_VARIANT_CLASS_INT32:
+        *value_p = INT_TO_JSVAL(g_variant_get_int32(variant));
+        return JS_TRUE;
+    case G_VARIANT_CLASS_HANDLE:
+        *value_p = INT_TO_JSVAL(g_variant_get_handle(variant));
+        return JS_TRUE;
+    case G_VARIANT_CLASS_UINT32:
+        return JS_NewNumberValue(context, g_variant_get_uint32(variant), value_p);
+    case G_VARIANT_CLASS_INT64:
+        return JS_NewNumberValue(context, (double) g_variant_get_int64(variant),
+                                 value_p);
+    case G_VARIANT_CLASS_UINT64:
+        return JS_NewNumberValue(context, (double) g_variant_get_uint64(variant),
+                                 value_p);
+    case G_VARIANT_CLASS_DOUBLE:
+        return JS_NewNumberValue(context, g_variant_get_double(variant), value_p);
+
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE: {
+        const char *str;
+        gsize len;
+
+        str = g_variant_get_string(variant, &len);
+        return gjs_string_from_utf8(context, str, len, value_p);
+    }
+
+    case G_VARIANT_CLASS_VARIANT: {
+        GVariant *child;
+        JSBool ret;
+
+        /* Even deep_unpack() keeps the boxing of 'v', otherwise the
+         * type of the contents would be lost */
+        child = g_variant_get_variant(variant);
+        ret = variant_to_value(context, child, value_p);
+        g_variant_unref(child);
+        return ret;
+    }
+
+    case G_VARIANT_CLASS_MAYBE: {
+        GVariant *child;
+
+        child = g_variant_get_maybe(variant);
+        if (child == NULL) {
+            *value_p = JSVAL_NULL;
+            return JS_TRUE;
+        }
+        return unpack_child(context, child, deep, value_p);
+    }
+
+    case G_VARIANT_CLASS_ARRAY:
+        return unpack_array(context, variant, deep, value_p);
+
+    case G_VARIANT_CLASS_TUPLE:
+    case G_VARIANT_CLASS_DICT_ENTRY:
+        return unpack_container(context, variant, deep, value_p);
+
+    default:
+        g_assert_not_reached();
+        return JS_FALSE;
+    }
+}
+
+/**
+ * gjs_variant_unpack:
+ * @context: a #JSContext
+ * @variant: a #GVariant
+ * @deep: whether to unpack the children too
+ * @value_p: (out): the unpacked value
+ *
+ * Converts @variant to a JS value, like GLib.Variant.unpack() (or
+ * deep_unpack(), if @deep is %TRUE).
+ *
+ * Returns: %JS_FALSE with an exception pending on failure
+ */
+JSBool
+gjs_variant_unpack(JSContext *context,
+                   GVariant  *variant,
+                   gboolean   deep,
+                   jsval     *value_p)
+{
+    return unpack_value(context, variant, deep, value_p);
+}
+
+static JSBool
+variant_pack_func(JSContext *context,
+                  unsigned   argc,
+                  jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    char *signature;
+    GVariant *variant;
+    jsval retval;
+    JSBool ret;
+
+    if (argc != 2) {
+        gjs_throw(context, "variant_pack() takes two arguments");
+        return JS_FALSE;
+    }
+
+    if (!gjs_string_to_utf8(context, argv[0], &signature))
+        return JS_FALSE;
+
+    variant = gjs_variant_pack(context, signature, argv[1]);
+    g_free(signature);
+    if (variant == NULL)
+        return JS_FALSE;
+
+    g_variant_ref_sink(variant);
+    ret = variant_to_value(context, variant, &retval);
+    g_variant_unref(variant);
+
+    if (ret)
+        JS_SET_RVAL(context, vp, retval);
+    return ret;
+}
+
+static JSBool
+variant_unpack_func(JSContext *context,
+                    unsigned   argc,
+                    jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *obj;
+    GVariant *variant;
+    JSBool deep;
+    jsval retval;
+
+    if (argc != 2 || !JSVAL_IS_OBJECT(argv[0]) || JSVAL_IS_NULL(argv[0])) {
+        gjs_throw(context, "variant_unpack() takes a GLib.Variant and a boolean");
+        return JS_FALSE;
+    }
+
+    obj = JSVAL_TO_OBJECT(argv[0]);
+    if (!gjs_typecheck_boxed(context, obj, NULL, G_TYPE_VARIANT, JS_TRUE))
+        return JS_FALSE;
+
+    variant = gjs_c_struct_from_boxed(context, obj);
+    if (variant == NULL) {
+        gjs_throw(context, "Cannot unpack the GLib.Variant prototype");
+        return JS_FALSE;
+    }
+
+    if (!JS_ValueToBoolean(context, argv[1], &deep))
+        return JS_FALSE;
+
+    if (!gjs_variant_unpack(context, variant, deep, &retval))
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, retval);
+    return JS_TRUE;
+}
+
+JSBool
+gjs_define_variant_stuff(JSContext *context,
+                         JSObject  *module_obj)
+{
+    if (!JS_DefineFunction(context, module_obj,
+                           "variant_pack",
+                           (JSNative)variant_pack_func,
+                           2, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module_obj,
+                           "variant_unpack",
+                           (JSNative)variant_unpack_func,
+                           2, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    return JS_TRUE;
+}
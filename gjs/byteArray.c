@@ -23,6 +23,7 @@
 
 #include <config.h>
 #include <string.h>
+#include <errno.h>
 #include <glib.h>
 #include "byteArray.h"
 #include "../gi/boxed.h"
@@ -31,6 +32,13 @@
 #include <girepository.h>
 #include <util/log.h>
 
+/* The data lives in exactly one of @array or @bytes. @bytes is
+ * immutable and may be shared with C code or GLib.Bytes wrappers, so
+ * reads are served straight from whichever one is set, and only
+ * writes convert to a private @array. g_bytes_unref_to_array() steals
+ * the data when we hold the only reference, so the copy only happens
+ * if someone else is still looking at the same GBytes.
+ */
 typedef struct {
     GByteArray *array;
     GBytes     *bytes;
@@ -83,7 +91,7 @@ gjs_value_from_gsize(JSContext         *context,
                      gsize              v,
                      jsval             *value_p)
 {
-    if (v > (gsize) JSVAL_INT_MAX) {
+    if (v <= (gsize) JSVAL_INT_MAX) {
         *value_p = INT_TO_JSVAL(v);
         return JS_TRUE;
     } else {
@@ -91,6 +99,7 @@ gjs_value_from_gsize(JSContext         *context,
     }
 }
 
+/* Call before writing to the ByteArray */
 static void
 byte_array_ensure_array (ByteArrayInstance  *priv)
 {
@@ -102,6 +111,33 @@ byte_array_ensure_array (ByteArrayInstance  *priv)
     }
 }
 
+/* Like g_byte_array_set_size(), but new bytes are always zeroed;
+ * after a round trip through GBytes the array isn't clear-to-zero.
+ * @len is 64-bit so that callers can pass offset + size without it
+ * wrapping; a RangeError is thrown if it doesn't fit the array.
+ * Call byte_array_ensure_array() first.
+ */
+static JSBool
+byte_array_set_length (JSContext          *context,
+                       ByteArrayInstance  *priv,
+                       guint64             len)
+{
+    gsize old_len = priv->array->len;
+
+    if (len > G_MAXUINT) {
+        gjs_throw_custom(context, "RangeError",
+                         "ByteArray length %" G_GUINT64_FORMAT " is too large",
+                         len);
+        return JS_FALSE;
+    }
+
+    g_byte_array_set_size(priv->array, (guint) len);
+    if (len > old_len)
+        memset(priv->array->data + old_len, 0, len - old_len);
+
+    return JS_TRUE;
+}
+
 static void
 byte_array_ensure_gbytes (ByteArrayInstance  *priv)
 {
@@ -168,6 +204,60 @@ gjs_value_to_byte(JSContext         *context,
     return JS_TRUE;
 }
 
+/* Returns the length of the run of ASCII bytes at the start of @data */
+static gsize
+ascii_prefix_length(const guint8 *data,
+                    gsize         len)
+{
+    gsize i = 0;
+
+    /* Check a word at a time first; memcpy() keeps this alignment-safe
+     * and compiles down to a plain load.
+     */
+    for (; i + sizeof(guint64) <= len; i += sizeof(guint64)) {
+        guint64 word;
+
+        memcpy(&word, data + i, sizeof(word));
+        if (word & G_GUINT64_CONSTANT(0x8080808080808080))
+            break;
+    }
+
+    for (; i < len; i++) {
+        if (data[i] & 0x80)
+            break;
+    }
+
+    return i;
+}
+
+/* Creates a JS string from bytes that are each one character, i.e.
+ * ASCII or Latin-1, without an intermediate UTF-8 or UTF-16 copy.
+ */
+static JSString *
+string_from_latin1(JSContext    *context,
+                   const guint8 *data,
+                   gsize         len)
+{
+    JSString *s;
+    jschar *chars;
+    gsize i;
+
+    chars = JS_malloc(context, (len + 1) * sizeof(jschar));
+    if (chars == NULL)
+        return NULL;
+
+    for (i = 0; i < len; i++)
+        chars[i] = data[i];
+    chars[len] = 0;
+
+    /* takes ownership of chars on success */
+    s = JS_NewUCString(context, chars, len);
+    if (s == NULL)
+        JS_free(context, chars);
+
+    return s;
+}
+
 static JSBool
 byte_array_get_index(JSContext         *context,
                      JSObject          *obj,
@@ -272,8 +362,7 @@ byte_array_length_setter(JSContext *context,
                   "Can't set ByteArray length to non-integer");
         return JS_FALSE;
     }
-    g_byte_array_set_size(priv->array, len);
-    return JS_TRUE;
+    return byte_array_set_length(context, priv, len);
 }
 
 static JSBool
@@ -293,10 +382,9 @@ byte_array_set_index(JSContext         *context,
     byte_array_ensure_array(priv);
 
     /* grow the array if necessary */
-    if (idx >= priv->array->len) {
-        g_byte_array_set_size(priv->array,
-                              idx + 1);
-    }
+    if (idx >= priv->array->len &&
+        !byte_array_set_length(context, priv, (guint64) idx + 1))
+        return JS_FALSE;
 
     g_array_index(priv->array, guint8, idx) = v;
 
@@ -424,13 +512,15 @@ to_string_func(JSContext *context,
     char *encoding;
     gboolean encoding_is_utf8;
     gchar *data;
+    guint8 *bytes;
+    gsize len;
 
     priv = priv_from_js(context, object);
 
     if (priv == NULL)
         return JS_TRUE; /* prototype, not instance */
 
-    byte_array_ensure_array(priv);
+    gjs_byte_array_peek_data(context, object, &bytes, &len);
 
     if (argc >= 1 &&
         JSVAL_IS_STRING(argv[0])) {
@@ -452,13 +542,21 @@ to_string_func(JSContext *context,
         encoding_is_utf8 = TRUE;
     }
 
-    if (priv->array->len == 0)
+    if (len == 0)
         /* the internal data pointer could be NULL in this case */
         data = "";
     else
-        data = (gchar*)priv->array->data;
+        data = (gchar*)bytes;
 
-    if (encoding_is_utf8) {
+    if (encoding_is_utf8 && ascii_prefix_length((guint8*)data, len) == len) {
+        JSString *s;
+
+        s = string_from_latin1(context, (guint8*)data, len);
+        if (s == NULL)
+            return JS_FALSE;
+        JS_SET_RVAL(context, vp, STRING_TO_JSVAL(s));
+        return JS_TRUE;
+    } else if (encoding_is_utf8) {
         /* optimization, avoids iconv overhead and runs
          * libmozjs hardwired utf8-to-utf16
          */
@@ -467,7 +565,7 @@ to_string_func(JSContext *context,
 
         ok = gjs_string_from_utf8(context,
                                   data,
-                                  priv->array->len,
+                                  len,
                                   &retval);
         if (ok)
             JS_SET_RVAL(context, vp, retval);
@@ -481,7 +579,7 @@ to_string_func(JSContext *context,
 
         error = NULL;
         u16_str = g_convert(data,
-                           priv->array->len,
+                           len,
                            "UTF-16",
                            encoding,
                            NULL, /* bytes read */
@@ -552,6 +650,28 @@ byte_array_new(JSContext *context)
     return array;
 }
 
+static gboolean
+string_is_ascii(JSContext     *context,
+                JSString      *str,
+                const jschar **chars_p,
+                gsize         *len_p)
+{
+    gsize i;
+
+    *chars_p = JS_GetStringCharsAndLength(context, str, len_p);
+    if (*chars_p == NULL) {
+        JS_ClearPendingException(context);
+        return FALSE;
+    }
+
+    for (i = 0; i < *len_p; i++) {
+        if ((*chars_p)[i] >= 0x80)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 /* fromString() function implementation */
 static JSBool
 from_string_func(JSContext *context,
@@ -562,6 +682,8 @@ from_string_func(JSContext *context,
     ByteArrayInstance *priv;
     char *encoding;
     gboolean encoding_is_utf8;
+    const jschar *u16_chars;
+    gsize u16_len;
     JSObject *obj;
     JSBool retval = JS_FALSE;
 
@@ -604,7 +726,15 @@ from_string_func(JSContext *context,
         encoding_is_utf8 = TRUE;
     }
 
-    if (encoding_is_utf8) {
+    if (encoding_is_utf8 &&
+        string_is_ascii(context, JSVAL_TO_STRING(argv[0]), &u16_chars, &u16_len)) {
+        /* fast path, each character is one byte */
+        gsize i;
+
+        g_byte_array_set_size(priv->array, u16_len);
+        for (i = 0; i < u16_len; i++)
+            priv->array->data[i] = u16_chars[i];
+    } else if (encoding_is_utf8) {
         /* optimization? avoids iconv overhead and runs
          * libmozjs hardwired utf16-to-utf8.
          */
@@ -621,8 +751,6 @@ from_string_func(JSContext *context,
         char *encoded;
         gsize bytes_written;
         GError *error;
-        const jschar *u16_chars;
-        gsize u16_len;
 
         u16_chars = JS_GetStringCharsAndLength(context, JSVAL_TO_STRING(argv[0]), &u16_len);
         if (u16_chars == NULL)
@@ -800,9 +928,10 @@ gjs_byte_array_from_byte_array (JSContext *context,
     priv = g_slice_new0(ByteArrayInstance);
     g_assert(priv_from_js(context, object) == NULL);
     JS_SetPrivate(object, priv);
-    priv->array = g_byte_array_new();
-    priv->array->data = g_memdup(array->data, array->len);
-    priv->array->len = array->len;
+    /* We don't own @array, so this is the one copy we have to make;
+     * the first write will take over the GBytes' data without copying.
+     */
+    priv->bytes = g_bytes_new(array->data, array->len);
 
     return object;
 }
@@ -880,6 +1009,863 @@ gjs_byte_array_peek_data (JSContext  *context,
     }
 }
 
+static JSObject *
+byte_array_new_for_array(JSContext  *context,
+                         GByteArray *array)
+{
+    JSObject *object;
+    ByteArrayInstance *priv;
+
+    object = JS_NewObject(context, &gjs_byte_array_class,
+                          gjs_byte_array_prototype, NULL);
+    if (!object) {
+        g_byte_array_unref(array);
+        gjs_throw(context, "failed to create byte array");
+        return NULL;
+    }
+
+    priv = g_slice_new0(ByteArrayInstance);
+    g_assert(priv_from_js(context, object) == NULL);
+    JS_SetPrivate(object, priv);
+    priv->array = array;
+
+    return object;
+}
+
+/* Resolves a start/end argument the way Array.prototype.slice() does,
+ * negative values counting from the end.
+ */
+static gsize
+resolve_index(gint32 idx,
+              gsize  len)
+{
+    if (idx < 0)
+        return (gsize) -(gint64) idx > len ? 0 : len + idx;
+    return MIN((gsize) idx, len);
+}
+
+/* Gets at the bytes of a ByteArray, a Uint8Array (or Int8Array) or a
+ * JS array of numbers. Only the last one needs to be copied; free
+ * *@free_p when done with the data.
+ */
+static JSBool
+get_source_bytes(JSContext  *context,
+                 JSObject   *src,
+                 const char *func_name,
+                 guint8    **data_p,
+                 gsize      *len_p,
+                 guint8    **free_p)
+{
+    GjsTypedArrayType type;
+    void *data;
+    guint32 length;
+
+    *free_p = NULL;
+
+    if (gjs_typecheck_bytearray(context, src, FALSE)) {
+        gjs_byte_array_peek_data(context, src, data_p, len_p);
+        return JS_TRUE;
+    }
+
+    if (gjs_typed_array_peek_data(context, src, &type, &data, &length) &&
+        (type == GJS_TYPED_ARRAY_UINT8 ||
+         type == GJS_TYPED_ARRAY_UINT8_CLAMPED ||
+         type == GJS_TYPED_ARRAY_INT8)) {
+        *data_p = data;
+        *len_p = length;
+        return JS_TRUE;
+    }
+
+    if (JS_IsArrayObject(context, src)) {
+        guint8 *buf;
+        guint32 i;
+
+        if (!JS_GetArrayLength(context, src, &length))
+            return JS_FALSE;
+
+        buf = g_malloc0(length + 1);
+        for (i = 0; i < length; i++) {
+            jsval elem = JSVAL_VOID;
+
+            if (!JS_GetElement(context, src, i, &elem) ||
+                (!JSVAL_IS_VOID(elem) &&
+                 !gjs_value_to_byte(context, elem, &buf[i]))) {
+                g_free(buf);
+                return JS_FALSE;
+            }
+        }
+
+        *data_p = *free_p = buf;
+        *len_p = length;
+        return JS_TRUE;
+    }
+
+    gjs_throw(context,
+              "%s() expects a ByteArray, Uint8Array or array of bytes",
+              func_name);
+    return JS_FALSE;
+}
+
+/* slice(start, end): copies a range of bytes into a new ByteArray */
+static JSBool
+slice_func(JSContext *context,
+           unsigned   argc,
+           jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    JSObject *ret;
+    GByteArray *array;
+    gint32 start = 0, end = G_MAXINT32;
+    guint8 *data;
+    gsize len, first, last;
+
+    if (priv_from_js(context, object) == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (!gjs_parse_args(context, "slice", "|ii", argc, argv,
+                        "start", &start, "end", &end))
+        return JS_FALSE;
+
+    gjs_byte_array_peek_data(context, object, &data, &len);
+    first = resolve_index(start, len);
+    last = MAX(first, resolve_index(end, len));
+
+    array = gjs_g_byte_array_new(0);
+    g_byte_array_append(array, data + first, last - first);
+
+    ret = byte_array_new_for_array(context, array);
+    if (ret == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(ret));
+    return JS_TRUE;
+}
+
+/* subarray(start, end): like slice(), but the new ByteArray shares the
+ * data with this one. Since both are copy-on-write, the data is only
+ * copied if either of them is written to.
+ */
+static JSBool
+subarray_func(JSContext *context,
+              unsigned   argc,
+              jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    JSObject *ret;
+    ByteArrayInstance *priv, *ret_priv;
+    gint32 start = 0, end = G_MAXINT32;
+    gsize len, first, last;
+
+    priv = priv_from_js(context, object);
+    if (priv == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (!gjs_parse_args(context, "subarray", "|ii", argc, argv,
+                        "start", &start, "end", &end))
+        return JS_FALSE;
+
+    byte_array_ensure_gbytes(priv);
+    len = g_bytes_get_size(priv->bytes);
+    first = resolve_index(start, len);
+    last = MAX(first, resolve_index(end, len));
+
+    ret = byte_array_new(context);
+    if (ret == NULL)
+        return JS_FALSE;
+
+    ret_priv = priv_from_js(context, ret);
+    ret_priv->bytes = g_bytes_new_from_bytes(priv->bytes, first, last - first);
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(ret));
+    return JS_TRUE;
+}
+
+/* set(src, offset): copies @src into this ByteArray at @offset,
+ * growing it if necessary
+ */
+static JSBool
+set_func(JSContext *context,
+         unsigned   argc,
+         jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    ByteArrayInstance *priv;
+    JSObject *src;
+    guint32 offset = 0;
+    guint8 *data, *to_free;
+    gsize len;
+
+    priv = priv_from_js(context, object);
+    if (priv == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (!gjs_parse_args(context, "set", "o|u", argc, argv,
+                        "src", &src, "offset", &offset))
+        return JS_FALSE;
+
+    if (!get_source_bytes(context, src, "set", &data, &len, &to_free))
+        return JS_FALSE;
+
+    if (len > 0) {
+        /* @src may be this ByteArray or share its data, so make sure
+         * the destination is writable and large enough before
+         * looking at the source again.
+         */
+        byte_array_ensure_array(priv);
+        if ((guint64) offset + len > priv->array->len &&
+            !byte_array_set_length(context, priv, (guint64) offset + len)) {
+            g_free(to_free);
+            return JS_FALSE;
+        }
+
+        /* Only the data pointer may have moved; if @src is this
+         * ByteArray, its length now includes the part just added */
+        if (to_free == NULL && gjs_typecheck_bytearray(context, src, FALSE)) {
+            gsize src_len;
+
+            gjs_byte_array_peek_data(context, src, &data, &src_len);
+        }
+
+        memmove(priv->array->data + offset, data, len);
+    }
+
+    g_free(to_free);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static gssize
+find_bytes(const guint8 *haystack,
+           gsize         haystack_len,
+           const guint8 *needle,
+           gsize         needle_len,
+           gsize         from)
+{
+    const guint8 *p, *last;
+
+    if (needle_len > haystack_len || from > haystack_len - needle_len)
+        return -1;
+
+    if (needle_len == 0)
+        return from;
+
+    p = haystack + from;
+    last = haystack + haystack_len - needle_len;
+    while (p <= last) {
+        p = memchr(p, needle[0], last - p + 1);
+        if (p == NULL)
+            return -1;
+        if (memcmp(p, needle, needle_len) == 0)
+            return p - haystack;
+        p++;
+    }
+
+    return -1;
+}
+
+/* indexOf(value, fromIndex): @value can be a byte, or a sequence of
+ * bytes given as a string (encoded as UTF-8) or anything set() accepts
+ */
+static JSBool
+index_of_func(JSContext *context,
+              unsigned   argc,
+              jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    gint32 from_index = 0;
+    guint8 *data, *needle, *to_free = NULL;
+    gsize len, needle_len, from;
+    guint8 byte;
+    gssize pos;
+
+    if (priv_from_js(context, object) == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (argc < 1) {
+        gjs_throw(context, "indexOf() requires an argument");
+        return JS_FALSE;
+    }
+
+    if (argc > 1 && !JS_ValueToECMAInt32(context, argv[1], &from_index))
+        return JS_FALSE;
+
+    if (JSVAL_IS_NUMBER(argv[0])) {
+        if (!gjs_value_to_byte(context, argv[0], &byte))
+            return JS_FALSE;
+        needle = &byte;
+        needle_len = 1;
+    } else if (JSVAL_IS_STRING(argv[0])) {
+        char *utf8;
+
+        if (!gjs_string_to_utf8(context, argv[0], &utf8))
+            return JS_FALSE;
+        needle = to_free = (guint8 *) utf8;
+        needle_len = strlen(utf8);
+    } else if (!JSVAL_IS_NULL(argv[0]) && JSVAL_IS_OBJECT(argv[0])) {
+        if (!get_source_bytes(context, JSVAL_TO_OBJECT(argv[0]), "indexOf",
+                              &needle, &needle_len, &to_free))
+            return JS_FALSE;
+    } else {
+        gjs_throw(context, "indexOf() expects a byte or a sequence of bytes");
+        return JS_FALSE;
+    }
+
+    gjs_byte_array_peek_data(context, object, &data, &len);
+    from = resolve_index(from_index, len);
+
+    if (needle_len == 1) {
+        const guint8 *p = from < len ? memchr(data + from, needle[0], len - from) : NULL;
+        pos = p ? p - data : -1;
+    } else {
+        pos = find_bytes(data, len, needle, needle_len, from);
+    }
+
+    g_free(to_free);
+
+    if (pos < 0) {
+        JS_SET_RVAL(context, vp, INT_TO_JSVAL(-1));
+    } else {
+        jsval retval;
+
+        if (!gjs_value_from_gsize(context, pos, &retval))
+            return JS_FALSE;
+        JS_SET_RVAL(context, vp, retval);
+    }
+    return JS_TRUE;
+}
+
+/* fill(value, start, end) */
+static JSBool
+fill_func(JSContext *context,
+          unsigned   argc,
+          jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    ByteArrayInstance *priv;
+    gint32 start = 0, end = G_MAXINT32;
+    gsize len, first, last;
+    guint8 byte;
+
+    priv = priv_from_js(context, object);
+    if (priv == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (argc < 1) {
+        gjs_throw(context, "fill() requires a value");
+        return JS_FALSE;
+    }
+
+    if (!gjs_value_to_byte(context, argv[0], &byte))
+        return JS_FALSE;
+
+    if ((argc > 1 && !JS_ValueToECMAInt32(context, argv[1], &start)) ||
+        (argc > 2 && !JS_ValueToECMAInt32(context, argv[2], &end)))
+        return JS_FALSE;
+
+    byte_array_ensure_array(priv);
+    len = priv->array->len;
+    first = resolve_index(start, len);
+    last = resolve_index(end, len);
+
+    if (last > first)
+        memset(priv->array->data + first, byte, last - first);
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(object));
+    return JS_TRUE;
+}
+
+/* concat(...): returns a new ByteArray with the contents of this one
+ * followed by each of the arguments
+ */
+static JSBool
+concat_func(JSContext *context,
+            unsigned   argc,
+            jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    JSObject *ret;
+    GByteArray *array;
+    guint8 *data;
+    gsize len;
+    unsigned i;
+
+    if (priv_from_js(context, object) == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    gjs_byte_array_peek_data(context, object, &data, &len);
+    array = gjs_g_byte_array_new(0);
+    g_byte_array_append(array, data, len);
+
+    for (i = 0; i < argc; i++) {
+        guint8 *to_free;
+
+        if (JSVAL_IS_NULL(argv[i]) || !JSVAL_IS_OBJECT(argv[i])) {
+            gjs_throw(context,
+                      "concat() expects ByteArrays, Uint8Arrays or arrays of bytes");
+            g_byte_array_unref(array);
+            return JS_FALSE;
+        }
+
+        if (!get_source_bytes(context, JSVAL_TO_OBJECT(argv[i]), "concat",
+                              &data, &len, &to_free)) {
+            g_byte_array_unref(array);
+            return JS_FALSE;
+        }
+
+        g_byte_array_append(array, data, len);
+        g_free(to_free);
+    }
+
+    ret = byte_array_new_for_array(context, array);
+    if (ret == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(ret));
+    return JS_TRUE;
+}
+
+/* readInt16LE(offset) and friends */
+static JSBool
+read_int(JSContext  *context,
+         unsigned    argc,
+         jsval      *vp,
+         const char *func_name,
+         guint       size,
+         gboolean    is_signed,
+         gboolean    big_endian)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    guint32 offset = 0;
+    guint32 v = 0;
+    guint8 *data;
+    gsize len;
+    guint i;
+
+    if (priv_from_js(context, object) == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (!gjs_parse_args(context, func_name, "|u", argc, argv,
+                        "offset", &offset))
+        return JS_FALSE;
+
+    gjs_byte_array_peek_data(context, object, &data, &len);
+
+    if (len < size || offset > len - size) {
+        gjs_throw(context,
+                  "Offset %u is out of range for reading %u bytes from ByteArray length %lu",
+                  offset, size, (unsigned long) len);
+        return JS_FALSE;
+    }
+
+    for (i = 0; i < size; i++) {
+        guint shift = big_endian ? (size - 1 - i) * 8 : i * 8;
+        v |= ((guint32) data[offset + i]) << shift;
+    }
+
+    if (is_signed) {
+        guint unused_bits = 32 - size * 8;
+        JS_SET_RVAL(context, vp,
+                    INT_TO_JSVAL(((gint32) (v << unused_bits)) >> unused_bits));
+        return JS_TRUE;
+    } else {
+        jsval retval;
+
+        if (!gjs_value_from_gsize(context, v, &retval))
+            return JS_FALSE;
+        JS_SET_RVAL(context, vp, retval);
+        return JS_TRUE;
+    }
+}
+
+/* writeInt16LE(value, offset) and friends; returns the offset just past
+ * the written bytes, growing the ByteArray if necessary
+ */
+static JSBool
+write_int(JSContext  *context,
+          unsigned    argc,
+          jsval      *vp,
+          const char *func_name,
+          guint       size,
+          gboolean    is_signed,
+          gboolean    big_endian)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    ByteArrayInstance *priv;
+    guint32 offset = 0;
+    double num, min, max;
+    guint32 v;
+    guint64 end;
+    jsval retval;
+    guint i;
+
+    priv = priv_from_js(context, object);
+    if (priv == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (!gjs_parse_args(context, func_name, "f|u", argc, argv,
+                        "value", &num, "offset", &offset))
+        return JS_FALSE;
+
+    if (is_signed) {
+        max = (double) ((G_GINT64_CONSTANT(1) << (size * 8 - 1)) - 1);
+        min = -max - 1;
+    } else {
+        max = (double) ((G_GINT64_CONSTANT(1) << (size * 8)) - 1);
+        min = 0;
+    }
+
+    if (!(num >= min && num <= max)) {
+        gjs_throw(context, "Value %g is out of range for %s()", num, func_name);
+        return JS_FALSE;
+    }
+
+    v = (guint32) (gint64) num;
+
+    byte_array_ensure_array(priv);
+    end = (guint64) offset + size;
+    if (end > priv->array->len &&
+        !byte_array_set_length(context, priv, end))
+        return JS_FALSE;
+
+    for (i = 0; i < size; i++) {
+        guint shift = big_endian ? (size - 1 - i) * 8 : i * 8;
+        priv->array->data[(gsize) offset + i] = (v >> shift) & 0xff;
+    }
+
+    if (!gjs_value_from_gsize(context, (gsize) end, &retval))
+        return JS_FALSE;
+    JS_SET_RVAL(context, vp, retval);
+    return JS_TRUE;
+}
+
+#define DEFINE_INT_ACCESSORS(name, js_suffix, size, is_signed, big_endian) \
+    static JSBool                                                       \
+    read_##name##_func(JSContext *context,                              \
+                       unsigned   argc,                                 \
+                       jsval     *vp)                                   \
+    {                                                                   \
+        return read_int(context, argc, vp, "read" js_suffix,            \
+                        size, is_signed, big_endian);                   \
+    }                                                                   \
+    static JSBool                                                       \
+    write_##name##_func(JSContext *context,                             \
+                        unsigned   argc,                                \
+                        jsval     *vp)                                  \
+    {                                                                   \
+        return write_int(context, argc, vp, "write" js_suffix,          \
+                         size, is_signed, big_endian);                  \
+    }
+
+DEFINE_INT_ACCESSORS(int8,       "Int8",     1, TRUE,  FALSE)
+DEFINE_INT_ACCESSORS(uint16_le,  "UInt16LE", 2, FALSE, FALSE)
+DEFINE_INT_ACCESSORS(uint16_be,  "UInt16BE", 2, FALSE, TRUE)
+DEFINE_INT_ACCESSORS(int16_le,   "Int16LE",  2, TRUE,  FALSE)
+DEFINE_INT_ACCESSORS(int16_be,   "Int16BE",  2, TRUE,  TRUE)
+DEFINE_INT_ACCESSORS(uint32_le,  "UInt32LE", 4, FALSE, FALSE)
+DEFINE_INT_ACCESSORS(uint32_be,  "UInt32BE", 4, FALSE, TRUE)
+DEFINE_INT_ACCESSORS(int32_le,   "Int32LE",  4, TRUE,  FALSE)
+DEFINE_INT_ACCESSORS(int32_be,   "Int32BE",  4, TRUE,  TRUE)
+
+#undef DEFINE_INT_ACCESSORS
+
+/*
+ * ByteArray.Decoder: converts a stream of chunks in some encoding to
+ * JS strings, keeping the iconv state and any incomplete multibyte
+ * sequence at the end of a chunk for the next call to decode().
+ */
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define UTF16_NATIVE "UTF-16LE"
+#else
+#define UTF16_NATIVE "UTF-16BE"
+#endif
+
+typedef struct {
+    GIConv converter;
+    /* bytes 0-127 decode to themselves */
+    guint ascii_compatible : 1;
+    /* bytes left over from the last chunk, not yet decoded */
+    GByteArray *pending;
+    /* output buffer, reused across calls */
+    GByteArray *buffer;
+} DecoderInstance;
+
+static void   byte_array_decoder_finalize (JSFreeOp *fop,
+                                           JSObject *obj);
+GJS_NATIVE_CONSTRUCTOR_DECLARE(byte_array_decoder);
+
+static struct JSClass gjs_byte_array_decoder_class = {
+    "Decoder",
+    JSCLASS_HAS_PRIVATE,
+    JS_PropertyStub,
+    JS_PropertyStub,
+    JS_PropertyStub,
+    JS_StrictPropertyStub,
+    JS_EnumerateStub,
+    JS_ResolveStub,
+    JS_ConvertStub,
+    byte_array_decoder_finalize,
+    NULL,
+    NULL,
+    NULL, NULL, NULL
+};
+
+/* GJS_DEFINE_PRIV_FROM_JS is already used for ByteArray in this file */
+static DecoderInstance *
+decoder_priv_from_js(JSContext *context,
+                     JSObject  *object)
+{
+    DecoderInstance *priv;
+    JS_BeginRequest(context);
+    priv = JS_GetInstancePrivate(context, object, &gjs_byte_array_decoder_class, NULL);
+    JS_EndRequest(context);
+    return priv;
+}
+
+static gboolean
+encoding_is_ascii_compatible(const char *encoding)
+{
+    return (g_ascii_strcasecmp(encoding, "UTF-8") == 0 ||
+            g_ascii_strcasecmp(encoding, "UTF8") == 0 ||
+            g_ascii_strcasecmp(encoding, "ASCII") == 0 ||
+            g_ascii_strcasecmp(encoding, "US-ASCII") == 0 ||
+            g_ascii_strncasecmp(encoding, "ISO-8859-", 9) == 0 ||
+            g_ascii_strncasecmp(encoding, "WINDOWS-125", 11) == 0 ||
+            g_ascii_strncasecmp(encoding, "CP125", 5) == 0);
+}
+
+GJS_NATIVE_CONSTRUCTOR_DECLARE(byte_array_decoder)
+{
+    GJS_NATIVE_CONSTRUCTOR_VARIABLES(byte_array_decoder)
+    DecoderInstance *priv;
+    char *encoding = NULL;
+    GIConv converter;
+
+    GJS_NATIVE_CONSTRUCTOR_PRELUDE(byte_array_decoder);
+
+    if (!gjs_parse_args(context, "Decoder", "|s", argc, argv,
+                        "encoding", &encoding))
+        return JS_FALSE;
+
+    if (encoding == NULL)
+        encoding = g_strdup("UTF-8");
+
+    converter = g_iconv_open(UTF16_NATIVE, encoding);
+    if (converter == (GIConv) -1) {
+        gjs_throw(context, "Conversion from character set '%s' is not supported",
+                  encoding);
+        g_free(encoding);
+        return JS_FALSE;
+    }
+
+    priv = g_slice_new0(DecoderInstance);
+    priv->converter = converter;
+    priv->ascii_compatible = encoding_is_ascii_compatible(encoding);
+    priv->pending = g_byte_array_new();
+    priv->buffer = g_byte_array_new();
+    g_free(encoding);
+
+    g_assert(decoder_priv_from_js(context, object) == NULL);
+    JS_SetPrivate(object, priv);
+
+    GJS_NATIVE_CONSTRUCTOR_FINISH(byte_array_decoder);
+
+    return JS_TRUE;
+}
+
+static void
+byte_array_decoder_finalize(JSFreeOp *fop,
+                            JSObject *obj)
+{
+    DecoderInstance *priv;
+
+    priv = JS_GetPrivate(obj);
+
+    if (priv == NULL)
+        return; /* prototype, not instance */
+
+    g_iconv_close(priv->converter);
+    g_byte_array_unref(priv->pending);
+    g_byte_array_unref(priv->buffer);
+
+    g_slice_free(DecoderInstance, priv);
+}
+
+static void
+decoder_reset(DecoderInstance *priv)
+{
+    g_iconv(priv->converter, NULL, NULL, NULL, NULL);
+    g_byte_array_set_size(priv->pending, 0);
+}
+
+/* Runs @data through iconv into priv->buffer, returning the number of
+ * bytes at the end of @data that make up an incomplete sequence, or
+ * -1 with an exception set
+ */
+static gssize
+decoder_convert(JSContext       *context,
+                DecoderInstance *priv,
+                const guint8    *data,
+                gsize            len,
+                gboolean         flush,
+                gsize           *out_len_p)
+{
+    gchar *inbuf = (gchar *) data;
+    gsize inleft = len;
+    gsize out_len = 0;
+    gboolean flushed = FALSE;
+
+    /* Every sane encoding needs at least as many bytes per character
+     * as UTF-16 needs code units, so this rarely has to grow
+     */
+    if (priv->buffer->len < (len + 4) * 2)
+        g_byte_array_set_size(priv->buffer, (len + 4) * 2);
+
+    for (;;) {
+        gchar *outbuf = (gchar *) priv->buffer->data + out_len;
+        gsize outleft = priv->buffer->len - out_len;
+        gsize result;
+
+        /* Once all the input is converted, a final chunk also resets
+         * the shift state of stateful encodings, which may write some
+         * more output */
+        if (inleft > 0) {
+            result = g_iconv(priv->converter, &inbuf, &inleft, &outbuf, &outleft);
+        } else if (flush && !flushed) {
+            result = g_iconv(priv->converter, NULL, NULL, &outbuf, &outleft);
+            flushed = result != (gsize) -1;
+        } else {
+            break;
+        }
+
+        out_len = priv->buffer->len - outleft;
+
+        if (result != (gsize) -1)
+            continue;
+
+        if (errno == E2BIG) {
+            g_byte_array_set_size(priv->buffer, priv->buffer->len * 2);
+        } else if (errno == EINVAL) {
+            /* incomplete sequence at the end of the input */
+            break;
+        } else {
+            gjs_throw(context, "Invalid byte sequence in conversion input");
+            return -1;
+        }
+    }
+
+    *out_len_p = out_len;
+    return inleft;
+}
+
+/* decode(chunk, { stream: true }) */
+static JSBool
+decode_func(JSContext *context,
+            unsigned   argc,
+            jsval     *vp)
+{
+    jsval *argv = JS_ARGV(context, vp);
+    JSObject *object = JS_THIS_OBJECT(context, vp);
+    DecoderInstance *priv;
+    gboolean stream = FALSE;
+    guint8 *data = NULL, *to_free = NULL;
+    gsize len = 0, out_len;
+    gssize incomplete;
+    JSString *s;
+
+    priv = decoder_priv_from_js(context, object);
+    if (priv == NULL)
+        return JS_TRUE; /* prototype, not instance */
+
+    if (argc > 0 && !JSVAL_IS_VOID(argv[0])) {
+        if (JSVAL_IS_NULL(argv[0]) || !JSVAL_IS_OBJECT(argv[0])) {
+            gjs_throw(context, "decode() expects a ByteArray, Uint8Array or array of bytes");
+            return JS_FALSE;
+        }
+        if (!get_source_bytes(context, JSVAL_TO_OBJECT(argv[0]), "decode",
+                              &data, &len, &to_free))
+            return JS_FALSE;
+    }
+
+    if (argc > 1 && !JSVAL_IS_NULL(argv[1]) && JSVAL_IS_OBJECT(argv[1])) {
+        jsval stream_val;
+        JSBool b;
+
+        if (!JS_GetProperty(context, JSVAL_TO_OBJECT(argv[1]), "stream", &stream_val) ||
+            !JS_ValueToBoolean(context, stream_val, &b)) {
+            g_free(to_free);
+            return JS_FALSE;
+        }
+        stream = b;
+    }
+
+    /* Fast path: nothing left over from the last chunk, and the whole
+     * chunk is ASCII. An ASCII compatible decoder has no shift state
+     * to flush either.
+     */
+    if (priv->pending->len == 0 && priv->ascii_compatible &&
+        ascii_prefix_length(data, len) == len) {
+        s = string_from_latin1(context, data, len);
+        g_free(to_free);
+        if (s == NULL)
+            return JS_FALSE;
+        JS_SET_RVAL(context, vp, STRING_TO_JSVAL(s));
+        return JS_TRUE;
+    }
+
+    if (priv->pending->len > 0) {
+        g_byte_array_append(priv->pending, data, len);
+        g_free(to_free);
+        to_free = NULL;
+        data = priv->pending->data;
+        len = priv->pending->len;
+    }
+
+    incomplete = decoder_convert(context, priv, data, len, !stream, &out_len);
+    if (incomplete < 0) {
+        decoder_reset(priv);
+        g_free(to_free);
+        return JS_FALSE;
+    }
+
+    if (incomplete > 0 && !stream) {
+        decoder_reset(priv);
+        g_free(to_free);
+        gjs_throw(context, "Incomplete multibyte sequence at end of input");
+        return JS_FALSE;
+    }
+
+    /* Keep the incomplete sequence for the next chunk */
+    if (data == priv->pending->data) {
+        g_byte_array_remove_range(priv->pending, 0, len - incomplete);
+    } else {
+        g_byte_array_append(priv->pending, data + len - incomplete, incomplete);
+    }
+    g_free(to_free);
+
+    g_assert((out_len % 2) == 0);
+    s = JS_NewUCStringCopyN(context, (jschar *) priv->buffer->data, out_len / 2);
+    if (s == NULL)
+        return JS_FALSE;
+
+    JS_SET_RVAL(context, vp, STRING_TO_JSVAL(s));
+    return JS_TRUE;
+}
+
+static JSFunctionSpec gjs_byte_array_decoder_proto_funcs[] = {
+    { "decode", JSOP_WRAPPER ((JSNative) decode_func), 2, 0 },
+    { NULL }
+};
+
 /* no idea what this is used for. examples in
  * spidermonkey use -1, -2, -3, etc. for tinyids.
  */
@@ -899,6 +1885,25 @@ static JSPropertySpec gjs_byte_array_proto_props[] = {
 static JSFunctionSpec gjs_byte_array_proto_funcs[] = {
     { "toString", JSOP_WRAPPER ((JSNative) to_string_func), 0, 0 },
     { "toGBytes", JSOP_WRAPPER ((JSNative) to_gbytes_func), 0, 0 },
+    { "slice", JSOP_WRAPPER ((JSNative) slice_func), 2, 0 },
+    { "subarray", JSOP_WRAPPER ((JSNative) subarray_func), 2, 0 },
+    { "set", JSOP_WRAPPER ((JSNative) set_func), 2, 0 },
+    { "indexOf", JSOP_WRAPPER ((JSNative) index_of_func), 2, 0 },
+    { "fill", JSOP_WRAPPER ((JSNative) fill_func), 3, 0 },
+    { "concat", JSOP_WRAPPER ((JSNative) concat_func), 1, 0 },
+#define INT_ACCESSOR_SPECS(name, js_suffix)                                     \
+    { "read" js_suffix, JSOP_WRAPPER ((JSNative) read_##name##_func), 1, 0 },   \
+    { "write" js_suffix, JSOP_WRAPPER ((JSNative) write_##name##_func), 2, 0 },
+    INT_ACCESSOR_SPECS(int8, "Int8")
+    INT_ACCESSOR_SPECS(uint16_le, "UInt16LE")
+    INT_ACCESSOR_SPECS(uint16_be, "UInt16BE")
+    INT_ACCESSOR_SPECS(int16_le, "Int16LE")
+    INT_ACCESSOR_SPECS(int16_be, "Int16BE")
+    INT_ACCESSOR_SPECS(uint32_le, "UInt32LE")
+    INT_ACCESSOR_SPECS(uint32_be, "UInt32BE")
+    INT_ACCESSOR_SPECS(int32_le, "Int32LE")
+    INT_ACCESSOR_SPECS(int32_be, "Int32BE")
+#undef INT_ACCESSOR_SPECS
     { NULL }
 };
 
@@ -926,6 +1931,17 @@ gjs_define_byte_array_stuff(JSContext      *context,
     if (gjs_byte_array_prototype == NULL)
         return JS_FALSE;
 
+    if (!JS_InitClass(context, in_object,
+                      NULL,
+                      &gjs_byte_array_decoder_class,
+                      gjs_byte_array_decoder_constructor,
+                      0,
+                      NULL,
+                      &gjs_byte_array_decoder_proto_funcs[0],
+                      NULL,
+                      NULL))
+        return JS_FALSE;
+
     if (!JS_DefineFunctions(context, in_object, &gjs_byte_array_module_funcs[0]))
         return JS_FALSE;
 
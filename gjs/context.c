@@ -27,10 +27,12 @@
 #include "importer.h"
 #include "jsapi-util.h"
 #include "profiler.h"
+#include "gc-scheduler.h"
 #include "native.h"
 #include "byteArray.h"
 #include "compat.h"
 #include "runtime.h"
+#include "script-cache.h"
 
 #include "gi.h"
 #include "gi/object.h"
@@ -69,6 +71,7 @@ struct _GjsContext {
     JSObject *global;
 
     GjsProfiler *profiler;
+    GjsGcScheduler *gc_scheduler;
 
     char *jsversion_string;
     char *program_name;
@@ -373,6 +376,11 @@ gjs_context_dispose(GObject *object)
         js_context->profiler = NULL;
     }
 
+    if (js_context->gc_scheduler) {
+        gjs_gc_scheduler_free(js_context->gc_scheduler);
+        js_context->gc_scheduler = NULL;
+    }
+
     if (js_context->global != NULL) {
         js_context->global = NULL;
     }
@@ -571,6 +579,7 @@ gjs_context_constructor (GType                  type,
     if (js_context->runtime == NULL)
         g_error("Failed to create javascript runtime");
     JS_SetGCParameter(js_context->runtime, JSGC_MAX_BYTES, 0xffffffff);
+    js_context->gc_scheduler = gjs_gc_scheduler_new(js_context->runtime);
 
     js_context->context = JS_NewContext(js_context->runtime, 8192 /* stack chunk size */);
     if (js_context->context == NULL)
@@ -862,9 +871,11 @@ gjs_context_new_with_search_path(char** search_path)
  *
  * This function always unconditionally invokes JS_MaybeGC(), but
  * additionally looks at memory usage from the system malloc()
- * when available, and if the delta has grown since the last run
- * significantly, also initiates a full JavaScript garbage
- * collection.  The idea is that since GJS is a bridge between
+ * when available, and at how fast the JavaScript heap grows, and
+ * if either has grown significantly since the last run, also starts
+ * a garbage collection. The collection runs incrementally from the
+ * main loop unless GJS_DISABLE_INCREMENTAL_GC is set, in which case
+ * it's a full collection that blocks. The idea is that since GJS is a bridge between
  * JavaScript and system libraries, and JS objects act as proxies
  * for these system memory objects, GJS consumers need a way to
  * hint to the runtime that it may be a good idea to try a
@@ -913,12 +924,10 @@ gjs_on_context_gc (JSRuntime *rt,
     JSContext *context = gjs_runtime_get_context(rt);
     GjsContext *gjs_context = JS_GetContextPrivate(context);
 
+    /* Toggle refs are blocked around each slice rather than for the
+     * whole collection, see gc-scheduler.c */
     switch (status) {
-        case JSGC_BEGIN:
-            gjs_enter_gc();
-            break;
         case JSGC_END:
-            gjs_leave_gc();
             if (gjs_context->gc_notifications_enabled) {
                 g_mutex_lock(&gc_idle_lock);
                 if (gjs_context->idle_emit_gc_id == 0)
@@ -1076,19 +1085,25 @@ gjs_context_eval_file(GjsContext  *js_context,
                       int           *exit_status_p,
                       GError       **error)
 {
-    char *script;
+    GBytes *script;
+    const char *script_data;
     gsize script_len;
+    gboolean ret;
 
-    if (!g_file_get_contents(filename, &script, &script_len, error))
+    /* Mapped, not copied; see gjs_script_source_load() */
+    script = gjs_script_source_load(filename, error);
+    if (script == NULL)
         return FALSE;
 
-    if (!gjs_context_eval(js_context, script, script_len, filename, exit_status_p, error)) {
-        g_free(script);
-        return FALSE;
-    }
+    script_data = g_bytes_get_data(script, &script_len);
+    if (script_data == NULL)
+        script_data = "";
 
-    g_free(script);
-    return TRUE;
+    ret = gjs_context_eval(js_context, script_data, script_len, filename,
+                           exit_status_p, error);
+
+    g_bytes_unref(script);
+    return ret;
 }
 
 gboolean
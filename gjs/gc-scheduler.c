@@ -0,0 +1,447 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  The GJS authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Decides when to collect garbage, so that applications such as
+ * compositors don't get long pauses at random times.
+ *
+ * Collections are incremental: once one is started, it proceeds in
+ * slices of a bounded length (GJS_GC_SLICE_BUDGET milliseconds, 5 by
+ * default) run from a low priority idle, so that anything else that
+ * the main loop has to do gets in between. A collection is started by
+ * gjs_gc_scheduler_maybe_collect() when the process RSS grew by 25%, or
+ * when the JS heap grew a lot or quickly since the last collection.
+ * Slices are held back while the application says that it's painting.
+ *
+ * Set GJS_DISABLE_INCREMENTAL_GC to go back to blocking collections.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gc-scheduler.h"
+#include "compat.h"
+
+#include <util/log.h>
+
+#define DEFAULT_SLICE_BUDGET_MS 5
+
+/* Collection resumes after this long even if the end of a paint is
+ * never signalled */
+#define MAX_PAINT_DEFER_MS 100
+
+/* Start a collection once the JS heap has grown by half since the last
+ * one, but by at least this much... */
+#define MIN_HEAP_GROWTH_TRIGGER (8 * 1024 * 1024)
+/* ...or when it's growing faster than this many bytes per second,
+ * measured over at least ALLOC_RATE_MIN_INTERVAL_US */
+#define ALLOC_RATE_TRIGGER (32 * 1024 * 1024)
+#define ALLOC_RATE_MIN_INTERVAL_US (100 * 1000)
+
+struct _GjsGcScheduler {
+    JSRuntime *runtime;
+
+    gboolean incremental;
+    guint    slice_budget_ms;
+
+    gboolean collection_pending;
+    guint    slice_idle_id;
+    guint    paint_timeout_id; /* non-zero while painting */
+
+    gulong   rss_trigger;
+    guint32  heap_bytes_after_gc;
+    guint32  last_heap_bytes;
+    gint64   last_heap_sample_time;
+
+    gint64     slice_start_time;
+    GjsGcStats stats;
+};
+
+/* All schedulers, so that the slice callback can find the one of its
+ * runtime; there is normally only one */
+static GSList *schedulers;
+
+#ifdef __linux__
+static void
+_linux_get_self_process_size (gulong *vm_size,
+                              gulong *rss_size)
+{
+    char *contents;
+    char *iter;
+    gsize len;
+    int i;
+
+    *vm_size = *rss_size = 0;
+
+    if (!g_file_get_contents ("/proc/self/stat", &contents, &len, NULL))
+        return;
+
+    iter = contents;
+    /* See "man proc" for where this 22 comes from */
+    for (i = 0; i < 22; i++) {
+        iter = strchr (iter, ' ');
+        if (!iter)
+            goto out;
+        iter++;
+    }
+    sscanf (iter, " %lu", vm_size);
+    iter = strchr (iter, ' ');
+    if (iter)
+        sscanf (iter, " %lu", rss_size);
+
+ out:
+    g_free (contents);
+}
+#endif
+
+static guint
+pause_bucket(gint64 pause_us)
+{
+    gint64 limit = 1000;
+    guint bucket = 0;
+
+    while (bucket < GJS_GC_PAUSE_BUCKETS - 1 && pause_us >= limit) {
+        bucket++;
+        limit *= 2;
+    }
+
+    return bucket;
+}
+
+static gboolean run_slice_idle(gpointer data);
+
+static void
+schedule_slices(GjsGcScheduler *self)
+{
+    if (self->slice_idle_id != 0 || self->paint_timeout_id != 0)
+        return;
+
+    self->slice_idle_id = g_idle_add_full(G_PRIORITY_LOW,
+                                          run_slice_idle, self, NULL);
+}
+
+static void
+unschedule_slices(GjsGcScheduler *self)
+{
+    if (self->slice_idle_id != 0) {
+        g_source_remove(self->slice_idle_id);
+        self->slice_idle_id = 0;
+    }
+}
+
+/* Returns %TRUE if the collection isn't finished yet */
+static gboolean
+run_slice(GjsGcScheduler *self)
+{
+    gjs_gc_incremental_slice(self->runtime, self->slice_budget_ms);
+
+    /* collection_pending is cleared by the slice callback when the
+     * cycle ends */
+    return self->collection_pending;
+}
+
+static gboolean
+run_slice_idle(gpointer data)
+{
+    GjsGcScheduler *self = data;
+
+    if (self->collection_pending && run_slice(self))
+        return TRUE;
+
+    self->slice_idle_id = 0;
+    return FALSE;
+}
+
+static gboolean
+paint_timeout(gpointer data)
+{
+    GjsGcScheduler *self = data;
+
+    gjs_debug(GJS_DEBUG_CONTEXT, "No end of paint after %d ms, resuming GC",
+              MAX_PAINT_DEFER_MS);
+
+    self->paint_timeout_id = 0;
+    if (self->collection_pending)
+        schedule_slices(self);
+
+    return FALSE;
+}
+
+static void
+start_collection(GjsGcScheduler *self,
+                 const char     *reason)
+{
+    gjs_debug(GJS_DEBUG_CONTEXT, "Starting GC: %s", reason);
+
+    if (!self->incremental) {
+        JS_GC(self->runtime);
+        return;
+    }
+
+    self->collection_pending = TRUE;
+    schedule_slices(self);
+}
+
+static void
+on_gc_slice(JSRuntime     *runtime,
+            GjsGcProgress  progress)
+{
+    GjsGcScheduler *self;
+    gint64 pause_us;
+
+    self = gjs_gc_scheduler_get(runtime);
+
+    switch (progress) {
+    case GJS_GC_CYCLE_BEGIN:
+    case GJS_GC_SLICE_BEGIN:
+        /* JS code runs between slices, so the GC is only "running"
+         * for toggle refs during a slice */
+        gjs_enter_gc();
+        if (self != NULL)
+            self->slice_start_time = g_get_monotonic_time();
+        break;
+
+    case GJS_GC_SLICE_END:
+    case GJS_GC_CYCLE_END:
+        if (self != NULL) {
+            pause_us = g_get_monotonic_time() - self->slice_start_time;
+
+            self->stats.n_slices++;
+            self->stats.total_pause_us += pause_us;
+            self->stats.max_pause_us = MAX(self->stats.max_pause_us, pause_us);
+            self->stats.pause_histogram[pause_bucket(pause_us)]++;
+
+            if (progress == GJS_GC_CYCLE_END) {
+                self->stats.n_cycles++;
+                self->collection_pending = FALSE;
+                self->heap_bytes_after_gc = JS_GetGCParameter(runtime, JSGC_BYTES);
+                self->last_heap_bytes = self->heap_bytes_after_gc;
+                self->last_heap_sample_time = g_get_monotonic_time();
+            } else if (!self->collection_pending) {
+                /* The engine started this collection by itself, we
+                 * have to make sure that it's finished */
+                self->collection_pending = TRUE;
+                schedule_slices(self);
+            }
+        }
+        gjs_leave_gc();
+        break;
+
+    default:
+        g_assert_not_reached();
+    }
+}
+
+GjsGcScheduler *
+gjs_gc_scheduler_new(JSRuntime *runtime)
+{
+    GjsGcScheduler *self;
+    const char *budget;
+
+    self = g_slice_new0(GjsGcScheduler);
+    self->runtime = runtime;
+    self->incremental = g_getenv("GJS_DISABLE_INCREMENTAL_GC") == NULL;
+
+    self->slice_budget_ms = DEFAULT_SLICE_BUDGET_MS;
+    budget = g_getenv("GJS_GC_SLICE_BUDGET");
+    if (budget != NULL) {
+        guint64 value = g_ascii_strtoull(budget, NULL, 10);
+        if (value > 0 && value <= G_MAXUINT)
+            self->slice_budget_ms = value;
+    }
+
+    /* The budget also applies to slices that the engine runs by itself */
+    JS_SetGCParameter(runtime, JSGC_MODE,
+                      self->incremental ? JSGC_MODE_INCREMENTAL : JSGC_MODE_GLOBAL);
+    JS_SetGCParameter(runtime, JSGC_SLICE_TIME_BUDGET, self->slice_budget_ms);
+
+    gjs_gc_set_slice_callback(runtime, on_gc_slice);
+
+    schedulers = g_slist_prepend(schedulers, self);
+
+    return self;
+}
+
+void
+gjs_gc_scheduler_free(GjsGcScheduler *self)
+{
+    unschedule_slices(self);
+
+    if (self->paint_timeout_id != 0)
+        g_source_remove(self->paint_timeout_id);
+
+    gjs_debug(GJS_DEBUG_CONTEXT,
+              "GC: %" G_GUINT64_FORMAT " collections in %" G_GUINT64_FORMAT
+              " slices, longest pause %" G_GINT64_FORMAT " us",
+              self->stats.n_cycles, self->stats.n_slices,
+              self->stats.max_pause_us);
+
+    schedulers = g_slist_remove(schedulers, self);
+    g_slice_free(GjsGcScheduler, self);
+}
+
+GjsGcScheduler *
+gjs_gc_scheduler_get(JSRuntime *runtime)
+{
+    GSList *l;
+
+    for (l = schedulers; l != NULL; l = l->next) {
+        GjsGcScheduler *self = l->data;
+
+        if (self->runtime == runtime)
+            return self;
+    }
+
+    return NULL;
+}
+
+static const char *
+collection_trigger(GjsGcScheduler *self)
+{
+    const char *reason = NULL;
+    guint32 heap_bytes;
+    gint64 now;
+
+#ifdef __linux__
+    {
+        gulong vmsize;
+        gulong rss_size;
+
+        _linux_get_self_process_size (&vmsize, &rss_size);
+
+        /* rss_trigger is initialized to 0, so we always collect
+         * early once.
+         *
+         * In theory using RSS is bad if we get swapped out, since we
+         * may be overzealous in GC, but on the other hand, if swapping
+         * is going on, better to GC.
+         */
+        if (rss_size > self->rss_trigger) {
+            self->rss_trigger = (gulong) MIN(G_MAXULONG, rss_size * 1.25);
+            reason = "RSS grew by 25%";
+        } else if (rss_size < (0.75 * self->rss_trigger)) {
+            /* If we've shrunk by 75%, lower the trigger */
+            self->rss_trigger = (rss_size * 1.25);
+        }
+    }
+#endif
+
+    heap_bytes = JS_GetGCParameter(self->runtime, JSGC_BYTES);
+    now = g_get_monotonic_time();
+
+    if (reason == NULL &&
+        heap_bytes > self->heap_bytes_after_gc +
+                     MAX(MIN_HEAP_GROWTH_TRIGGER, self->heap_bytes_after_gc / 2))
+        reason = "JS heap grew";
+
+    if (now - self->last_heap_sample_time >= ALLOC_RATE_MIN_INTERVAL_US) {
+        if (reason == NULL && self->last_heap_sample_time != 0 &&
+            heap_bytes > self->last_heap_bytes) {
+            gint64 rate;
+
+            rate = (gint64) (heap_bytes - self->last_heap_bytes) * G_USEC_PER_SEC /
+                (now - self->last_heap_sample_time);
+            if (rate >= ALLOC_RATE_TRIGGER)
+                reason = "high allocation rate";
+        }
+
+        self->last_heap_bytes = heap_bytes;
+        self->last_heap_sample_time = now;
+    }
+
+    return reason;
+}
+
+/**
+ * gjs_gc_scheduler_maybe_collect:
+ * @self: a #GjsGcScheduler
+ *
+ * Starts a collection if memory usage grew enough since the last one.
+ * Unless incremental GC is disabled, this only schedules the first
+ * slice.
+ */
+void
+gjs_gc_scheduler_maybe_collect(GjsGcScheduler *self)
+{
+    const char *reason;
+
+    reason = collection_trigger(self);
+
+    if (reason != NULL && !self->collection_pending)
+        start_collection(self, reason);
+}
+
+/**
+ * gjs_gc_scheduler_hint:
+ * @self: a #GjsGcScheduler
+ * @hint: what the application is about to do
+ *
+ * %GJS_GC_HINT_PAINT_BEGIN holds back GC slices until
+ * %GJS_GC_HINT_PAINT_END, or at most for %MAX_PAINT_DEFER_MS. The
+ * engine may still collect by itself if it runs out of memory.
+ * %GJS_GC_HINT_IDLE says that now is a good time: it may start a
+ * collection, and runs a slice right away if one is in progress.
+ */
+void
+gjs_gc_scheduler_hint(GjsGcScheduler *self,
+                      GjsGcHint       hint)
+{
+    switch (hint) {
+    case GJS_GC_HINT_PAINT_BEGIN:
+        unschedule_slices(self);
+        if (self->paint_timeout_id != 0)
+            g_source_remove(self->paint_timeout_id);
+        self->paint_timeout_id = g_timeout_add(MAX_PAINT_DEFER_MS,
+                                               paint_timeout, self);
+        break;
+
+    case GJS_GC_HINT_PAINT_END:
+        if (self->paint_timeout_id != 0) {
+            g_source_remove(self->paint_timeout_id);
+            self->paint_timeout_id = 0;
+        }
+        if (self->collection_pending)
+            schedule_slices(self);
+        break;
+
+    case GJS_GC_HINT_IDLE:
+        if (self->paint_timeout_id != 0)
+            break;
+
+        gjs_gc_scheduler_maybe_collect(self);
+        if (self->collection_pending && !run_slice(self))
+            unschedule_slices(self);
+        break;
+
+    default:
+        g_assert_not_reached();
+    }
+}
+
+void
+gjs_gc_scheduler_get_stats(GjsGcScheduler *self,
+                           GjsGcStats     *stats)
+{
+    *stats = self->stats;
+}
@@ -0,0 +1,64 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  The GJS authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GJS_GC_SCHEDULER_H__
+#define __GJS_GC_SCHEDULER_H__
+
+#include <glib.h>
+#include "gjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Pause bucket i counts slices shorter than 2^i ms; the last bucket
+ * counts everything longer */
+#define GJS_GC_PAUSE_BUCKETS 12
+
+typedef struct _GjsGcScheduler GjsGcScheduler;
+
+typedef enum {
+    GJS_GC_HINT_PAINT_BEGIN,
+    GJS_GC_HINT_PAINT_END,
+    GJS_GC_HINT_IDLE
+} GjsGcHint;
+
+typedef struct {
+    guint64 n_cycles;
+    guint64 n_slices;
+    gint64  total_pause_us;
+    gint64  max_pause_us;
+    guint64 pause_histogram[GJS_GC_PAUSE_BUCKETS];
+} GjsGcStats;
+
+GjsGcScheduler *gjs_gc_scheduler_new           (JSRuntime      *runtime);
+void            gjs_gc_scheduler_free          (GjsGcScheduler *self);
+GjsGcScheduler *gjs_gc_scheduler_get           (JSRuntime      *runtime);
+
+void            gjs_gc_scheduler_maybe_collect (GjsGcScheduler *self);
+void            gjs_gc_scheduler_hint          (GjsGcScheduler *self,
+                                                GjsGcHint       hint);
+void            gjs_gc_scheduler_get_stats     (GjsGcScheduler *self,
+                                                GjsGcStats     *stats);
+
+G_END_DECLS
+
+#endif /* __GJS_GC_SCHEDULER_H__ */
@@ -30,10 +30,13 @@
 #include <gjs/importer.h>
 #include <gjs/compat.h>
 #include <gjs/runtime.h>
+#include <gjs/script-cache.h>
 
+#include <gio/gio.h>
 #include <string.h>
 
 #define MODULE_INIT_FILENAME "__init__.js"
+#define RESOURCE_PREFIX "resource://"
 
 static char **gjs_search_path = NULL;
 
@@ -50,6 +53,50 @@ static struct JSClass gjs_importer_class;
 
 GJS_DEFINE_PRIV_FROM_JS(Importer, gjs_importer_class)
 
+/* Search path entries can be directories in the file system, or
+ * resource:// URIs pointing into a registered GResource.
+ */
+static const char *
+resource_path(const char *path)
+{
+    if (g_str_has_prefix(path, RESOURCE_PREFIX))
+        return path + strlen(RESOURCE_PREFIX);
+    return NULL;
+}
+
+static gboolean
+path_is_directory(const char *path)
+{
+    const char *resource = resource_path(path);
+
+    if (resource != NULL) {
+        char **children;
+
+        children = g_resources_enumerate_children(resource,
+                                                  G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                                  NULL);
+        if (children == NULL)
+            return FALSE;
+        g_strfreev(children);
+        return TRUE;
+    }
+
+    return g_file_test(path, G_FILE_TEST_IS_DIR);
+}
+
+static gboolean
+path_exists(const char *path)
+{
+    const char *resource = resource_path(path);
+
+    if (resource != NULL)
+        return g_resources_get_info(resource, G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                    NULL, NULL, NULL) ||
+            path_is_directory(path);
+
+    return g_file_test(path, G_FILE_TEST_EXISTS);
+}
+
 static JSBool
 define_meta_properties(JSContext  *context,
                        JSObject   *module_obj,
@@ -277,8 +324,7 @@ load_module_init(JSContext  *context,
                  JSObject   *in_object,
                  const char *full_path)
 {
-    char *script;
-    gsize script_len;
+    JSScript *script;
     jsval script_retval;
     JSObject *module_obj;
     GError *error;
@@ -316,10 +362,12 @@ load_module_init(JSContext  *context,
                           NULL, NULL,
                           GJS_MODULE_PROP_FLAGS & ~JSPROP_PERMANENT);
 
-    script_len = 0;
     error = NULL;
 
-    if (!g_file_get_contents(full_path, &script, &script_len, &error)) {
+    gjs_debug(GJS_DEBUG_IMPORTER, "Importing %s", full_path);
+
+    script = gjs_script_cache_compile_file(context, module_obj, full_path, &error);
+    if (script == NULL && error != NULL) {
         if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_ISDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
@@ -330,19 +378,11 @@ load_module_init(JSContext  *context,
         return NULL;
     }
 
-    g_assert(script != NULL);
-
-    gjs_debug(GJS_DEBUG_IMPORTER, "Importing %s", full_path);
-
-    if (!JS_EvaluateScript(context,
-                           module_obj,
-                           script,
-                           script_len,
-                           full_path,
-                           1, /* line number */
-                           &script_retval)) {
-        g_free(script);
-
+    if (script == NULL ||
+        !JS_ExecuteScript(context,
+                          module_obj,
+                          script,
+                          &script_retval)) {
         /* If JSOPTION_DONT_REPORT_UNCAUGHT is set then the exception
          * would be left set after the evaluate and not go to the error
          * reporter function.
@@ -353,17 +393,49 @@ load_module_init(JSContext  *context,
             gjs_log_and_keep_exception(context);
         } else {
             gjs_throw(context,
-                      "JS_EvaluateScript() returned FALSE but did not set exception");
+                      "JS_ExecuteScript() returned FALSE but did not set exception");
         }
 
         return NULL;
     }
 
-    g_free(script);
-
     return module_obj;
 }
 
+/* Like the g_dir_open() loop in importer_new_enumerate(), for a
+ * directory inside a GResource
+ */
+static void
+add_resource_elements(ImporterIterator *iter,
+                      const char       *dirname)
+{
+    char **children;
+    int i;
+
+    children = g_resources_enumerate_children(resource_path(dirname),
+                                              G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                              NULL);
+    if (children == NULL)
+        return;
+
+    for (i = 0; children[i] != NULL; i++) {
+        const char *filename = children[i];
+        gsize len = strlen(filename);
+
+        /* skip hidden files and directories, and the module init file */
+        if (filename[0] == '.' || strcmp(filename, MODULE_INIT_FILENAME) == 0)
+            continue;
+
+        /* subdirectories are listed with a trailing slash */
+        if (g_str_has_suffix(filename, "/"))
+            g_ptr_array_add(iter->elements, g_strndup(filename, len - 1));
+        else if (g_str_has_suffix(filename, ".js"))
+            g_ptr_array_add(iter->elements, g_strndup(filename, len - 3));
+    }
+
+    g_strfreev(children);
+}
+
 static void
 load_module_elements(JSContext *context,
                      JSObject *in_object,
@@ -410,8 +482,7 @@ import_file(JSContext  *context,
             const char *name,
             const char *full_path)
 {
-    char *script;
-    gsize script_len;
+    JSScript *script;
     JSObject *module_obj;
     GError *error;
     jsval script_retval;
@@ -431,10 +502,10 @@ import_file(JSContext  *context,
     if (!define_meta_properties(context, module_obj, full_path, name, obj))
         goto out;
 
-    script_len = 0;
     error = NULL;
 
-    if (!(g_file_get_contents(full_path, &script, &script_len, &error))) {
+    script = gjs_script_cache_compile_file(context, module_obj, full_path, &error);
+    if (script == NULL && error != NULL) {
         if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_ISDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOTDIR) &&
             !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
@@ -445,17 +516,11 @@ import_file(JSContext  *context,
         goto out;
     }
 
-    g_assert(script != NULL);
-
-    if (!JS_EvaluateScript(context,
-                           module_obj,
-                           script,
-                           script_len,
-                           full_path,
-                           1, /* line number */
-                           &script_retval)) {
-        g_free(script);
-
+    if (script == NULL ||
+        !JS_ExecuteScript(context,
+                          module_obj,
+                          script,
+                          &script_retval)) {
         /* If JSOPTION_DONT_REPORT_UNCAUGHT is set then the exception
          * would be left set after the evaluate and not go to the error
          * reporter function.
@@ -467,14 +532,12 @@ import_file(JSContext  *context,
             gjs_log_and_keep_exception(context);
         } else {
             gjs_throw(context,
-                         "JS_EvaluateScript() returned FALSE but did not set exception");
+                         "JS_ExecuteScript() returned FALSE but did not set exception");
         }
 
         goto out;
     }
 
-    g_free(script);
-
     if (!finish_import(context, name))
         goto out;
 
@@ -607,7 +670,7 @@ do_import(JSContext  *context,
         full_path = g_build_filename(dirname, name,
                                      NULL);
 
-        if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+        if (path_is_directory(full_path)) {
             gjs_debug(GJS_DEBUG_IMPORTER,
                       "Adding directory '%s' to child importer '%s'",
                       full_path, name);
@@ -634,7 +697,7 @@ do_import(JSContext  *context,
         full_path = g_build_filename(dirname, filename,
                                      NULL);
 
-        if (g_file_test(full_path, G_FILE_TEST_EXISTS)) {
+        if (path_exists(full_path)) {
             if (import_file(context, obj, name, full_path)) {
                 gjs_debug(GJS_DEBUG_IMPORTER,
                           "successfully imported module '%s'", name);
@@ -820,6 +883,12 @@ importer_new_enumerate(JSContext  *context,
 
             g_free(init_path);
 
+            if (resource_path(dirname) != NULL) {
+                add_resource_elements(iter, dirname);
+                g_free(dirname);
+                continue;
+            }
+
             dir = g_dir_open(dirname, 0, NULL);
 
             if (!dir) {
@@ -75,3 +75,359 @@ gjs_error_reporter(JSContext     *context,
 
     g_log(G_LOG_DOMAIN, level, "JS %s: [%s %d]: %s", warning, report->filename, report->lineno, message);
 }
+
+static gsize
+typed_array_element_size(GjsTypedArrayType type)
+{
+    switch (type) {
+    case GJS_TYPED_ARRAY_INT8:
+    case GJS_TYPED_ARRAY_UINT8:
+    case GJS_TYPED_ARRAY_UINT8_CLAMPED:
+        return 1;
+    case GJS_TYPED_ARRAY_INT16:
+    case GJS_TYPED_ARRAY_UINT16:
+        return 2;
+    case GJS_TYPED_ARRAY_INT32:
+    case GJS_TYPED_ARRAY_UINT32:
+    case GJS_TYPED_ARRAY_FLOAT32:
+        return 4;
+    case GJS_TYPED_ARRAY_FLOAT64:
+        return 8;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/**
+ * gjs_typed_array_peek_data:
+ * @context: a #JSContext
+ * @obj: any JS object
+ * @type_p: (out): element type of the typed array
+ * @data_p: (out): pointer to the first element, owned by @obj
+ * @length_p: (out): number of elements
+ *
+ * If @obj is a typed array (Uint8Array, Float64Array, etc.), returns
+ * %TRUE and gives direct access to its elements. The data pointer is
+ * only valid until the next GC or script execution.
+ */
+gboolean
+gjs_typed_array_peek_data(JSContext          *context,
+                          JSObject           *obj,
+                          GjsTypedArrayType  *type_p,
+                          void              **data_p,
+                          guint32            *length_p)
+{
+    if (!JS_IsTypedArrayObject(obj, context))
+        return FALSE;
+
+    switch (JS_GetTypedArrayType(obj, context)) {
+    case js::ArrayBufferView::TYPE_INT8:
+        *type_p = GJS_TYPED_ARRAY_INT8;
+        break;
+    case js::ArrayBufferView::TYPE_UINT8:
+        *type_p = GJS_TYPED_ARRAY_UINT8;
+        break;
+    case js::ArrayBufferView::TYPE_UINT8_CLAMPED:
+        *type_p = GJS_TYPED_ARRAY_UINT8_CLAMPED;
+        break;
+    case js::ArrayBufferView::TYPE_INT16:
+        *type_p = GJS_TYPED_ARRAY_INT16;
+        break;
+    case js::ArrayBufferView::TYPE_UINT16:
+        *type_p = GJS_TYPED_ARRAY_UINT16;
+        break;
+    case js::ArrayBufferView::TYPE_INT32:
+        *type_p = GJS_TYPED_ARRAY_INT32;
+        break;
+    case js::ArrayBufferView::TYPE_UINT32:
+        *type_p = GJS_TYPED_ARRAY_UINT32;
+        break;
+    case js::ArrayBufferView::TYPE_FLOAT32:
+        *type_p = GJS_TYPED_ARRAY_FLOAT32;
+        break;
+    case js::ArrayBufferView::TYPE_FLOAT64:
+        *type_p = GJS_TYPED_ARRAY_FLOAT64;
+        break;
+    default:
+        return FALSE;
+    }
+
+    *data_p = JS_GetArrayBufferViewData(obj, context);
+    *length_p = JS_GetTypedArrayLength(obj, context);
+
+    return TRUE;
+}
+
+/**
+ * gjs_typed_array_new:
+ * @context: a #JSContext
+ * @type: element type of the new array
+ * @data: @length elements to copy into the new array
+ * @length: number of elements
+ *
+ * Returns: a new typed array holding a copy of @data, or %NULL on
+ * failure with an exception pending
+ */
+JSObject*
+gjs_typed_array_new(JSContext         *context,
+                    GjsTypedArrayType  type,
+                    const void        *data,
+                    guint32            length)
+{
+    JSObject *obj;
+
+    switch (type) {
+    case GJS_TYPED_ARRAY_INT8:
+        obj = JS_NewInt8Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_UINT8:
+        obj = JS_NewUint8Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_UINT8_CLAMPED:
+        obj = JS_NewUint8ClampedArray(context, length);
+        break;
+    case GJS_TYPED_ARRAY_INT16:
+        obj = JS_NewInt16Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_UINT16:
+        obj = JS_NewUint16Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_INT32:
+        obj = JS_NewInt32Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_UINT32:
+        obj = JS_NewUint32Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_FLOAT32:
+        obj = JS_NewFloat32Array(context, length);
+        break;
+    case GJS_TYPED_ARRAY_FLOAT64:
+        obj = JS_NewFloat64Array(context, length);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    if (obj == NULL)
+        return NULL;
+
+    if (length > 0)
+        memcpy(JS_GetArrayBufferViewData(obj, context), data,
+               length * typed_array_element_size(type));
+
+    return obj;
+}
+
+static GjsGcSliceCallback gc_slice_callback;
+
+static void
+gc_slice_callback_trampoline(JSRuntime                *runtime,
+                             js::GCProgress            progress,
+                             const js::GCDescription  &desc)
+{
+    GjsGcProgress gjs_progress;
+
+    switch (progress) {
+    case js::GC_CYCLE_BEGIN:
+        gjs_progress = GJS_GC_CYCLE_BEGIN;
+        break;
+    case js::GC_SLICE_BEGIN:
+        gjs_progress = GJS_GC_SLICE_BEGIN;
+        break;
+    case js::GC_SLICE_END:
+        gjs_progress = GJS_GC_SLICE_END;
+        break;
+    case js::GC_CYCLE_END:
+        gjs_progress = GJS_GC_CYCLE_END;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    (* gc_slice_callback) (runtime, gjs_progress);
+}
+
+/**
+ * gjs_gc_set_slice_callback:
+ * @runtime: a #JSRuntime
+ * @callback: function called around every GC slice
+ *
+ * A non-incremental GC is reported as a single slice, going straight
+ * from %GJS_GC_CYCLE_BEGIN to %GJS_GC_CYCLE_END. There is only one
+ * callback for the whole process; every runtime has to use the same one.
+ */
+void
+gjs_gc_set_slice_callback(JSRuntime          *runtime,
+                          GjsGcSliceCallback  callback)
+{
+    g_assert(gc_slice_callback == NULL || gc_slice_callback == callback);
+
+    gc_slice_callback = callback;
+    js::SetGCSliceCallback(runtime, gc_slice_callback_trampoline);
+}
+
+/**
+ * gjs_gc_incremental_slice:
+ * @runtime: a #JSRuntime
+ * @budget_ms: how long the slice may take, in milliseconds
+ *
+ * Starts an incremental collection of the whole heap if none is in
+ * progress, otherwise carries on with the current one. If the engine
+ * can't collect incrementally right now this does a full GC.
+ */
+void
+gjs_gc_incremental_slice(JSRuntime *runtime,
+                         gint64     budget_ms)
+{
+    if (js::IsIncrementalGCInProgress(runtime))
+        js::PrepareForIncrementalGC(runtime);
+    else
+        js::PrepareForFullGC(runtime);
+
+    js::IncrementalGC(runtime, js::gcreason::API, budget_ms);
+}
+
+/**
+ * gjs_gc_object_barrier:
+ * @runtime: a #JSRuntime
+ * @obj: (allow-none): an object
+ *
+ * Must be called before dropping a pointer that a trace hook reports,
+ * and when reading an object out of a weak, untraced pointer, so that an
+ * incremental GC marking in the background doesn't miss @obj. It does
+ * nothing unless such a GC is in progress and between slices.
+ */
+void
+gjs_gc_object_barrier(JSRuntime *runtime,
+                      JSObject  *obj)
+{
+    if (obj != NULL && js::IsIncrementalBarrierNeeded(runtime))
+        js::IncrementalReferenceBarrier(obj);
+}
+
+struct _GjsProfilingStack {
+    js::ProfileEntry *entries;
+    uint32_t          size;
+    uint32_t          max_depth;
+};
+
+/**
+ * gjs_profiling_stack_new:
+ * @max_depth: number of frames to keep
+ *
+ * Allocates a stack for the engine to record the JS frames being run
+ * into, see gjs_profiling_stack_enable(). Deeper frames are counted but
+ * not recorded.
+ */
+GjsProfilingStack *
+gjs_profiling_stack_new(guint32 max_depth)
+{
+    GjsProfilingStack *stack;
+
+    stack = g_slice_new0(GjsProfilingStack);
+    stack->entries = new js::ProfileEntry[max_depth];
+    stack->max_depth = max_depth;
+
+    return stack;
+}
+
+void
+gjs_profiling_stack_free(GjsProfilingStack *stack)
+{
+    delete[] stack->entries;
+    g_slice_free(GjsProfilingStack, stack);
+}
+
+void
+gjs_profiling_stack_enable(JSRuntime         *runtime,
+                           GjsProfilingStack *stack,
+                           gboolean           enabled)
+{
+    if (enabled) {
+        stack->size = 0;
+        js::SetRuntimeProfilingStack(runtime, stack->entries,
+                                     &stack->size, stack->max_depth);
+    }
+
+    /* Switching this discards all JIT code, so that it is recompiled
+     * with (or without) the instrumentation */
+    js::EnableRuntimeProfilingStack(runtime, enabled != FALSE);
+}
+
+/**
+ * gjs_profiling_stack_get_depth:
+ * @stack: a #GjsProfilingStack
+ *
+ * Safe to call from a signal handler interrupting the thread running
+ * JS. Frames past the maximum depth are left out.
+ *
+ * Returns: the number of frames that can be read
+ */
+guint32
+gjs_profiling_stack_get_depth(GjsProfilingStack *stack)
+{
+    uint32_t size = *(volatile uint32_t *) &stack->size;
+
+    return MIN(size, stack->max_depth);
+}
+
+/**
+ * gjs_profiling_stack_get_label:
+ * @stack: a #GjsProfilingStack
+ * @index: frame to read, 0 being the outermost
+ *
+ * JS frames are labeled "function (file:line)" by the engine. The label
+ * is only valid for as long as the frame is on the stack.
+ *
+ * Returns: the label of the frame, or %NULL if it doesn't have one
+ */
+const char *
+gjs_profiling_stack_get_label(GjsProfilingStack *stack,
+                              guint32            index)
+{
+    volatile js::ProfileEntry *entry = &stack->entries[index];
+
+    return entry->label();
+}
+
+/**
+ * gjs_profiling_stack_push_native:
+ * @stack: a #GjsProfilingStack
+ * @label: label of the frame, which must stay valid until it is popped
+ * @stack_address: any address in the stack frame of the caller
+ *
+ * Records a call into native code, to be popped with
+ * gjs_profiling_stack_pop() once it returns. This follows what the
+ * engine does for its own frames: the entry is filled in before the
+ * size is bumped, so that a sampling signal never sees a half written
+ * frame.
+ */
+void
+gjs_profiling_stack_push_native(GjsProfilingStack *stack,
+                                const char        *label,
+                                void              *stack_address)
+{
+    volatile uint32_t *size = &stack->size;
+    uint32_t current = *size;
+
+    if (current < stack->max_depth) {
+        volatile js::ProfileEntry *entry = &stack->entries[current];
+
+        /* A non-NULL stack address is what tells native frames apart */
+        entry->setLabel(label);
+        entry->setStackAddress(stack_address);
+        entry->setScript(NULL);
+    }
+
+    /* Both stores are volatile, so they are not reordered */
+    *size = current + 1;
+}
+
+void
+gjs_profiling_stack_pop(GjsProfilingStack *stack)
+{
+    volatile uint32_t *size = &stack->size;
+
+    g_assert(*size > 0);
+    *size = *size - 1;
+}
@@ -32,11 +32,22 @@
 #include "compat.h"
 #include "jsapi-private.h"
 #include "runtime.h"
+#include "gc-scheduler.h"
 
 #include <string.h>
 #include <math.h>
 
-static GMutex gc_lock;
+/* GC state shared between the GC callback and the toggle ref code.
+ * gc_state is GC_RUNNING while a GC is in progress, otherwise the
+ * number of threads currently blocking the GC. The mutex and condition
+ * are only used to sleep when one side has to wait for the other.
+ */
+#define GC_RUNNING (-1)
+
+static volatile gint gc_state;
+static volatile gint gc_waiters;
+static GMutex gc_wait_lock;
+static GCond gc_wait_cond;
 
 GQuark
 gjs_util_error_quark (void)
@@ -1044,106 +1055,111 @@ gjs_parse_args (JSContext  *context,
     return JS_FALSE;
 }
 
-#ifdef __linux__
-static void
-_linux_get_self_process_size (gulong *vm_size,
-                              gulong *rss_size)
+/**
+ * gjs_maybe_gc:
+ *
+ * Low level version of gjs_context_maybe_gc().
+ */
+void
+gjs_maybe_gc (JSContext *context)
 {
-    char *contents;
-    char *iter;
-    gsize len;
-    int i;
+    GjsGcScheduler *scheduler;
 
-    *vm_size = *rss_size = 0;
+    JS_MaybeGC(context);
 
-    if (!g_file_get_contents ("/proc/self/stat", &contents, &len, NULL))
+    scheduler = gjs_gc_scheduler_get(JS_GetRuntime(context));
+    if (scheduler != NULL)
+        gjs_gc_scheduler_maybe_collect(scheduler);
+}
+
+static void
+gc_state_wake_waiters(void)
+{
+    if (g_atomic_int_get(&gc_waiters) == 0)
         return;
 
-    iter = contents;
-    /* See "man proc" for where this 22 comes from */
-    for (i = 0; i < 22; i++) {
-        iter = strchr (iter, ' ');
-        if (!iter)
-            goto out;
-        iter++;
-    }
-    sscanf (iter, " %lu", vm_size);
-    iter = strchr (iter, ' ');
-    if (iter)
-        sscanf (iter, " %lu", rss_size);
+    g_mutex_lock(&gc_wait_lock);
+    g_cond_broadcast(&gc_wait_cond);
+    g_mutex_unlock(&gc_wait_lock);
+}
 
- out:
-    g_free (contents);
+static gboolean
+gc_state_try_block(void)
+{
+    gint state;
+
+    do {
+        state = g_atomic_int_get(&gc_state);
+        if (state == GC_RUNNING)
+            return FALSE;
+    } while (!g_atomic_int_compare_and_exchange(&gc_state, state, state + 1));
+
+    return TRUE;
 }
 
-static gulong linux_rss_trigger;
-#endif
+static gboolean
+gc_state_try_enter(void)
+{
+    return g_atomic_int_compare_and_exchange(&gc_state, 0, GC_RUNNING);
+}
 
-/**
- * gjs_maybe_gc:
- *
- * Low level version of gjs_context_maybe_gc().
+/* Sleeps until @try_func succeeds. The waiter count is raised before
+ * trying under the lock, so a thread changing gc_state either sees it
+ * and broadcasts, or changed the state before our attempt.
  */
-void
-gjs_maybe_gc (JSContext *context)
+static void
+gc_state_wait(gboolean (*try_func) (void))
 {
-    JS_MaybeGC(context);
+    if (try_func())
+        return;
 
-#ifdef __linux__
-    {
-        /* We initiate a GC if VM or RSS has grown by this much */
-        gulong vmsize;
-        gulong rss_size;
-
-        _linux_get_self_process_size (&vmsize, &rss_size);
-
-        /* linux_rss_trigger is initialized to 0, so currently
-         * we always do a full GC early.
-         *
-         * Here we see if the RSS has grown by 25% since
-         * our last look; if so, initiate a full GC.  In
-         * theory using RSS is bad if we get swapped out,
-         * since we may be overzealous in GC, but on the
-         * other hand, if swapping is going on, better
-         * to GC.
-         */
-        if (rss_size > linux_rss_trigger) {
-            linux_rss_trigger = (gulong) MIN(G_MAXULONG, rss_size * 1.25);
-            JS_GC(JS_GetRuntime(context));
-        } else if (rss_size < (0.75 * linux_rss_trigger)) {
-            /* If we've shrunk by 75%, lower the trigger */
-            linux_rss_trigger = (rss_size * 1.25);
-        }
-    }
-#endif
+    g_atomic_int_inc(&gc_waiters);
+    g_mutex_lock(&gc_wait_lock);
+    while (!try_func())
+        g_cond_wait(&gc_wait_cond, &gc_wait_lock);
+    g_mutex_unlock(&gc_wait_lock);
+    g_atomic_int_add(&gc_waiters, -1);
 }
 
 void
 gjs_enter_gc(void)
 {
-    g_mutex_lock(&gc_lock);
+    gc_state_wait(gc_state_try_enter);
 }
 
 void
 gjs_leave_gc(void)
 {
-    g_mutex_unlock(&gc_lock);
+    g_assert(g_atomic_int_get(&gc_state) == GC_RUNNING);
+
+    g_atomic_int_set(&gc_state, 0);
+    gc_state_wake_waiters();
 }
 
+/* Returns %FALSE, without waiting, if a GC is in progress. Otherwise
+ * a GC can't start until gjs_unblock_gc() is called; this costs two
+ * atomic operations and never takes a lock.
+ */
 gboolean
 gjs_try_block_gc(void)
 {
-    return g_mutex_trylock(&gc_lock);
+    return gc_state_try_block();
 }
 
 void
 gjs_block_gc(void)
 {
-    g_mutex_lock(&gc_lock);
+    gc_state_wait(gc_state_try_block);
 }
 
 void
 gjs_unblock_gc(void)
 {
-    g_mutex_unlock(&gc_lock);
+    gint old_state;
+
+    old_state = g_atomic_int_add(&gc_state, -1);
+    g_assert(old_state > 0);
+
+    if (old_state == 1)
+        gc_state_wake_waiters();
 }
@@ -52,6 +52,33 @@ typedef enum {
 
 typedef struct GjsRootedArray GjsRootedArray;
 
+/* Element types of JS typed arrays, see gjs_typed_array_peek_data() */
+typedef enum {
+    GJS_TYPED_ARRAY_INT8,
+    GJS_TYPED_ARRAY_UINT8,
+    GJS_TYPED_ARRAY_UINT8_CLAMPED,
+    GJS_TYPED_ARRAY_INT16,
+    GJS_TYPED_ARRAY_UINT16,
+    GJS_TYPED_ARRAY_INT32,
+    GJS_TYPED_ARRAY_UINT32,
+    GJS_TYPED_ARRAY_FLOAT32,
+    GJS_TYPED_ARRAY_FLOAT64
+} GjsTypedArrayType;
+
+/* Progress of a garbage collection, see gjs_gc_set_slice_callback() */
+typedef enum {
+    GJS_GC_CYCLE_BEGIN,
+    GJS_GC_SLICE_BEGIN,
+    GJS_GC_SLICE_END,
+    GJS_GC_CYCLE_END
+} GjsGcProgress;
+
+typedef void (* GjsGcSliceCallback) (JSRuntime     *runtime,
+                                     GjsGcProgress  progress);
+
+/* Stack of the frames being run, maintained by the engine for profilers */
+typedef struct _GjsProfilingStack GjsProfilingStack;
+
 /* Flags that should be set on properties exported from native code modules.
  * Basically set these on API, but do NOT set them on data.
  *
@@ -283,6 +310,33 @@ JSBool      gjs_call_function_value          (JSContext       *context,
 void        gjs_error_reporter               (JSContext       *context,
                                               const char      *message,
                                               JSErrorReport   *report);
+gboolean    gjs_typed_array_peek_data        (JSContext         *context,
+                                              JSObject          *obj,
+                                              GjsTypedArrayType *type_p,
+                                              void             **data_p,
+                                              guint32           *length_p);
+JSObject*   gjs_typed_array_new              (JSContext         *context,
+                                              GjsTypedArrayType  type,
+                                              const void        *data,
+                                              guint32            length);
+void        gjs_gc_set_slice_callback        (JSRuntime          *runtime,
+                                              GjsGcSliceCallback  callback);
+void        gjs_gc_incremental_slice         (JSRuntime       *runtime,
+                                              gint64           budget_ms);
+void        gjs_gc_object_barrier            (JSRuntime       *runtime,
+                                              JSObject        *obj);
+GjsProfilingStack* gjs_profiling_stack_new   (guint32             max_depth);
+void        gjs_profiling_stack_free         (GjsProfilingStack  *stack);
+void        gjs_profiling_stack_enable       (JSRuntime          *runtime,
+                                              GjsProfilingStack  *stack,
+                                              gboolean            enabled);
+guint32     gjs_profiling_stack_get_depth    (GjsProfilingStack  *stack);
+const char* gjs_profiling_stack_get_label    (GjsProfilingStack  *stack,
+                                              guint32             index);
+void        gjs_profiling_stack_push_native  (GjsProfilingStack  *stack,
+                                              const char         *label,
+                                              void               *stack_address);
+void        gjs_profiling_stack_pop          (GjsProfilingStack  *stack);
 JSBool      gjs_get_prop_verbose_stub        (JSContext       *context,
                                               JSObject        *obj,
                                               jsval            id,
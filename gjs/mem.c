@@ -23,6 +23,8 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include "mem.h"
 #include "compat.h"
 #include <util/log.h>
@@ -36,6 +38,7 @@
 GJS_DEFINE_COUNTER(everything)
 
 GJS_DEFINE_COUNTER(boxed)
+GJS_DEFINE_COUNTER(boxed_payload)
 GJS_DEFINE_COUNTER(gerror)
 GJS_DEFINE_COUNTER(closure)
 GJS_DEFINE_COUNTER(database)
@@ -54,6 +57,7 @@ GJS_DEFINE_COUNTER(interface)
 
 static GjsMemCounter* counters[] = {
     GJS_LIST_COUNTER(boxed),
+    GJS_LIST_COUNTER(boxed_payload),
     GJS_LIST_COUNTER(gerror),
     GJS_LIST_COUNTER(closure),
     GJS_LIST_COUNTER(database),
@@ -68,6 +72,142 @@ static GjsMemCounter* counters[] = {
     GJS_LIST_COUNTER(interface)
 };
 
+/* Code using things like Gdk.RGBA or Clutter.ActorBox as temporaries
+ * allocates and frees lots of small structs in a row. Instead of going
+ * back to the slice allocator each time, freed blocks are kept on free
+ * lists, one per size class, and handed out again. The lists are per
+ * thread, since a context is only used from the thread it was created
+ * in, and their length is bounded so a burst of allocations doesn't pin
+ * memory forever.
+ */
+#define PAYLOAD_GRANULARITY 8
+#define PAYLOAD_MAX_SIZE    128
+#define PAYLOAD_N_CLASSES   (PAYLOAD_MAX_SIZE / PAYLOAD_GRANULARITY)
+#define PAYLOAD_MAX_CACHED  256
+
+typedef struct {
+    gpointer free_lists[PAYLOAD_N_CLASSES];
+    guint n_cached[PAYLOAD_N_CLASSES];
+} PayloadCache;
+
+static struct {
+    guint allocated;
+    guint reused;
+} payload_stats;
+
+static void
+payload_cache_free(gpointer data)
+{
+    PayloadCache *cache = data;
+    int i;
+
+    for (i = 0; i < PAYLOAD_N_CLASSES; i++) {
+        gpointer block = cache->free_lists[i];
+
+        while (block != NULL) {
+            gpointer next = *(gpointer *) block;
+            g_slice_free1((i + 1) * PAYLOAD_GRANULARITY, block);
+            block = next;
+        }
+    }
+
+    g_slice_free(PayloadCache, cache);
+}
+
+static GPrivate payload_cache_key = G_PRIVATE_INIT(payload_cache_free);
+
+static PayloadCache *
+get_payload_cache(void)
+{
+    PayloadCache *cache = g_private_get(&payload_cache_key);
+
+    if (G_UNLIKELY(cache == NULL)) {
+        cache = g_slice_new0(PayloadCache);
+        g_private_set(&payload_cache_key, cache);
+    }
+
+    return cache;
+}
+
+/**
+ * gjs_boxed_payload_alloc0:
+ * @size: size of the struct
+ *
+ * Allocates zeroed memory for a struct that gjs manages itself, such as
+ * a directly allocated boxed or a caller-allocates out argument. Free it
+ * with gjs_boxed_payload_free() and the same @size.
+ *
+ * Returns: the new block, or %NULL if @size is 0
+ */
+gpointer
+gjs_boxed_payload_alloc0(gsize size)
+{
+    PayloadCache *cache;
+    gpointer block;
+    int size_class;
+
+    /* Nothing is allocated, and gjs_boxed_payload_free() ignores
+     * NULL, so this mustn't be counted as a live payload */
+    if (size == 0)
+        return NULL;
+
+    GJS_INC_COUNTER(boxed_payload);
+
+    if (size > PAYLOAD_MAX_SIZE)
+        return g_slice_alloc0(size);
+
+    size_class = (size - 1) / PAYLOAD_GRANULARITY;
+    cache = get_payload_cache();
+    block = cache->free_lists[size_class];
+
+    if (block != NULL) {
+        cache->free_lists[size_class] = *(gpointer *) block;
+        cache->n_cached[size_class]--;
+        memset(block, 0, size);
+        payload_stats.reused++;
+    } else {
+        block = g_slice_alloc0((size_class + 1) * PAYLOAD_GRANULARITY);
+        payload_stats.allocated++;
+    }
+
+    return block;
+}
+
+/**
+ * gjs_boxed_payload_free:
+ * @size: size passed to gjs_boxed_payload_alloc0()
+ * @mem: the block to free
+ */
+void
+gjs_boxed_payload_free(gsize    size,
+                       gpointer mem)
+{
+    PayloadCache *cache;
+    int size_class;
+
+    if (mem == NULL)
+        return;
+
+    GJS_DEC_COUNTER(boxed_payload);
+
+    if (size > PAYLOAD_MAX_SIZE) {
+        g_slice_free1(size, mem);
+        return;
+    }
+
+    size_class = (size - 1) / PAYLOAD_GRANULARITY;
+    cache = get_payload_cache();
+
+    if (cache->n_cached[size_class] >= PAYLOAD_MAX_CACHED) {
+        g_slice_free1((size_class + 1) * PAYLOAD_GRANULARITY, mem);
+        return;
+    }
+
+    *(gpointer *) mem = cache->free_lists[size_class];
+    cache->free_lists[size_class] = mem;
+    cache->n_cached[size_class]++;
+}
+
 void
 gjs_memory_report(const char *where,
                   gboolean    die_if_leaks)
@@ -103,6 +243,11 @@ gjs_memory_report(const char *where,
                   counters[i]->value);
     }
 
+    gjs_debug(GJS_DEBUG_MEMORY,
+              "  boxed payloads: %u allocated, %u reused from free lists",
+              payload_stats.allocated,
+              payload_stats.reused);
+
     if (die_if_leaks && GJS_GET_COUNTER(everything) > 0) {
         g_error("%s: JavaScript objects were leaked.", where);
     }
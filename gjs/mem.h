@@ -44,6 +44,7 @@ typedef struct {
 GJS_DECLARE_COUNTER(everything)
 
 GJS_DECLARE_COUNTER(boxed)
+GJS_DECLARE_COUNTER(boxed_payload)
 GJS_DECLARE_COUNTER(gerror)
 GJS_DECLARE_COUNTER(closure)
 GJS_DECLARE_COUNTER(database)
@@ -75,6 +76,10 @@ GJS_DECLARE_COUNTER(interface)
 void gjs_memory_report(const char *where,
                        gboolean    die_if_leaks);
 
+gpointer gjs_boxed_payload_alloc0 (gsize    size);
+void     gjs_boxed_payload_free   (gsize    size,
+                                   gpointer mem);
+
 G_END_DECLS
 
 #endif  /* __GJS_MEM_H__ */
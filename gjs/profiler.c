@@ -21,284 +21,219 @@
  * IN THE SOFTWARE.
  */
 
+/* A sampling profiler. While it runs, the engine keeps a stack of the
+ * JS frames being executed (its "SPS" profiling stack), to which calls
+ * into introspected C functions are added as "Namespace.function"
+ * frames. A timer measuring the CPU time of the JS thread sends it
+ * SIGPROF at a regular interval, and the signal handler copies the
+ * current stack into a preallocated ring buffer. The samples are
+ * counted from the main loop, and written out in the "collapsed stack"
+ * format that flamegraph.pl and most other tools read: one line per
+ * distinct stack, outermost frame first, with the number of samples.
+ *
+ * Set GJS_DEBUG_PROFILER_OUTPUT to a file name to turn it on. The
+ * profile is written to <output>.<pid>.<n> when the context is
+ * destroyed and whenever the process gets SIGUSR1, each file only
+ * having the samples taken since the previous one.
+ * GJS_DEBUG_PROFILER_INTERVAL sets the sampling interval, in
+ * microseconds of CPU time.
+ */
+
 #include <config.h>
 
 #include "profiler.h"
 #include "compat.h"
 #include "jsapi-util.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
-#include <string.h>
+
+#if defined(HAVE_TIMER_CREATE) && defined(SIGEV_THREAD_ID)
+#define USE_THREAD_TIMER 1
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/* Frames past this depth are counted but left out of the samples */
+#define MAX_STACK_DEPTH 64
+/* Must be a power of two */
+#define RING_SIZE (4 * 1024 * 1024)
+#define DEFAULT_INTERVAL_USEC 1000
+#define DRAIN_INTERVAL_MS 250
+
+/* Sample taken while the JS thread wasn't running any JS */
+#define NATIVE_LABEL "(native)"
+#define UNKNOWN_LABEL "(unknown)"
 
 static GjsProfiler *global_profiler = NULL;
 static char        *global_profiler_output = NULL;
 static guint        global_profiler_output_counter = 0;
 static guint        global_profile_idle = 0;
 
-
-typedef struct _GjsProfileData     GjsProfileData;
-typedef struct _GjsProfileFunction GjsProfileFunction;
-
 struct _GjsProfiler {
     JSRuntime *runtime;
+    GjsProfilingStack *stack;
+    pthread_t thread;
 
-    GHashTable *by_file;    /* GjsProfileFunctionKey -> GjsProfileFunction */
-
-    GjsProfileData *last_function_entered; /* weak ref to by_file */
-    int64_t         last_function_exit_time;
-};
-
-struct _GjsProfileData {
-    /* runtime state tracking */
-    GjsProfileData *caller;
-    int64_t enter_time;
-    int64_t runtime_so_far;
-    unsigned recurse_depth;
-
-    /* final statistics */
-    unsigned call_count;
-
-    int64_t total_time;
-    int64_t self_time;
-};
-
-typedef struct {
-    char       *filename;
-    unsigned    lineno;
-    char       *function_name;
-} GjsProfileFunctionKey;
-
-struct _GjsProfileFunction {
-    GjsProfileFunctionKey key;
-
-    GjsProfileData profile;
+    /* Each sample is a guint32 length followed by the collapsed stack,
+     * without a terminating nul. The signal handler is the only writer
+     * of ring_head, and it runs on the same thread as the reader, so
+     * volatile is all that is needed.
+     */
+    char *ring;
+    volatile guint ring_head;
+    volatile guint ring_tail;
+    volatile guint dropped;
+
+    GHashTable *counts;     /* collapsed stack -> number of samples */
+    guint drain_id;
+
+#ifdef USE_THREAD_TIMER
+    timer_t timer;
+#endif
+    gboolean timer_running;
 };
 
-static guint
-gjs_profile_function_key_hash(gconstpointer keyp)
-{
-    const GjsProfileFunctionKey *key = keyp;
-
-    return g_str_hash(key->filename) ^
-        key->lineno ^
-        g_str_hash(key->function_name);
-}
-
-static gboolean
-gjs_profile_function_key_equal(gconstpointer ap,
-                               gconstpointer bp)
-{
-    const GjsProfileFunctionKey *a = ap;
-    const GjsProfileFunctionKey *b = bp;
-
-    g_assert(a != NULL);
-    g_assert(b != NULL);
-
-    return g_str_equal(a->filename, b->filename) &&
-        a->lineno == b->lineno &&
-        g_str_equal(a->function_name, b->function_name);
-}
-
-static GjsProfileFunction *
-gjs_profile_function_new(GjsProfileFunctionKey *key)
+static void
+ring_write(GjsProfiler *self,
+           guint        pos,
+           const char  *data,
+           guint        len)
 {
-    GjsProfileFunction *self;
+    guint i;
 
-    self = g_slice_new0(GjsProfileFunction);
-    self->key.filename = g_strdup(key->filename);
-    self->key.lineno = key->lineno;
-    // Pass ownership of function_name from key to the new function
-    self->key.function_name = key->function_name;
-
-    g_assert(self->key.filename != NULL);
-    g_assert(self->key.function_name != NULL);
-
-    return self;
+    for (i = 0; i < len; i++)
+        self->ring[(pos + i) & (RING_SIZE - 1)] = data[i];
 }
 
 static void
-gjs_profile_function_free(GjsProfileFunction *self)
+ring_read(GjsProfiler *self,
+          guint        pos,
+          char        *data,
+          guint        len)
 {
-    g_free(self->key.filename);
-    g_free(self->key.function_name);
-    g_slice_free(GjsProfileFunction, self);
+    guint i;
+
+    for (i = 0; i < len; i++)
+        data[i] = self->ring[(pos + i) & (RING_SIZE - 1)];
 }
 
+/* Only calls async-signal-safe functions, and doesn't allocate */
 static void
-gjs_profile_function_key_from_js(JSContext             *cx,
-                                 JSStackFrame          *fp,
-                                 GjsProfileFunctionKey *key)
+sample_signal_handler(int signum)
 {
-    JSScript *script;
-    JSFunction *function;
-    JSString *function_name;
+    GjsProfiler *self = global_profiler;
+    const char *labels[MAX_STACK_DEPTH];
+    guint lengths[MAX_STACK_DEPTH];
+    guint depth, i, head, pos;
+    guint32 len;
+    int saved_errno;
+
+    /* With setitimer() the signal goes to whichever thread is running */
+    if (self == NULL || !pthread_equal(pthread_self(), self->thread))
+        return;
 
-    /* We're not using the JSScript or JSFunction as the key since the script
-     * could be unloaded and addresses reused.
-     */
+    saved_errno = errno;
 
-    script = JS_GetFrameScript(cx, fp);
-    if (script != NULL) {
-        key->filename = (char*)JS_GetScriptFilename(cx, script);
-        key->lineno = JS_GetScriptBaseLineNumber(cx, script);
+    depth = gjs_profiling_stack_get_depth(self->stack);
+    if (depth == 0) {
+        labels[0] = NATIVE_LABEL;
+        depth = 1;
     } else {
-        key->filename = "(native)";
-        key->lineno = 0;
+        for (i = 0; i < depth; i++) {
+            labels[i] = gjs_profiling_stack_get_label(self->stack, i);
+            if (labels[i] == NULL)
+                labels[i] = UNKNOWN_LABEL;
+        }
     }
 
-    function = JS_GetFrameFunction(cx, fp);
-    /* If function == NULL we're probably calling a GIRepositoryFunction object
-     * (or other object with a 'call' method) and would be good to somehow
-     * figure out the name of the called function.
-     */
-    function_name = JS_GetFunctionId(function);
-    if (!function_name ||
-        !gjs_string_to_utf8(cx, STRING_TO_JSVAL(function_name), &key->function_name))
-        key->function_name = g_strdup("(unknown)");
-
-    g_assert(key->filename != NULL);
-    g_assert(key->function_name != NULL);
-}
-
-static GjsProfileFunction *
-gjs_profiler_lookup_function(GjsProfiler  *self,
-                             JSContext    *cx,
-                             JSStackFrame *fp,
-                             gboolean      create_if_missing)
-{
-    GjsProfileFunctionKey key;
-    GjsProfileFunction *function;
-
-    gjs_profile_function_key_from_js(cx, fp, &key);
-
-    function = g_hash_table_lookup(self->by_file, &key);
-    if (function)
-        goto error;
-
-    if (!create_if_missing)
-        goto error;
+    len = depth - 1;
+    for (i = 0; i < depth; i++) {
+        lengths[i] = strlen(labels[i]);
+        len += lengths[i];
+    }
 
-    function = gjs_profile_function_new(&key);
+    head = self->ring_head;
+    if (sizeof(len) + len > RING_SIZE - (head - self->ring_tail)) {
+        self->dropped += 1;
+        errno = saved_errno;
+        return;
+    }
 
-    g_hash_table_insert(self->by_file, &function->key, function);
+    ring_write(self, head, (const char *) &len, sizeof(len));
+    pos = head + sizeof(len);
 
-    /* Don't free key.function_name if we get here since we passed its
-     * ownership to the new function.
-     */
-    return function;
+    for (i = 0; i < depth; i++) {
+        if (i > 0) {
+            ring_write(self, pos, ";", 1);
+            pos += 1;
+        }
+        ring_write(self, pos, labels[i], lengths[i]);
+        pos += lengths[i];
+    }
 
- error:
-    g_free(key.function_name);
-    return NULL;
+    self->ring_head = pos;
+    errno = saved_errno;
 }
 
+/* Moves the samples out of the ring buffer and into the counts */
 static void
-gjs_profiler_log_call(GjsProfiler  *self,
-                      JSContext    *cx,
-                      JSStackFrame *fp,
-                      JSBool        before,
-                      JSBool       *ok)
+gjs_profiler_drain(GjsProfiler *self)
 {
-    GjsProfileFunction *function;
-    GjsProfileData *p;
-    int64_t now;
+    GString *stack;
+    guint head, tail;
 
-    function = gjs_profiler_lookup_function(self, cx, fp, before);
-    if (!function)
+    head = self->ring_head;
+    tail = self->ring_tail;
+    if (head == tail)
         return;
 
-    p = &function->profile;
-    now = JS_Now();
-
-    if (before) {
-        if (p->recurse_depth == 0) {
-            g_assert(p->enter_time == 0);
+    stack = g_string_new(NULL);
 
-            /* we just exited the caller so account for the time spent */
-            if (p->caller) {
-                int64_t delta;
+    while (tail != head) {
+        guint32 len;
+        guint count;
+        char *p;
 
-                if (self->last_function_exit_time != 0) {
-                    delta = now - self->last_function_exit_time;
-                } else {
-                    delta = now - p->caller->enter_time;
-                }
+        ring_read(self, tail, (char *) &len, sizeof(len));
+        tail += sizeof(len);
 
-                p->caller->runtime_so_far += delta;
-            }
+        g_string_set_size(stack, len);
+        ring_read(self, tail, stack->str, len);
+        tail += len;
 
-            self->last_function_exit_time = 0;
-            p->runtime_so_far = 0;
-            p->enter_time = now;
-
-            p->caller = self->last_function_entered;
-            self->last_function_entered = p;
-        } else {
-            g_assert(p->enter_time != 0);
+        /* A newline in a label would break the output format */
+        for (p = stack->str; *p != '\0'; p++) {
+            if (*p == '\n')
+                *p = ' ';
         }
 
-        p->recurse_depth += 1;
-    } else {
-        int64_t delta;
-
-        g_assert(p->recurse_depth > 0);
-
-        p->recurse_depth -= 1;
-        if (p->recurse_depth == 0) {
-            g_assert(p->enter_time != 0);
-
-            delta = now - p->enter_time;
-            p->total_time += delta;
-
-            /* two returns without function call in between */
-            if (self->last_function_exit_time != 0) {
-                delta = now - self->last_function_exit_time;
-                p->runtime_so_far += delta;
-
-                delta = p->runtime_so_far;
-            }
-
-            p->self_time += delta;
-
-            self->last_function_entered = p->caller;
-            p->caller = NULL;
-
-            self->last_function_exit_time = now;
-            p->enter_time = 0;
-        }
-
-        p->call_count += 1;
+        count = GPOINTER_TO_UINT(g_hash_table_lookup(self->counts, stack->str));
+        g_hash_table_replace(self->counts, g_strdup(stack->str),
+                             GUINT_TO_POINTER(count + 1));
     }
-}
-
-static void *
-gjs_profiler_execute_hook(JSContext    *cx,
-                          JSStackFrame *fp,
-                          JSBool        before,
-                          JSBool       *ok,
-                          void         *callerdata)
-{
-    GjsProfiler *self = callerdata;
 
-    gjs_profiler_log_call(self, cx, fp, before, ok);
+    self->ring_tail = tail;
 
-    return callerdata;
+    g_string_free(stack, TRUE);
 }
 
-static void *
-gjs_profiler_call_hook(JSContext    *cx,
-                       JSStackFrame *fp,
-                       JSBool        before,
-                       JSBool       *ok,
-                       void         *callerdata)
+static gboolean
+drain_timeout(gpointer user_data)
 {
-    GjsProfiler *self = callerdata;
+    gjs_profiler_drain(user_data);
 
-    gjs_profiler_log_call(self, cx, fp, before, ok);
-
-    return callerdata;
+    return TRUE;
 }
 
 static gboolean
@@ -320,13 +255,79 @@ dump_profile_signal_handler(int signum)
                                               NULL, NULL);
 }
 
-static void
-gjs_profiler_profile(GjsProfiler *self, gboolean enabled)
+static guint
+get_sampling_interval(void)
+{
+    const char *interval_env;
+    guint64 interval;
+
+    interval_env = g_getenv("GJS_DEBUG_PROFILER_INTERVAL");
+    if (interval_env == NULL)
+        return DEFAULT_INTERVAL_USEC;
+
+    interval = g_ascii_strtoull(interval_env, NULL, 10);
+    if (interval == 0 || interval > G_MAXUINT)
+        return DEFAULT_INTERVAL_USEC;
+
+    return (guint) interval;
+}
+
+static gboolean
+gjs_profiler_start_timer(GjsProfiler *self,
+                         guint        interval_usec)
 {
-    JSRuntime *rt;
+#ifdef USE_THREAD_TIMER
+    struct sigevent sev;
+    struct itimerspec its;
+
+    /* Only counts the time the JS thread is actually running, and
+     * always interrupts that thread rather than some other one */
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &self->timer) < 0)
+        return FALSE;
+
+    its.it_interval.tv_sec = interval_usec / G_USEC_PER_SEC;
+    its.it_interval.tv_nsec = (interval_usec % G_USEC_PER_SEC) * 1000;
+    its.it_value = its.it_interval;
+
+    if (timer_settime(self->timer, 0, &its, NULL) < 0) {
+        timer_delete(self->timer);
+        return FALSE;
+    }
+#else
+    struct itimerval itv;
+
+    itv.it_interval.tv_sec = interval_usec / G_USEC_PER_SEC;
+    itv.it_interval.tv_usec = interval_usec % G_USEC_PER_SEC;
+    itv.it_value = itv.it_interval;
+
+    if (setitimer(ITIMER_PROF, &itv, NULL) < 0)
+        return FALSE;
+#endif
 
-    rt = self->runtime;
+    return TRUE;
+}
+
+static void
+gjs_profiler_stop_timer(GjsProfiler *self)
+{
+#ifdef USE_THREAD_TIMER
+    timer_delete(self->timer);
+#else
+    struct itimerval itv;
+
+    memset(&itv, 0, sizeof(itv));
+    setitimer(ITIMER_PROF, &itv, NULL);
+#endif
+}
 
+static void
+gjs_profiler_profile(GjsProfiler *self, gboolean enabled)
+{
     if (enabled) {
         static gboolean signal_handler_initialized = FALSE;
 
@@ -338,70 +339,100 @@ gjs_profiler_profile(GjsProfiler *self, gboolean enabled)
             memset(&sa, 0, sizeof(sa));
             sa.sa_handler = dump_profile_signal_handler;
             sigaction(SIGUSR1, &sa, NULL);
+
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = sample_signal_handler;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGPROF, &sa, NULL);
         }
 
-        global_profiler = self;
         g_assert(global_profiler_output != NULL);
 
-        /* "toplevel" execution */
-        JS_SetExecuteHook(rt, gjs_profiler_execute_hook, self);
-        /* function call */
-        JS_SetCallHook(rt, gjs_profiler_call_hook, self);
+        self->stack = gjs_profiling_stack_new(MAX_STACK_DEPTH);
+        self->ring = g_malloc(RING_SIZE);
+        self->thread = pthread_self();
+        gjs_profiling_stack_enable(self->runtime, self->stack, TRUE);
+
+        global_profiler = self;
+
+        self->timer_running = gjs_profiler_start_timer(self, get_sampling_interval());
+        if (!self->timer_running)
+            g_warning("Could not start the profiler timer: %s",
+                      g_strerror(errno));
+
+        self->drain_id = g_timeout_add(DRAIN_INTERVAL_MS, drain_timeout, self);
     } else if (self == global_profiler) {
-        JS_SetExecuteHook(rt, NULL, NULL);
-        JS_SetCallHook(rt, NULL, NULL);
+        if (self->timer_running)
+            gjs_profiler_stop_timer(self);
+        self->timer_running = FALSE;
 
+        /* A signal can't come in after this, it would be ignored */
         global_profiler = NULL;
+
+        g_source_remove(self->drain_id);
+        self->drain_id = 0;
+
+        gjs_profiling_stack_enable(self->runtime, self->stack, FALSE);
     }
 }
 
-static void
-by_file_reset_one(gpointer key,
-                  gpointer value,
-                  gpointer user_data)
+/**
+ * gjs_profiler_is_sampling:
+ *
+ * Returns: %TRUE if gjs_profiler_push_native() records anything
+ */
+gboolean
+gjs_profiler_is_sampling(void)
 {
-    GjsProfileFunction *function = value;
-    GjsProfileData *p;
+    return global_profiler != NULL;
+}
 
-    p = &function->profile;
+/**
+ * gjs_profiler_push_native:
+ * @label: name of the native function being called
+ * @stack_address: any address in the stack frame of the caller
+ *
+ * Adds a frame to the sampled stacks, until gjs_profiler_pop_native()
+ * is called. @label must stay valid until then. Only call this when
+ * gjs_profiler_is_sampling() is %TRUE.
+ */
+void
+gjs_profiler_push_native(const char *label,
+                         void       *stack_address)
+{
+    gjs_profiling_stack_push_native(global_profiler->stack, label,
+                                    stack_address);
+}
 
-    p->call_count = 0;
-    p->self_time  = 0;
-    p->total_time = 0;
+void
+gjs_profiler_pop_native(void)
+{
+    /* The profiler may have been stopped during the call */
+    if (global_profiler != NULL)
+        gjs_profiling_stack_pop(global_profiler->stack);
 }
 
 void
 gjs_profiler_reset(GjsProfiler *self)
 {
-    g_hash_table_foreach(self->by_file,
-                         by_file_reset_one,
-                         NULL);
+    if (self->ring != NULL) {
+        gjs_profiler_drain(self);
+        self->dropped = 0;
+    }
+
+    g_hash_table_remove_all(self->counts);
 }
 
 static void
-by_file_dump_one(gpointer key,
-                 gpointer value,
-                 gpointer user_data)
+counts_dump_one(gpointer key,
+                gpointer value,
+                gpointer user_data)
 {
-    GjsProfileFunction *function = value;
     FILE *fp = user_data;
-    GjsProfileData *p;
-
-    p = &function->profile;
-
-    if (p->call_count == 0)
-        return;
-
-    /* file:line function calls self total */
-    fprintf(fp, "%s:%u\t%s\t%u\t%.2f\t%.2f\n",
-            function->key.filename, function->key.lineno,
-            function->key.function_name,
-            p->call_count,
-            p->self_time / 1000.,
-            p->total_time / 1000.);
 
-    /* reset counters so that next dump is delta from previous */
-    by_file_reset_one(key, value, user_data);
+    /* frame;frame;frame samples */
+    fprintf(fp, "%s %u\n", (const char *) key, GPOINTER_TO_UINT(value));
 }
 
 void
@@ -410,6 +441,11 @@ gjs_profiler_dump(GjsProfiler *self)
     char *filename;
     FILE *fp;
 
+    if (self->ring == NULL)
+        return;
+
+    gjs_profiler_drain(self);
+
     filename = g_strdup_printf("%s.%u.%u",
                                global_profiler_output,
                                (guint)getpid(),
@@ -422,14 +458,17 @@ gjs_profiler_dump(GjsProfiler *self)
     if (!fp)
         return;
 
-    /* file:line function calls self total */
-    fprintf(fp, "file:line\tfunction\tcalls\tself\ttotal\n");
-
-    g_hash_table_foreach(self->by_file,
-                         by_file_dump_one,
+    g_hash_table_foreach(self->counts,
+                         counts_dump_one,
                          fp);
 
+    if (self->dropped > 0)
+        fprintf(fp, "(dropped) %u\n", self->dropped);
+
     fclose(fp);
+
+    /* next dump is delta from this one */
+    gjs_profiler_reset(self);
 }
 
 GjsProfiler *
@@ -443,11 +482,8 @@ gjs_profiler_new(JSRuntime *runtime)
 
     self = g_slice_new0(GjsProfiler);
     self->runtime = runtime;
-    self->by_file =
-        g_hash_table_new_full(gjs_profile_function_key_hash,
-                              gjs_profile_function_key_equal,
-                              NULL,
-                              (GDestroyNotify)gjs_profile_function_free);
+    self->counts = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, NULL);
 
     profiler_output = g_getenv("GJS_DEBUG_PROFILER_OUTPUT");
     if (profiler_output != NULL) {
@@ -468,6 +504,13 @@ gjs_profiler_free(GjsProfiler *self)
     gjs_profiler_profile(self, FALSE);
     g_assert(global_profiler == NULL);
 
-    g_hash_table_destroy(self->by_file);
+    if (self->ring != NULL) {
+        gjs_profiler_dump(self);
+
+        gjs_profiling_stack_free(self->stack);
+        g_free(self->ring);
+    }
+
+    g_hash_table_destroy(self->counts);
     g_slice_free(GjsProfiler, self);
 }
@@ -37,6 +37,11 @@ void         gjs_profiler_reset(GjsProfiler *self);
 
 void gjs_profiler_dump   (GjsProfiler *self);
 
+gboolean gjs_profiler_is_sampling (void);
+void     gjs_profiler_push_native (const char *label,
+                                   void       *stack_address);
+void     gjs_profiler_pop_native  (void);
+
 G_END_DECLS
 
 #endif /* __GJS_PROFILER_H__ */
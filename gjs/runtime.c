@@ -35,9 +35,24 @@
 #include <string.h>
 #include <math.h>
 
+/* Values pushed by gjs_runtime_push_values() live in chunks that are
+ * never moved, so callers can hold on to the pointers. */
+#define VALUE_CHUNK_SIZE 256
+
+typedef struct _ValueChunk ValueChunk;
+struct _ValueChunk {
+    ValueChunk *prev;
+    guint size;
+    guint top;
+    jsval values[1];
+};
+
 typedef struct {
     JSContext *context;
     jsid const_strings[GJS_STRING_LAST];
+
+    ValueChunk *value_stack;
+    ValueChunk *spare_chunk;
 } GjsRuntimeData;
 
 /* Keep this consistent with GjsConstString */
@@ -96,6 +111,107 @@ gjs_object_get_property_const(JSContext      *context,
                               pname, value_p);
 }
 
+static ValueChunk *
+value_chunk_new(guint size)
+{
+    ValueChunk *chunk;
+
+    chunk = g_malloc(G_STRUCT_OFFSET(ValueChunk, values) + size * sizeof(jsval));
+    chunk->prev = NULL;
+    chunk->size = size;
+    chunk->top = 0;
+
+    return chunk;
+}
+
+/**
+ * gjs_runtime_push_values:
+ * @runtime: a #JSRuntime
+ * @n_values: number of values
+ *
+ * Reserves @n_values jsvals on a stack that the garbage collector
+ * traces, for the arguments of a call into JS. This is much cheaper
+ * than rooting each value with JS_AddValueRoot(). The values are
+ * initialized to %JSVAL_VOID, and stay traced until they are released
+ * with gjs_runtime_pop_values(), in the reverse order they were pushed.
+ *
+ * Returns: the reserved values
+ */
+jsval *
+gjs_runtime_push_values(JSRuntime *runtime,
+                        guint      n_values)
+{
+    GjsRuntimeData *data = get_data(runtime);
+    ValueChunk *chunk = data->value_stack;
+    jsval *values;
+    guint i;
+
+    if (chunk == NULL || chunk->size - chunk->top < n_values) {
+        ValueChunk *new_chunk = data->spare_chunk;
+
+        if (new_chunk != NULL && new_chunk->size >= n_values) {
+            data->spare_chunk = NULL;
+        } else {
+            new_chunk = value_chunk_new(MAX(VALUE_CHUNK_SIZE, n_values));
+        }
+
+        new_chunk->prev = chunk;
+        data->value_stack = chunk = new_chunk;
+    }
+
+    values = &chunk->values[chunk->top];
+    for (i = 0; i < n_values; i++)
+        values[i] = JSVAL_VOID;
+    chunk->top += n_values;
+
+    return values;
+}
+
+/**
+ * gjs_runtime_pop_values:
+ * @runtime: a #JSRuntime
+ * @values: values returned by the last gjs_runtime_push_values()
+ * @n_values: number of values that were pushed
+ *
+ * Releases values reserved with gjs_runtime_push_values().
+ */
+void
+gjs_runtime_pop_values(JSRuntime *runtime,
+                       jsval     *values,
+                       guint      n_values)
+{
+    GjsRuntimeData *data = get_data(runtime);
+    ValueChunk *chunk = data->value_stack;
+
+    g_assert(chunk != NULL);
+    g_assert(chunk->top >= n_values);
+    g_assert(values == &chunk->values[chunk->top - n_values]);
+
+    chunk->top -= n_values;
+
+    /* Keep one chunk around, so that calls going back and forth over a
+     * chunk boundary don't allocate every time */
+    if (chunk->top == 0 && chunk->prev != NULL) {
+        data->value_stack = chunk->prev;
+        g_free(data->spare_chunk);
+        data->spare_chunk = chunk;
+    }
+}
+
+static void
+runtime_trace_values(JSTracer *tracer,
+                     void     *user_data)
+{
+    GjsRuntimeData *data = user_data;
+    ValueChunk *chunk;
+    guint i;
+
+    for (chunk = data->value_stack; chunk != NULL; chunk = chunk->prev) {
+        for (i = 0; i < chunk->top; i++)
+            JS_CALL_VALUE_TRACER(tracer, chunk->values[i], "argument stack");
+    }
+}
+
 void
 gjs_runtime_init_for_context(JSRuntime *runtime,
                              JSContext *context)
@@ -103,17 +219,31 @@ gjs_runtime_init_for_context(JSRuntime *runtime,
     GjsRuntimeData *data;
     int i;
 
-    data = g_new(GjsRuntimeData, 1);
+    data = g_new0(GjsRuntimeData, 1);
 
     data->context = context;
     for (i = 0; i < GJS_STRING_LAST; i++)
         data->const_strings[i] = gjs_intern_string_to_id(context, const_strings[i]);
 
+    data->value_stack = value_chunk_new(VALUE_CHUNK_SIZE);
+    JS_SetExtraGCRootsTracer(runtime, runtime_trace_values, data);
+
     JS_SetRuntimePrivate(runtime, data);
 }
 
 void
 gjs_runtime_deinit(JSRuntime *runtime)
 {
-    g_free(get_data(runtime));
+    GjsRuntimeData *data = get_data(runtime);
+    ValueChunk *chunk, *prev;
+
+    JS_SetExtraGCRootsTracer(runtime, NULL, NULL);
+
+    for (chunk = data->value_stack; chunk != NULL; chunk = prev) {
+        prev = chunk->prev;
+        g_free(chunk);
+    }
+    g_free(data->spare_chunk);
+
+    g_free(data);
 }
@@ -56,4 +56,10 @@ JSContext*  gjs_runtime_get_context          (JSRuntime       *runtime);
 jsid        gjs_runtime_get_const_string     (JSRuntime       *runtime,
                                               GjsConstString   string);
 
+jsval*      gjs_runtime_push_values          (JSRuntime       *runtime,
+                                              guint            n_values);
+void        gjs_runtime_pop_values           (JSRuntime       *runtime,
+                                              jsval           *values,
+                                              guint            n_values);
+
 #endif /* __GJS_RUNTIME_H__ */
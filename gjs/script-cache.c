@@ -0,0 +1,340 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2014  The GJS authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Keeps the bytecode of imported modules on disk, so that they don't
+ * have to be parsed and compiled again on the next startup.
+ *
+ * Each file in $XDG_CACHE_HOME/gjs/scripts/ holds the XDR-encoded
+ * script of one source file. It is named after a checksum of the
+ * source path and of a "build id" identifying the SpiderMonkey and gjs
+ * versions, and starts with a header giving the SHA1 digest of the
+ * source it was compiled from. Anything that doesn't match is
+ * recompiled and overwritten. We don't go by modification times, since
+ * a file edited within the timestamp resolution of its filesystem
+ * would be served stale. SpiderMonkey also refuses to
+ * decode bytecode from a different XDR version, in which case we fall
+ * back to compiling too.
+ *
+ * Set GJS_DISABLE_SCRIPT_CACHE to bypass the cache completely.
+ *
+ * Sources are mapped rather than read, and can also come from a
+ * GResource (resource:// paths), see gjs_script_source_load().
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <errno.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "script-cache.h"
+
+#include <util/log.h>
+
+#define CACHE_MAGIC "GJSXDR2"
+#define SOURCE_DIGEST_LEN 20
+
+typedef struct {
+    char    magic[8];
+    guint8  source_digest[SOURCE_DIGEST_LEN];
+    guint32 data_len;
+} CacheHeader;
+
+static gboolean
+script_cache_enabled(void)
+{
+    static gsize init = 0;
+    static gboolean enabled = FALSE;
+
+    if (g_once_init_enter(&init)) {
+        enabled = g_getenv("GJS_DISABLE_SCRIPT_CACHE") == NULL;
+        g_once_init_leave(&init, 1);
+    }
+
+    return enabled;
+}
+
+static const char *
+get_cache_dir(void)
+{
+    static char *cache_dir = NULL;
+
+    if (g_once_init_enter(&cache_dir)) {
+        char *dir = g_build_filename(g_get_user_cache_dir(),
+                                     "gjs", "scripts", NULL);
+        g_once_init_leave(&cache_dir, dir);
+    }
+
+    return cache_dir;
+}
+
+static const char *
+get_build_id(void)
+{
+    static char *build_id = NULL;
+
+    if (g_once_init_enter(&build_id)) {
+        char *id = g_strdup_printf("%s;gjs-%s;%u;%u",
+                                   JS_GetImplementationVersion(),
+                                   PACKAGE_VERSION,
+                                   (guint) GLIB_SIZEOF_VOID_P,
+                                   (guint) G_BYTE_ORDER);
+        g_once_init_leave(&build_id, id);
+    }
+
+    return build_id;
+}
+
+/**
+ * gjs_script_cache_get_path:
+ * @filename: path of a JS source file
+ *
+ * Returns: (transfer full): where the bytecode cached for @filename is
+ * stored
+ */
+char *
+gjs_script_cache_get_path(const char *filename)
+{
+    char *key, *checksum, *basename, *path;
+
+    key = g_strconcat(get_build_id(), "\n", filename, NULL);
+    checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    basename = g_strconcat(checksum, ".xdr", NULL);
+    path = g_build_filename(get_cache_dir(), basename, NULL);
+
+    g_free(basename);
+    g_free(checksum);
+    g_free(key);
+
+    return path;
+}
+
+static void
+compute_source_digest(const char *source_data,
+                      gsize       source_len,
+                      guint8     *digest)
+{
+    GChecksum *checksum;
+    gsize digest_len = SOURCE_DIGEST_LEN;
+
+    checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    g_checksum_update(checksum, (const guchar *) source_data, source_len);
+    g_checksum_get_digest(checksum, digest, &digest_len);
+    g_checksum_free(checksum);
+}
+
+static JSScript *
+load_cached_script(JSContext    *context,
+                   const char   *cache_path,
+                   const guint8 *source_digest)
+{
+    JSScript *script;
+    CacheHeader header;
+    char *contents;
+    gsize len;
+
+    if (!g_file_get_contents(cache_path, &contents, &len, NULL))
+        return NULL;
+
+    if (len < sizeof(CacheHeader))
+        goto invalid;
+
+    memcpy(&header, contents, sizeof(CacheHeader));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        memcmp(header.source_digest, source_digest, SOURCE_DIGEST_LEN) != 0 ||
+        header.data_len != len - sizeof(CacheHeader))
+        goto invalid;
+
+    script = JS_DecodeScript(context, contents + sizeof(CacheHeader),
+                             header.data_len, NULL, NULL);
+    if (script == NULL) {
+        JS_ClearPendingException(context);
+        goto invalid;
+    }
+
+    g_free(contents);
+    return script;
+
+ invalid:
+    gjs_debug(GJS_DEBUG_IMPORTER, "Discarding stale script cache %s", cache_path);
+    g_free(contents);
+    g_unlink(cache_path);
+    return NULL;
+}
+
+static void
+store_cached_script(JSContext    *context,
+                    JSScript     *script,
+                    const char   *cache_path,
+                    const guint8 *source_digest)
+{
+    CacheHeader header;
+    GError *error = NULL;
+    void *data;
+    uint32_t data_len;
+    char *contents;
+
+    data = JS_EncodeScript(context, script, &data_len);
+    if (data == NULL) {
+        JS_ClearPendingException(context);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.source_digest, source_digest, SOURCE_DIGEST_LEN);
+    header.data_len = data_len;
+
+    contents = g_malloc(sizeof(CacheHeader) + data_len);
+    memcpy(contents, &header, sizeof(CacheHeader));
+    memcpy(contents + sizeof(CacheHeader), data, data_len);
+    JS_free(context, data);
+
+    /* g_file_set_contents() writes to a temporary file and renames it,
+     * so other processes never see a partially written cache file
+     */
+    if (g_mkdir_with_parents(get_cache_dir(), 0700) < 0 ||
+        !g_file_set_contents(cache_path, contents,
+                             sizeof(CacheHeader) + data_len, &error)) {
+        gjs_debug(GJS_DEBUG_IMPORTER, "Failed to write script cache %s: %s",
+                  cache_path, error ? error->message : g_strerror(errno));
+        g_clear_error(&error);
+    }
+
+    g_free(contents);
+}
+
+#define RESOURCE_PREFIX "resource://"
+
+/**
+ * gjs_script_source_load:
+ * @filename: path of a JS source file, or a resource:// URI
+ * @error: return location for a #GError
+ *
+ * Gets at the contents of @filename without reading them into a
+ * malloc'd buffer: files are mapped with #GMappedFile, and resources
+ * point straight into the registered #GResource. A missing resource is
+ * reported as %G_FILE_ERROR_NOENT, like a missing file.
+ *
+ * Returns: (transfer full): the contents, or %NULL with @error set
+ */
+GBytes *
+gjs_script_source_load(const char  *filename,
+                       GError     **error)
+{
+    GMappedFile *mapped;
+    GBytes *bytes;
+
+    if (g_str_has_prefix(filename, RESOURCE_PREFIX)) {
+        GError *local_error = NULL;
+
+        bytes = g_resources_lookup_data(filename + strlen(RESOURCE_PREFIX),
+                                        G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                        &local_error);
+        if (bytes == NULL) {
+            if (g_error_matches(local_error, G_RESOURCE_ERROR,
+                                G_RESOURCE_ERROR_NOT_FOUND)) {
+                g_set_error_literal(error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                                    local_error->message);
+                g_error_free(local_error);
+            } else {
+                g_propagate_error(error, local_error);
+            }
+        }
+        return bytes;
+    }
+
+    mapped = g_mapped_file_new(filename, FALSE, error);
+    if (mapped == NULL)
+        return NULL;
+
+    bytes = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    return bytes;
+}
+
+/**
+ * gjs_script_cache_compile_file:
+ * @context: a #JSContext
+ * @scope: object to compile the script for
+ * @filename: path of the JS source file
+ * @error: return location for a #GError
+ *
+ * Compiles the contents of @filename, using the on-disk bytecode cache
+ * when possible. The result has to be run with JS_ExecuteScript().
+ *
+ * Returns: the compiled script, or %NULL. If the file can't be read,
+ * @error is set; if it doesn't compile, an exception is pending.
+ */
+JSScript *
+gjs_script_cache_compile_file(JSContext   *context,
+                              JSObject    *scope,
+                              const char  *filename,
+                              GError     **error)
+{
+    JSScript *script;
+    char *cache_path = NULL;
+    guint8 source_digest[SOURCE_DIGEST_LEN];
+    GBytes *source;
+    const char *source_data;
+    gsize source_len;
+
+    source = gjs_script_source_load(filename, error);
+    if (source == NULL)
+        return NULL;
+
+    /* the data of an empty mapping is NULL */
+    source_data = g_bytes_get_data(source, &source_len);
+    if (source_data == NULL)
+        source_data = "";
+
+    /* Only files on disk are cached, not resources */
+    if (script_cache_enabled() &&
+        !g_str_has_prefix(filename, RESOURCE_PREFIX)) {
+        compute_source_digest(source_data, source_len, source_digest);
+        cache_path = gjs_script_cache_get_path(filename);
+
+        script = load_cached_script(context, cache_path, source_digest);
+        if (script != NULL) {
+            gjs_debug(GJS_DEBUG_IMPORTER, "Loaded %s from script cache",
+                      filename);
+            g_bytes_unref(source);
+            g_free(cache_path);
+            return script;
+        }
+    }
+
+    script = JS_CompileScript(context, scope, source_data, source_len,
+                              filename, 1);
+    g_bytes_unref(source);
+
+    if (script != NULL && cache_path != NULL)
+        store_cached_script(context, script, cache_path, source_digest);
+
+    g_free(cache_path);
+
+    return script;
+}
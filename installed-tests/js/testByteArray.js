@@ -4,6 +4,7 @@
 const JSUnit = imports.jsUnit;
 const ByteArray = imports.byteArray;
 const Gio = imports.gi.Gio;
+const Lang = imports.lang;
 
 function testEmptyByteArray() {
     let a = new ByteArray.ByteArray();
@@ -118,5 +119,179 @@ function testToString() {
     JSUnit.assertEquals("toString() gives 'abcd'", "abcd", s);
 }
 
+function testSliceAndSubarray() {
+    let a = ByteArray.fromArray([ 1, 2, 3, 4, 5 ]);
+
+    let b = a.slice(1, -1);
+    JSUnit.assertEquals("slice(1, -1) has length 3", 3, b.length);
+    JSUnit.assertEquals("b[0] == 2", 2, b[0]);
+    JSUnit.assertEquals("b[2] == 4", 4, b[2]);
+
+    let c = a.subarray(2);
+    JSUnit.assertEquals("subarray(2) has length 3", 3, c.length);
+    JSUnit.assertEquals("c[0] == 3", 3, c[0]);
+
+    c[0] = 42;
+    JSUnit.assertEquals("writing to a subarray doesn't change the original", 3, a[2]);
+    a[3] = 42;
+    JSUnit.assertEquals("writing to the original doesn't change a subarray", 4, c[1]);
+}
+
+function testSetFillConcat() {
+    let a = new ByteArray.ByteArray(4);
+    a.fill(7);
+    JSUnit.assertEquals("fill() sets every byte", 7, a[3]);
+
+    a.set([ 1, 2 ], 1);
+    JSUnit.assertEquals("set() copies to offset", 1, a[1]);
+    JSUnit.assertEquals("set() copies to offset", 2, a[2]);
+
+    a.set(ByteArray.fromArray([ 8, 9 ]), 3);
+    JSUnit.assertEquals("set() past the end grows the array", 5, a.length);
+    JSUnit.assertEquals("a[4] == 9", 9, a[4]);
+
+    let b = a.concat([ 10 ], ByteArray.fromString("a"));
+    JSUnit.assertEquals("concat() appends each argument", 7, b.length);
+    JSUnit.assertEquals("b[5] == 10", 10, b[5]);
+    JSUnit.assertEquals("b[6] == 97", 97, b[6]);
+}
+
+function testGrowingZeroesGap() {
+    // After a round trip through GBytes, the array is no longer one
+    // that clears new bytes by itself
+    let a = ByteArray.fromArray([ 1, 2 ]);
+    a.toGBytes();
+
+    a.set([ 5 ], 4096);
+    JSUnit.assertEquals("set() past the end grows the array", 4097, a.length);
+    a.writeUInt32LE(0x01020304, 8192);
+    JSUnit.assertEquals("write past the end grows the array", 8196, a.length);
+
+    for (let i = 2; i < 8192; i++) {
+        if (i != 4096)
+            JSUnit.assertEquals("gap byte " + i + " is zero", 0, a[i]);
+    }
+
+    let b = ByteArray.fromArray([ 1, 2, 3 ]);
+    b.set(b, 2);
+    JSUnit.assertEquals("set() from itself grows the array", 5, b.length);
+    JSUnit.assertEquals("b[2] == 1", 1, b[2]);
+    JSUnit.assertEquals("b[4] == 3", 3, b[4]);
+}
+
+function testIndexOf() {
+    let a = ByteArray.fromString("GET / HTTP/1.1\r\nHost: x\r\n");
+
+    JSUnit.assertEquals("indexOf() finds a byte", 3, a.indexOf(32));
+    JSUnit.assertEquals("indexOf() finds a string", 14, a.indexOf("\r\n"));
+    JSUnit.assertEquals("indexOf() honors fromIndex", 23, a.indexOf("\r\n", 15));
+    JSUnit.assertEquals("indexOf() finds a byte sequence", 6, a.indexOf([ 72, 84 ]));
+    JSUnit.assertEquals("indexOf() returns -1 if not found", -1, a.indexOf("xyz"));
+}
+
+function testEndianAccessors() {
+    let a = new ByteArray.ByteArray();
+
+    JSUnit.assertEquals("write returns the next offset", 2, a.writeUInt16BE(0x0102, 0));
+    a.writeInt32LE(-2, 2);
+    JSUnit.assertEquals("big endian byte order", 1, a[0]);
+    JSUnit.assertEquals("big endian byte order", 2, a[1]);
+    JSUnit.assertEquals("readUInt16LE", 0x0201, a.readUInt16LE(0));
+    JSUnit.assertEquals("readInt32LE", -2, a.readInt32LE(2));
+    JSUnit.assertEquals("readUInt32LE", 0xfffffffe, a.readUInt32LE(2));
+    JSUnit.assertEquals("readInt8", -2, a.readInt8(2));
+
+    JSUnit.assertRaises(function() { a.readUInt32BE(4); });
+    JSUnit.assertRaises(function() { a.writeUInt16LE(65536, 0); });
+}
+
+function testOffsetsNearLimit() {
+    let a = ByteArray.fromArray([ 1, 2 ]);
+
+    function assertRangeError(func) {
+        try {
+            func();
+        } catch (e) {
+            JSUnit.assertTrue(e instanceof RangeError);
+            return;
+        }
+        JSUnit.fail("expected a RangeError");
+    }
+
+    // offset + size doesn't fit in 32 bits
+    assertRangeError(function() { a.writeUInt16LE(0, 4294967295); });
+    assertRangeError(function() { a.writeUInt32BE(0, 4294967294); });
+    assertRangeError(function() { a.writeInt8(0, 4294967295); });
+    assertRangeError(function() { a.set([ 5, 6 ], 4294967295); });
+    assertRangeError(function() { a.set(a, 4294967294); });
+
+    JSUnit.assertEquals("failed writes leave the array alone", 2, a.length);
+    JSUnit.assertEquals("a[0] == 1", 1, a[0]);
+    JSUnit.assertEquals("a[1] == 2", 2, a[1]);
+}
+
+// Takes one byte per write, so that write_all() goes back to its
+// buffer after each call into JS
+const ByteAtATimeStream = new Lang.Class({
+    Name: 'ByteAtATimeStream',
+    Extends: Gio.OutputStream,
+
+    _init: function(onWrite) {
+        this.parent();
+        this._onWrite = onWrite;
+        this.written = [];
+    },
+
+    vfunc_write_fn: function(buffer, cancellable) {
+        this.written.push(buffer[0]);
+        this._onWrite();
+        return 1;
+    }
+});
+
+function testChangedDuringCall() {
+    let a = ByteArray.fromArray([ 1, 2, 3, 4 ]);
+    let stream = new ByteAtATimeStream(function() {
+        // Reallocates the data, and writes over a byte not written yet
+        a.length = 65536;
+        a[2] = 99;
+    });
+
+    stream.write_all(a, null);
+
+    JSUnit.assertEquals("C sees the data as it was passed", 4, stream.written.length);
+    for (let i = 0; i < 4; i++)
+        JSUnit.assertEquals("written[" + i + "]", i + 1, stream.written[i]);
+    JSUnit.assertEquals("the ByteArray itself changed", 99, a[2]);
+    JSUnit.assertEquals("the ByteArray itself grew", 65536, a.length);
+}
+
+function testDecoder() {
+    let decoder = new ByteArray.Decoder('UTF-8');
+
+    JSUnit.assertEquals("ASCII chunk", "abc", decoder.decode(ByteArray.fromString("abc")));
+
+    // U+2665 is 0xe2 0x99 0xa5, split across two chunks
+    JSUnit.assertEquals("first half of a character is held back", "a",
+                        decoder.decode([ 97, 0xe2, 0x99 ], { stream: true }));
+    JSUnit.assertEquals("second half completes it", "\u2665b",
+                        decoder.decode([ 0xa5, 98 ], { stream: true }));
+
+    decoder.decode([ 0xe2 ], { stream: true });
+    JSUnit.assertRaises(function() { decoder.decode(); });
+    JSUnit.assertEquals("decoder is usable after an error", "x", decoder.decode([ 120 ]));
+
+    let latin1 = new ByteArray.Decoder('ISO-8859-1');
+    JSUnit.assertEquals("non UTF-8 encoding", "caf\u00e9", latin1.decode([ 99, 97, 102, 0xe9 ]));
+
+    // ESC $ B switches ISO-2022-JP to JIS X 0208, where 0x30 0x21 is U+4E9C.
+    // The input ends without switching back, which a final chunk must undo.
+    let jis = new ByteArray.Decoder('ISO-2022-JP');
+    JSUnit.assertEquals("stateful encoding", "\u4e9c",
+                        jis.decode([ 0x1b, 0x24, 0x42, 0x30, 0x21 ]));
+    JSUnit.assertEquals("shift state is reset after a final chunk", "0!",
+                        jis.decode([ 0x30, 0x21 ]));
+}
+
 JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
 
@@ -215,6 +215,23 @@ function testCallback() {
     JSUnit.assertRaises('CallbackUndefined', function () { Everything.test_callback(undefined) });
 }
 
+function testFailedReturnConversionInCallback() {
+    // g_utf8_get_char_validated() returns (gunichar) -2 for an empty
+    // range, which can't be converted to a string
+    let callback = function() {
+        JSUnit.assertRaises(function() {
+            GLib.utf8_get_char_validated('a', 0);
+        });
+        return 42;
+    };
+
+    // Returning from the callback must not trip over values left
+    // behind by the failed call
+    JSUnit.assertEquals(42, Everything.test_callback(callback));
+    JSUnit.assertEquals(42, Everything.test_callback(callback));
+    JSUnit.assertEquals('a', GLib.utf8_get_char_validated('a', -1));
+}
+
 function testArrayCallback() {
     function arrayEqual(ref, one) {
         JSUnit.assertEquals(ref.length, one.length);
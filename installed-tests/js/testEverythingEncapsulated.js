@@ -67,6 +67,15 @@ function testSimpleBoxed() {
     JSUnit.assertEquals(43, simple_boxed.some_int8);
     JSUnit.assertEquals(42.5, simple_boxed.some_double);
     JSUnit.assertEquals(Everything.TestEnum.VALUE3, simple_boxed.some_enum);
+
+    // Values that aren't plain numbers still get converted
+    simple_boxed.some_int8 = '45';
+    JSUnit.assertEquals(45, simple_boxed.some_int8);
+    simple_boxed.some_double = 7;
+    JSUnit.assertEquals(7, simple_boxed.some_double);
+    JSUnit.assertRaises(function() {
+        simple_boxed.some_int8 = 1000;
+    });
 }
 
 function testBoxedCopyConstructor()
@@ -87,6 +96,20 @@ function testBoxedCopyConstructor()
         let t = new Everything.TestSimpleBoxedA({ junk: 42 });
     });
 
+    // Hashes with the same fields as a previous one, in the same or in
+    // a different order, or with an extra bad field
+    for (let i = 0; i < 3; i++) {
+        let b = new Everything.TestSimpleBoxedA({ some_int: i, some_int8: i + 1 });
+        JSUnit.assertEquals(i, b.some_int);
+        JSUnit.assertEquals(i + 1, b.some_int8);
+    }
+    let reordered = new Everything.TestSimpleBoxedA({ some_int8: 5, some_int: 6 });
+    JSUnit.assertEquals(5, reordered.some_int8);
+    JSUnit.assertEquals(6, reordered.some_int);
+    JSUnit.assertRaises(function() {
+        let t = new Everything.TestSimpleBoxedA({ some_int: 1, some_int8: 2, junk: 3 });
+    });
+
     // Copy an object from another object of the same type, shortcuts to the boxed copy
     let copy = new Everything.TestSimpleBoxedA(simple_boxed);
 
@@ -106,6 +129,10 @@ function testNestedSimpleBoxed() {
     JSUnit.assertEquals(42, simple_boxed.some_int8);
     JSUnit.assertEquals(43, simple_boxed.nested_a.some_int);
 
+    // Nested structs are wrapped only once per parent
+    let nested = simple_boxed.nested_a;
+    JSUnit.assertTrue(nested === simple_boxed.nested_a);
+
     // Try assigning the nested struct field from an instance
     simple_boxed.nested_a = new Everything.TestSimpleBoxedA({ some_int: 53 });
     JSUnit.assertEquals(53, simple_boxed.nested_a.some_int);
@@ -113,6 +140,7 @@ function testNestedSimpleBoxed() {
     // And directly from a hash of field values
     simple_boxed.nested_a = { some_int: 63 };
     JSUnit.assertEquals(63, simple_boxed.nested_a.some_int);
+    JSUnit.assertEquals(63, nested.some_int);
 
     // Try constructing with a nested hash of field values
     let simple2 = new Everything.TestSimpleBoxedB({
@@ -189,5 +217,72 @@ function testVariantConstructor() {
     JSUnit.assertEquals(2, unpacked[4].length);
 }
 
+function testVariantDictionary() {
+    let dict_variant = new GLib.Variant('a{sv}',
+                                        { name: new GLib.Variant('s', 'gjs'),
+                                          count: new GLib.Variant('u', 42) });
+    JSUnit.assertEquals(2, dict_variant.n_children());
+
+    let unpacked = dict_variant.unpack();
+    JSUnit.assertTrue(unpacked.name instanceof GLib.Variant);
+    JSUnit.assertEquals('gjs', unpacked.name.unpack());
+    JSUnit.assertEquals(42, unpacked.count.unpack());
+
+    let rows = new GLib.Variant('a(iiss)', [ [ 1, -2, 'a', 'b' ],
+                                             [ 3, 4, 'c', 'd' ] ]);
+    let deep = rows.deep_unpack();
+    JSUnit.assertEquals(2, deep.length);
+    JSUnit.assertEquals(-2, deep[0][1]);
+    JSUnit.assertEquals('d', deep[1][3]);
+}
+
+function testVariantFixedArrays() {
+    let ints = new GLib.Variant('ai', [ 1, 2, -3 ]);
+    JSUnit.assertEquals(3, ints.n_children());
+    JSUnit.assertEquals(-3, ints.deep_unpack()[2]);
+    JSUnit.assertTrue(ints.unpack()[0] instanceof GLib.Variant);
+
+    let typed = new GLib.Variant('ad', new Float64Array([ 0.5, 1.5 ]));
+    JSUnit.assertEquals(1.5, typed.deep_unpack()[1]);
+
+    let bytes = new GLib.Variant('ay', [ 104, 105 ]);
+    JSUnit.assertEquals('hi', bytes.deep_unpack().toString());
+
+    JSUnit.assertRaises(function() {
+        return new GLib.Variant('ay', [ 256 ]);
+    });
+}
+
+function testVariantMaybe() {
+    JSUnit.assertEquals(null, new GLib.Variant('mi', null).deep_unpack());
+    JSUnit.assertEquals(5, new GLib.Variant('mi', 5).deep_unpack());
+}
+
+function testVariantInvalidSignature() {
+    JSUnit.assertRaises(function() {
+        return new GLib.Variant('ii', [ 1, 2 ]);
+    });
+    JSUnit.assertRaises(function() {
+        return new GLib.Variant('(ii', [ 1, 2 ]);
+    });
+    JSUnit.assertRaises(function() {
+        return new GLib.Variant('(ii)', [ 1 ]);
+    });
+}
+
+function testVariantIntegerRange() {
+    JSUnit.assertEquals(-32768, new GLib.Variant('n', -32768).unpack());
+    JSUnit.assertEquals(4294967295, new GLib.Variant('u', 4294967295).unpack());
+
+    JSUnit.assertRaises(function() { return new GLib.Variant('n', 32768); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('n', -70000); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('y', 4294967297); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('i', NaN); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('x', Math.pow(2, 63)); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('t', Math.pow(2, 64)); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('t', NaN); });
+    JSUnit.assertRaises(function() { return new GLib.Variant('at', [ 1, -1 ]); });
+}
+
 JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
 
@@ -74,6 +74,7 @@ var TestIface = <interface name="org.gnome.gjs.Test">
 <method name="structArray">
     <arg type="a(ii)" direction="out"/>
 </method>
+<method name="emitPropertyChanges"/>
 <signal name="signalFoo">
     <arg type="s" direction="out"/>
 </signal>
@@ -205,6 +206,16 @@ Test.prototype = {
 
     structArray: function () {
         return [[128, 123456], [42, 654321]];
+    },
+
+    emitPropertyChanges: function() {
+        this._impl.set_property_invalidate_only('PropReadOnly', true);
+        this._impl.queuePropertyChanged('PropReadOnly', true);
+
+        this._propReadWrite = 'first';
+        this._impl.queuePropertyChanged('PropReadWrite', this.PropReadWrite);
+        this._propReadWrite = 'second';
+        this._impl.queuePropertyChanged('PropReadWrite', this.PropReadWrite);
     }
 };
 
@@ -557,6 +568,28 @@ function testDictSignatures() {
     JSUnit.assertEquals(10.0, theResult['aDouble'].deep_unpack());
 }
 
+function testBatchedPropertyChanges() {
+    let emissions = 0, changed, invalidated;
+    let id = proxy.connect('g-properties-changed', function(proxy, changedProps, invalidatedProps) {
+        emissions++;
+        changed = changedProps.deep_unpack();
+        invalidated = invalidatedProps;
+        Mainloop.quit('testGDBus');
+    });
+
+    proxy.emitPropertyChangesRemote(function(result, excp) { });
+    Mainloop.run('testGDBus');
+    proxy.disconnect(id);
+
+    // Both changes of PropReadWrite went out in the same signal as the
+    // invalidation of PropReadOnly, and only the last value was sent
+    JSUnit.assertEquals(1, emissions);
+    JSUnit.assertEquals(1, Object.keys(changed).length);
+    JSUnit.assertEquals('second', changed.PropReadWrite.deep_unpack().deep_unpack());
+    JSUnit.assertEquals(1, invalidated.length);
+    JSUnit.assertEquals('PropReadOnly', invalidated[0]);
+}
+
 function testFinalize() {
     // Not really needed, but if we don't cleanup
     // memory checking will complain
@@ -113,6 +113,12 @@ function testCArray() {
     GIMarshallingTests.array_in_len_zero_terminated(array);
     GIMarshallingTests.array_in_guint64_len(array);
     GIMarshallingTests.array_in_guint8_len(array);
+
+    // Typed arrays are copied straight into the C array
+    array = new Int32Array([-1, 0, 1, 2]);
+    GIMarshallingTests.array_in(array);
+    GIMarshallingTests.array_in_len_zero_terminated(array);
+    GIMarshallingTests.array_uint8_in(new Uint8Array([97, 98, 99, 100]), 4);
 }
 
 function testGArray() {
@@ -206,6 +212,14 @@ function testGBytes() {
     assertRaises(function() {
 	GIMarshallingTests.array_uint8_in(bytes);
     });
+
+    // Writes to a ByteArray don't show up in GBytes sharing its data
+    array = imports.byteArray.fromArray([97, 98, 99, 100]);
+    bytes = array.toGBytes();
+    array[0] = 42;
+    assertEquals(42, array[0]);
+    assertEquals(97, bytes.toArray()[0]);
+    GIMarshallingTests.array_uint8_in(bytes.toArray());
 }
 
 function testPtrArray() {
@@ -237,6 +237,30 @@ function testSignals() {
 
     JSUnit.assertEquals(1, stack[0]);
     JSUnit.assertEquals(2, stack[1]);
+
+    // Repeated emissions go through the cached signal lookup
+    args = [ ];
+    for (let i = 0; i < 3; i++)
+        myInstance.emit_minimal(i, i + 1);
+    JSUnit.assertEquals(8, args.length);
+    JSUnit.assertEquals(2, args[6]);
+    JSUnit.assertEquals(3, args[7]);
+
+    let details = [ ];
+    myInstance.connect('detailed::two', function(emitter, s) {
+        details.push(s);
+    });
+    myInstance.emit('detailed::one', 'a');
+    myInstance.emit('detailed::two', 'b');
+    myInstance.emit('detailed::two', 'c');
+    JSUnit.assertEquals('b,c', details.join());
+
+    JSUnit.assertRaises(function() {
+        myInstance.emit('minimal', 1);
+    });
+    JSUnit.assertRaises(function() {
+        myInstance.connect('no-such-signal', function() {});
+    });
 }
 
 function testSubclass() {
@@ -0,0 +1,79 @@
+// application/javascript;version=1.8 -*- mode: js; indent-tabs-mode: nil -*-
+
+// GObject properties of introspected classes. "make check" runs this
+// a second time with GJS_ENABLE_PROPERTY_ACCESSORS set, where they are
+// accessors on the prototypes rather than class hooks, and the results
+// must be the same.
+
+const JSUnit = imports.jsUnit;
+const GLib = imports.gi.GLib;
+const Gio = imports.gi.Gio;
+
+function testGet() {
+    let action = new Gio.SimpleAction({ name: 'action',
+                                        parameter_type: new GLib.VariantType('s') });
+
+    JSUnit.assertEquals('action', action.name);
+    JSUnit.assertEquals(true, action.enabled);
+    JSUnit.assertEquals('s', action.parameter_type.dup_string());
+    JSUnit.assertEquals('s', action['parameter-type'].dup_string());
+    JSUnit.assertEquals('s', action.parameterType.dup_string());
+}
+
+function testGetInherited() {
+    let base = new Gio.MemoryInputStream();
+    let stream = new Gio.BufferedInputStream({ base_stream: base,
+                                               buffer_size: 64 });
+
+    JSUnit.assertEquals(64, stream.buffer_size);
+    JSUnit.assertEquals(64, stream.bufferSize);
+    // Installed by Gio.FilterInputStream
+    JSUnit.assertEquals(base, stream.base_stream);
+    JSUnit.assertEquals(true, stream.close_base_stream);
+}
+
+function testSet() {
+    let action = new Gio.SimpleAction({ name: 'action' });
+    let notified = 0;
+
+    action.connect('notify::enabled', function() { notified++; });
+
+    action.enabled = false;
+    JSUnit.assertEquals(false, action.get_enabled());
+    JSUnit.assertEquals(false, action.enabled);
+    JSUnit.assertEquals(1, notified);
+
+    action['enabled'] = true;
+    JSUnit.assertEquals(true, action.get_enabled());
+    JSUnit.assertEquals(2, notified);
+}
+
+function testNotWritable() {
+    let action = new Gio.SimpleAction({ name: 'action',
+                                        parameter_type: new GLib.VariantType('s') });
+
+    // state-type is read-only
+    JSUnit.assertRaises(function() {
+        action.state_type = new GLib.VariantType('i');
+    });
+    JSUnit.assertRaises(function() {
+        action.stateType = new GLib.VariantType('i');
+    });
+    JSUnit.assertEquals(null, action.state_type);
+}
+
+function testPlainProperties() {
+    let action = new Gio.SimpleAction({ name: 'action' });
+
+    action.foo = 42;
+    JSUnit.assertEquals(42, action.foo);
+    JSUnit.assertEquals('function', typeof action.activate);
+
+    // Accessors on the prototype are shared, values are not
+    let other = new Gio.SimpleAction({ name: 'other' });
+    JSUnit.assertEquals('other', other.name);
+    JSUnit.assertEquals('action', action.name);
+    JSUnit.assertEquals(undefined, other.foo);
+}
+
+JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
@@ -15,5 +15,28 @@ function testVersion() {
     JSUnit.assert(System.version >= 13600);
 }
 
+function testGcHint() {
+    System.gcHint('paint-begin');
+    System.gcHint('paint-end');
+    System.gcHint('idle');
+
+    JSUnit.assertRaises(function() { System.gcHint('nap'); });
+}
+
+function testGcStats() {
+    let before = System.gcStats();
+    System.gc();
+    let after = System.gcStats();
+
+    JSUnit.assert(after.cycles > before.cycles);
+    JSUnit.assert(after.slices > before.slices);
+    JSUnit.assert(after.maxPause >= 0);
+
+    let total = 0;
+    for (let i = 0; i < after.pauseHistogram.length; i++)
+        total += after.pauseHistogram[i];
+    JSUnit.assertEquals(after.slices, total);
+}
+
 JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
 
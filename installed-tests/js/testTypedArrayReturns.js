@@ -0,0 +1,52 @@
+// application/javascript;version=1.8
+
+// Numeric C arrays come back as typed arrays when
+// GJS_RETURN_TYPED_ARRAYS is set, and as JS arrays otherwise. "make
+// check" runs this in both modes.
+
+const JSUnit = imports.jsUnit;
+const GLib = imports.gi.GLib;
+const GIMarshallingTests = imports.gi.GIMarshallingTests;
+
+const typedArrays = GLib.getenv('GJS_RETURN_TYPED_ARRAYS') != null;
+
+function assertArray(expectedType, expected, got) {
+    if (typedArrays)
+        JSUnit.assertTrue(got instanceof expectedType);
+    else
+        JSUnit.assertTrue(got instanceof Array);
+
+    JSUnit.assertEquals(expected.length, got.length);
+    for (let i = 0; i < expected.length; i++)
+        JSUnit.assertEquals(expected[i], got[i]);
+}
+
+function testCArrayWithLength() {
+    assertArray(Int32Array, [ -1, 0, 1, 2 ], GIMarshallingTests.array_return());
+}
+
+function testFixedSizeCArray() {
+    assertArray(Int32Array, [ -1, 0, 1, 2 ], GIMarshallingTests.array_fixed_int_return());
+    assertArray(Int16Array, [ -1, 0, 1, 2 ], GIMarshallingTests.array_fixed_short_return());
+}
+
+function testGArray() {
+    assertArray(Int32Array, [ -1, 0, 1, 2 ], GIMarshallingTests.garray_int_none_return());
+}
+
+function testReturnedArrayIsACopy() {
+    let first = GIMarshallingTests.array_fixed_int_return();
+    first[0] = 42;
+
+    let second = GIMarshallingTests.array_fixed_int_return();
+    JSUnit.assertEquals(-1, second[0]);
+}
+
+function testUnchangedTypes() {
+    // Arrays of non-numeric elements are never typed arrays
+    let strings = GIMarshallingTests.array_zero_terminated_return();
+    JSUnit.assertTrue(strings instanceof Array);
+    JSUnit.assertEquals('0', strings[0]);
+}
+
+JSUnit.gjstestRun(this, JSUnit.setUp, JSUnit.tearDown);
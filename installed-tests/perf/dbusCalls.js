@@ -0,0 +1,131 @@
+// application/javascript;version=1.8
+
+// Benchmark for D-Bus method calls to an object exported with
+// Gio.DBusExportedObject.wrapJSObject(), going through a real
+// dbus-daemon. Both the service and the proxy live in this process.
+//
+// It needs a session bus; test/run-with-dbus can start a private one.
+// Run it once normally and once with GJS_DISABLE_DBUS_DIRECT_DISPATCH=1
+// set in the environment to compare direct dispatch with the
+// handle-method-call signal:
+//
+//   TOP_SRCDIR=. BUILDDIR=. test/run-with-dbus --session \
+//       gjs installed-tests/perf/dbusCalls.js
+//   GJS_DISABLE_DBUS_DIRECT_DISPATCH=1 TOP_SRCDIR=. BUILDDIR=. \
+//       test/run-with-dbus --session gjs installed-tests/perf/dbusCalls.js
+//
+// run-with-dbus sends stderr to a log file, the results go to stdout.
+
+const Gio = imports.gi.Gio;
+const GLib = imports.gi.GLib;
+const Mainloop = imports.mainloop;
+
+const ITERATIONS = 20000;
+const WARMUP = 1000;
+
+const BenchIface = '<interface name="org.gnome.gjs.Bench"> \
+<method name="echo"> \
+    <arg type="i" direction="in"/> \
+    <arg type="s" direction="in"/> \
+    <arg type="i" direction="out"/> \
+    <arg type="s" direction="out"/> \
+</method> \
+<method name="lookup"> \
+    <arg type="a{sv}" direction="in"/> \
+    <arg type="a(iiss)" direction="out"/> \
+</method> \
+</interface>';
+
+const BenchService = {
+    echo: function(i, s) {
+        return [i, s];
+    },
+
+    lookup: function(query) {
+        let rows = [];
+        for (let i = 0; i < 8; i++)
+            rows.push([i, query.limit.unpack(), 'name' + i, 'value']);
+        return rows;
+    }
+};
+
+function percentile(sorted, p) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+// Issues the calls one after the other, so that each latency is the
+// time of a single round trip
+function runSequential(name, call, iterations, onDone) {
+    let latencies = [];
+    let i = 0;
+    let start = GLib.get_monotonic_time();
+    let callStart;
+
+    function next() {
+        if (i == iterations) {
+            let elapsed = GLib.get_monotonic_time() - start;
+            onDone(name, iterations, elapsed, latencies);
+            return;
+        }
+
+        callStart = GLib.get_monotonic_time();
+        call(i++, function(result, excp) {
+            if (excp)
+                throw excp;
+            latencies.push(GLib.get_monotonic_time() - callStart);
+            next();
+        });
+    }
+
+    next();
+}
+
+function report(name, iterations, elapsed, latencies) {
+    latencies.sort(function(a, b) { return a - b; });
+    print(name + ': ' +
+          Math.round(iterations / (elapsed / 1000000)) + ' calls/sec, ' +
+          'p50 ' + percentile(latencies, 0.50) + ' us, ' +
+          'p99 ' + percentile(latencies, 0.99) + ' us');
+}
+
+let bus = Gio.DBus.session;
+let impl = Gio.DBusExportedObject.wrapJSObject(BenchIface, BenchService);
+impl.export(bus, '/org/gnome/gjs/Bench');
+
+let BenchProxy = Gio.DBusProxy.makeProxyWrapper(BenchIface);
+let proxy = new BenchProxy(bus, bus.get_unique_name(), '/org/gnome/gjs/Bench');
+
+let direct = GLib.getenv('GJS_DISABLE_DBUS_DIRECT_DISPATCH') === null;
+print('dispatch: ' + (direct ? 'direct' : 'handle-method-call signal'));
+
+let benchmarks = [
+    { name: 'echo(is)',
+      call: function(i, callback) {
+          proxy.echoRemote(i, 'hello', callback);
+      } },
+    { name: 'lookup(a{sv}) -> a(iiss)',
+      call: function(i, callback) {
+          proxy.lookupRemote({ limit: new GLib.Variant('i', i) }, callback);
+      } }
+];
+
+function runBenchmark(index) {
+    if (index == benchmarks.length) {
+        Mainloop.quit('dbusCalls');
+        return;
+    }
+
+    let benchmark = benchmarks[index];
+    runSequential(benchmark.name, benchmark.call, WARMUP, function() {
+        runSequential(benchmark.name, benchmark.call, ITERATIONS,
+                      function(name, iterations, elapsed, latencies) {
+                          report(name, iterations, elapsed, latencies);
+                          runBenchmark(index + 1);
+                      });
+    });
+}
+
+runBenchmark(0);
+Mainloop.run('dbusCalls');
+
+impl.unexport();
@@ -21,13 +21,32 @@ enum {
 
 static guint signals[SIGNAL_LAST];
 
+#define EMITS_CHANGED_SIGNAL_ANNOTATION "org.freedesktop.DBus.Property.EmitsChangedSignal"
+
+/* How a property shows up in PropertiesChanged, as given by the
+ * EmitsChangedSignal annotation */
+typedef enum {
+    PROPERTY_EMITS_VALUE,
+    PROPERTY_EMITS_INVALIDATION,
+    PROPERTY_EMITS_NOTHING
+} PropertyEmitMode;
+
 struct _GjsDBusImplementationPrivate {
     GDBusInterfaceVTable  vtable;
     GDBusInterfaceInfo   *ifaceinfo;
 
-    // from gchar* to GVariant*
+    // from gchar* to GVariant*, NULL for invalidated properties
     GHashTable           *outstanding_properties;
     guint                 idle_id;
+    guint                 flush_delay;
+
+    // from gchar* to PropertyEmitMode, for the properties that don't
+    // emit their value
+    GHashTable           *property_modes;
+
+    GjsDBusMethodDispatchFunc dispatch_func;
+    gpointer                  dispatch_data;
+    GDestroyNotify            dispatch_notify;
 };
 
 G_DEFINE_TYPE(GjsDBusImplementation, gjs_dbus_implementation, G_TYPE_DBUS_INTERFACE_SKELETON)
@@ -44,6 +63,11 @@ gjs_dbus_implementation_method_call(GDBusConnection       *connection,
 {
     GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (user_data);
 
+    if (self->priv->dispatch_func != NULL &&
+        self->priv->dispatch_func(self, method_name, parameters, invocation,
+                                  self->priv->dispatch_data))
+        return;
+
     g_signal_emit(self, signals[SIGNAL_HANDLE_METHOD], 0, method_name, parameters, invocation);
 }
 
@@ -86,6 +110,14 @@ gjs_dbus_implementation_property_set(GDBusConnection       *connection,
     return TRUE;
 }
 
+/* Invalidated properties are queued with a NULL value */
+static void
+outstanding_property_free(gpointer value)
+{
+    if (value != NULL)
+        g_variant_unref(value);
+}
+
 static void
 gjs_dbus_implementation_init(GjsDBusImplementation *self) {
     GjsDBusImplementationPrivate *priv = G_TYPE_INSTANCE_GET_PRIVATE (self, GJS_TYPE_DBUS_IMPLEMENTATION, GjsDBusImplementationPrivate);
@@ -96,19 +128,73 @@ gjs_dbus_implementation_init(GjsDBusImplementation *self) {
     priv->vtable.get_property = gjs_dbus_implementation_property_get;
     priv->vtable.set_property = gjs_dbus_implementation_property_set;
 
-    priv->outstanding_properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+    priv->outstanding_properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, outstanding_property_free);
+    priv->property_modes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
 gjs_dbus_implementation_finalize(GObject *object) {
     GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (object);
 
+    gjs_dbus_implementation_set_method_dispatch(self, NULL, NULL, NULL);
+
+    if (self->priv->idle_id)
+        g_source_remove (self->priv->idle_id);
+
     g_dbus_interface_info_unref (self->priv->ifaceinfo);
     g_hash_table_unref (self->priv->outstanding_properties);
+    g_hash_table_unref (self->priv->property_modes);
 
     G_OBJECT_CLASS(gjs_dbus_implementation_parent_class)->finalize(object);
 }
 
+static PropertyEmitMode
+parse_emit_mode(GDBusAnnotationInfo **annotations,
+                PropertyEmitMode      default_mode)
+{
+    const char *value;
+
+    value = g_dbus_annotation_info_lookup(annotations, EMITS_CHANGED_SIGNAL_ANNOTATION);
+    if (value == NULL)
+        return default_mode;
+
+    if (strcmp(value, "invalidates") == 0)
+        return PROPERTY_EMITS_INVALIDATION;
+    if (strcmp(value, "const") == 0 || strcmp(value, "false") == 0)
+        return PROPERTY_EMITS_NOTHING;
+
+    return PROPERTY_EMITS_VALUE;
+}
+
+static void
+load_property_modes(GjsDBusImplementation *self)
+{
+    GDBusInterfaceInfo *info = self->priv->ifaceinfo;
+    GDBusPropertyInfo **props;
+    PropertyEmitMode interface_mode;
+
+    if (info == NULL || info->properties == NULL)
+        return;
+
+    /* The annotation on the interface is the default for its properties */
+    interface_mode = parse_emit_mode(info->annotations, PROPERTY_EMITS_VALUE);
+
+    for (props = info->properties; *props; ++props) {
+        PropertyEmitMode mode = parse_emit_mode((*props)->annotations, interface_mode);
+
+        if (mode != PROPERTY_EMITS_VALUE)
+            g_hash_table_replace(self->priv->property_modes,
+                                 g_strdup((*props)->name), GINT_TO_POINTER(mode));
+    }
+}
+
+static PropertyEmitMode
+get_emit_mode(GjsDBusImplementation *self,
+              const char            *property)
+{
+    return GPOINTER_TO_INT(g_hash_table_lookup(self->priv->property_modes, property));
+}
+
 static void
 gjs_dbus_implementation_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
 {
@@ -117,6 +203,7 @@ gjs_dbus_implementation_set_property(GObject *object, guint property_id, const G
     switch (property_id) {
     case PROP_G_INTERFACE_INFO:
         self->priv->ifaceinfo = g_value_dup_boxed (value);
+        load_property_modes(self);
         break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -173,6 +260,20 @@ gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
     GHashTableIter iter;
     GVariant *val;
     gchar *prop_name;
+    GDBusConnection *connection;
+
+    if (self->priv->idle_id) {
+        g_source_remove(self->priv->idle_id);
+        self->priv->idle_id = 0;
+    }
+
+    /* Nothing to send, or nobody to send it to */
+    connection = g_dbus_interface_skeleton_get_connection(skeleton);
+    if (g_hash_table_size(self->priv->outstanding_properties) == 0 ||
+        connection == NULL) {
+        g_hash_table_remove_all(self->priv->outstanding_properties);
+        return;
+    }
 
     g_variant_builder_init(&changed_props, G_VARIANT_TYPE_VARDICT);
     g_variant_builder_init(&invalidated_props, G_VARIANT_TYPE_STRING_ARRAY);
@@ -185,7 +286,7 @@ gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
             g_variant_builder_add(&invalidated_props, "s", prop_name);
     }
 
-    g_dbus_connection_emit_signal(g_dbus_interface_skeleton_get_connection(skeleton),
+    g_dbus_connection_emit_signal(connection,
                                   NULL, /* bus name */
                                   g_dbus_interface_skeleton_get_object_path(skeleton),
                                   "org.freedesktop.DBus.Properties",
@@ -197,10 +298,6 @@ gjs_dbus_implementation_flush (GDBusInterfaceSkeleton *skeleton) {
                                    NULL /* error */);
 
     g_hash_table_remove_all(self->priv->outstanding_properties);
-    if (self->priv->idle_id) {
-        g_source_remove(self->priv->idle_id);
-        self->priv->idle_id = 0;
-    }
 }
 
 void
@@ -265,9 +362,11 @@ gjs_dbus_implementation_class_init(GjsDBusImplementationClass *klass) {
 
 static gboolean
 idle_cb (gpointer data) {
-    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (data);
+    GjsDBusImplementation *self = GJS_DBUS_IMPLEMENTATION (data);
 
-    g_dbus_interface_skeleton_flush(skeleton);
+    /* The source is destroyed when we return */
+    self->priv->idle_id = 0;
+    g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON (self));
     return FALSE;
 }
 
@@ -278,17 +377,98 @@ idle_cb (gpointer data) {
  * @newvalue: (allow-none): the new value, or %NULL to just invalidate it
  *
  * Queue a PropertyChanged signal for emission, or update the one queued
- * adding @property
+ * adding @property. All the changes queued until the next idle (or
+ * until the delay set with gjs_dbus_implementation_set_flush_delay()
+ * runs out) are sent in a single signal.
+ *
+ * @newvalue is ignored for properties that only emit invalidation, see
+ * gjs_dbus_implementation_set_property_invalidate_only(), and nothing
+ * is queued for properties annotated as not emitting PropertiesChanged.
  */
 void
 gjs_dbus_implementation_emit_property_changed (GjsDBusImplementation *self,
                                                gchar                 *property,
                                                GVariant              *newvalue)
 {
-    g_hash_table_replace (self->priv->outstanding_properties, g_strdup (property), g_variant_ref (newvalue));
+    GjsDBusImplementationPrivate *priv = self->priv;
+
+    switch (get_emit_mode(self, property)) {
+    case PROPERTY_EMITS_NOTHING:
+        return;
+    case PROPERTY_EMITS_INVALIDATION:
+        newvalue = NULL;
+        break;
+    case PROPERTY_EMITS_VALUE:
+        break;
+    }
+
+    g_hash_table_replace (priv->outstanding_properties, g_strdup (property),
+                          newvalue ? g_variant_ref_sink (newvalue) : NULL);
+
+    if (!priv->idle_id) {
+        if (priv->flush_delay == 0)
+            priv->idle_id = g_idle_add(idle_cb, self);
+        else
+            priv->idle_id = g_timeout_add(priv->flush_delay, idle_cb, self);
+    }
+}
+
+/**
+ * gjs_dbus_implementation_set_flush_delay:
+ * @self: a #GjsDBusImplementation
+ * @delay_ms: time to wait before sending queued property changes, in
+ *   milliseconds, or 0 to send them at the next idle
+ *
+ * Sets how long property changes are gathered before being sent in a
+ * single PropertiesChanged signal. The change only applies from the
+ * next batch. g_dbus_interface_skeleton_flush() sends the queued
+ * changes right away.
+ */
+void
+gjs_dbus_implementation_set_flush_delay (GjsDBusImplementation *self,
+                                         guint                  delay_ms)
+{
+    self->priv->flush_delay = delay_ms;
+}
+
+/**
+ * gjs_dbus_implementation_set_property_invalidate_only:
+ * @self: a #GjsDBusImplementation
+ * @property: the name of a property
+ * @invalidate_only: whether PropertiesChanged should only list
+ *   @property as invalidated
+ *
+ * Makes changes of @property send no value, so that clients fetch it
+ * only if they need it. This is meant for large values. It has the
+ * same effect as the "invalidates" value of the
+ * org.freedesktop.DBus.Property.EmitsChangedSignal annotation, which is
+ * also honored.
+ */
+void
+gjs_dbus_implementation_set_property_invalidate_only (GjsDBusImplementation *self,
+                                                      const gchar           *property,
+                                                      gboolean               invalidate_only)
+{
+    if (invalidate_only)
+        g_hash_table_replace(self->priv->property_modes, g_strdup(property),
+                             GINT_TO_POINTER(PROPERTY_EMITS_INVALIDATION));
+    else
+        g_hash_table_remove(self->priv->property_modes, property);
+}
 
-    if (!self->priv->idle_id)
-        self->priv->idle_id = g_idle_add(idle_cb, self);
+/**
+ * gjs_dbus_implementation_get_property_invalidate_only:
+ * @self: a #GjsDBusImplementation
+ * @property: the name of a property
+ *
+ * Returns: %TRUE if changes of @property are sent without their value,
+ *   or not sent at all
+ */
+gboolean
+gjs_dbus_implementation_get_property_invalidate_only (GjsDBusImplementation *self,
+                                                      const gchar           *property)
+{
+    return get_emit_mode(self, property) != PROPERTY_EMITS_VALUE;
 }
 
 /**
@@ -315,3 +495,31 @@ gjs_dbus_implementation_emit_signal (GjsDBusImplementation *self,
                                   parameters,
                                   NULL);
 }
+
+/**
+ * gjs_dbus_implementation_set_method_dispatch: (skip)
+ * @self: a #GjsDBusImplementation
+ * @func: (allow-none): function handling incoming method calls
+ * @user_data: data for @func
+ * @notify: (allow-none): destroy notify for @user_data
+ *
+ * Lets @func handle incoming method calls before the
+ * #GjsDBusImplementation::handle-method-call signal is emitted. If @func
+ * returns %TRUE, it took care of the invocation and the signal is not
+ * emitted at all.
+ */
+void
+gjs_dbus_implementation_set_method_dispatch (GjsDBusImplementation     *self,
+                                             GjsDBusMethodDispatchFunc  func,
+                                             gpointer                   user_data,
+                                             GDestroyNotify             notify)
+{
+    GjsDBusImplementationPrivate *priv = self->priv;
+
+    if (priv->dispatch_notify)
+        priv->dispatch_notify(priv->dispatch_data);
+
+    priv->dispatch_func = func;
+    priv->dispatch_data = user_data;
+    priv->dispatch_notify = notify;
+}
@@ -50,10 +50,20 @@ struct _GjsDBusImplementationClass {
     GDBusInterfaceSkeletonClass parent_class;
 };
 
+typedef gboolean (*GjsDBusMethodDispatchFunc) (GjsDBusImplementation *self,
+                                               const char            *method_name,
+                                               GVariant              *parameters,
+                                               GDBusMethodInvocation *invocation,
+                                               gpointer               user_data);
+
 GType                  gjs_dbus_implementation_get_type (void);
 
 void                   gjs_dbus_implementation_emit_property_changed (GjsDBusImplementation *self, gchar *property, GVariant *newvalue);
 void                   gjs_dbus_implementation_emit_signal           (GjsDBusImplementation *self, gchar *signal_name, GVariant *parameters);
+void                   gjs_dbus_implementation_set_method_dispatch   (GjsDBusImplementation *self, GjsDBusMethodDispatchFunc func, gpointer user_data, GDestroyNotify notify);
+void                   gjs_dbus_implementation_set_flush_delay       (GjsDBusImplementation *self, guint delay_ms);
+void                   gjs_dbus_implementation_set_property_invalidate_only (GjsDBusImplementation *self, const gchar *property, gboolean invalidate_only);
+gboolean               gjs_dbus_implementation_get_property_invalidate_only (GjsDBusImplementation *self, const gchar *property);
 
 G_END_DECLS
 
@@ -22,6 +22,7 @@
 var GLib = imports.gi.GLib;
 var GObject = imports.gi.GObject;
 var GjsPrivate = imports.gi.GjsPrivate;
+var Gi = imports._gi;
 var Lang = imports.lang;
 var Signals = imports.signals;
 var Gio;
@@ -37,20 +38,16 @@ function _signatureLength(sig) {
     return counter;
 }
 
-function _proxyInvoker(methodName, sync, inSignature, arg_array) {
+function _proxyInvoker(methodName, sync, inSignature, nInArgs, arg_array) {
     var replyFunc;
     var flags = 0;
     var cancellable = null;
 
-    /* Convert arg_array to a *real* array */
-    arg_array = Array.prototype.slice.call(arg_array);
-
     /* The default replyFunc only logs the responses */
     replyFunc = _logReply;
 
-    var signatureLength = inSignature.length;
-    var minNumberArgs = signatureLength;
-    var maxNumberArgs = signatureLength + 3;
+    var minNumberArgs = nInArgs;
+    var maxNumberArgs = nInArgs + 3;
 
     if (arg_array.length < minNumberArgs) {
         throw new Error("Not enough arguments passed for method: " + methodName +
@@ -61,9 +58,8 @@ function _proxyInvoker(methodName, sync, inSignature, arg_array) {
                         " + one callback and/or flags");
     }
 
-    while (arg_array.length > signatureLength) {
-        var argNum = arg_array.length - 1;
-        var arg = arg_array.pop();
+    for (var argNum = arg_array.length - 1; argNum >= nInArgs; argNum--) {
+        var arg = arg_array[argNum];
         if (typeof(arg) == "function" && !sync) {
             replyFunc = arg;
         } else if (typeof(arg) == "number") {
@@ -76,7 +72,10 @@ function _proxyInvoker(methodName, sync, inSignature, arg_array) {
         }
     }
 
-    var inVariant = new GLib.Variant('(' + inSignature.join('') + ')', arg_array);
+    /* Packing a tuple only looks at as many elements as it has items,
+     * so the arguments object can be passed as is, trailing callback,
+     * flags and cancellable included */
+    var inVariant = Gi.variant_pack(inSignature, arg_array);
 
     var asyncCallback = function (proxy, result) {
         var outVariant = null, succeeded = false;
@@ -114,18 +113,30 @@ function _logReply(result, exc) {
 }
 
 function _makeProxyMethod(method, sync) {
-    var i;
     var name = method.name;
     var inArgs = method.in_args;
-    var inSignature = [ ];
-    for (i = 0; i < inArgs.length; i++)
-        inSignature.push(inArgs[i].signature);
+    var inSignature = _makeTupleSignature(inArgs);
+    var nInArgs = inArgs.length;
 
     return function() {
-        return _proxyInvoker.call(this, name, sync, inSignature, arguments);
+        return _proxyInvoker.call(this, name, sync, inSignature, nInArgs, arguments);
     };
 }
 
+// The stubs don't depend on the proxy, so a wrapper made with
+// makeProxyWrapper() compiles them once and shares them between all
+// its proxies
+function _makeProxyMethods(info) {
+    var stubs = [ ];
+    var methods = info.methods;
+    for (var i = 0; i < methods.length; i++) {
+        stubs.push({ name: methods[i].name,
+                     remote: _makeProxyMethod(methods[i], false),
+                     sync: _makeProxyMethod(methods[i], true) });
+    }
+    return stubs;
+}
+
 function _convertToNativeSignal(proxy, sender_name, signal_name, parameters) {
     Signals._emit.call(proxy, signal_name, sender_name, parameters.deep_unpack());
 }
@@ -162,11 +173,10 @@ function _addDBusConvenience() {
     if (info.signals.length > 0)
         this.connect('g-signal', _convertToNativeSignal);
 
-    let i, methods = info.methods;
-    for (i = 0; i < methods.length; i++) {
-        var method = methods[i];
-        this[method.name + 'Remote'] = _makeProxyMethod(methods[i], false);
-        this[method.name + 'Sync'] = _makeProxyMethod(methods[i], true);
+    let i, stubs = this._dbusProxyMethods || _makeProxyMethods(info);
+    for (i = 0; i < stubs.length; i++) {
+        this[stubs[i].name + 'Remote'] = stubs[i].remote;
+        this[stubs[i].name + 'Sync'] = stubs[i].sync;
     }
 
     let properties = info.properties;
@@ -182,12 +192,14 @@ function _addDBusConvenience() {
 function _makeProxyWrapper(interfaceXml) {
     var info = _newInterfaceInfo(interfaceXml);
     var iname = info.name;
+    var stubs = _makeProxyMethods(info);
     return function(bus, name, object, asyncCallback, cancellable) {
         var obj = new Gio.DBusProxy({ g_connection: bus,
                                       g_interface_name: iname,
                                       g_interface_info: info,
                                       g_name: name,
                                       g_object_path: object });
+        Object.defineProperty(obj, '_dbusProxyMethods', { value: stubs });
         if (!cancellable)
             cancellable = null;
         if (asyncCallback)
@@ -261,7 +273,7 @@ function _wrapFunction(klass, method, addition) {
     }
 }
 
-function _makeOutSignature(args) {
+function _makeTupleSignature(args) {
     var ret = '(';
     for (var i = 0; i < args.length; i++)
         ret += args[i].signature;
@@ -269,7 +281,25 @@ function _makeOutSignature(args) {
     return ret + ')';
 }
 
-function _handleMethodCall(info, impl, method_name, parameters, invocation) {
+// Out signatures of the methods and signatures of the properties of an
+// exported interface, computed once when the object is wrapped
+function _makeSignatureTables(info) {
+    var i;
+    var methods = Object.create(null);
+    var properties = Object.create(null);
+
+    for (i = 0; i < info.methods.length; i++) {
+        let outArgs = info.methods[i].out_args;
+        methods[info.methods[i].name] = { outSignature: _makeTupleSignature(outArgs),
+                                          nOutArgs: outArgs.length };
+    }
+    for (i = 0; i < info.properties.length; i++)
+        properties[info.properties[i].name] = info.properties[i].signature;
+
+    return { methods: methods, properties: properties };
+}
+
+function _handleMethodCall(signatures, impl, method_name, parameters, invocation) {
     // prefer a sync version if available
     if (this[method_name]) {
         let retval;
@@ -295,15 +325,13 @@ function _handleMethodCall(info, impl, method_name, parameters, invocation) {
         try {
             if (!(retval instanceof GLib.Variant)) {
                 // attempt packing according to out signature
-                let methodInfo = info.lookup_method(method_name);
-                let outArgs = methodInfo.out_args;
-                let outSignature = _makeOutSignature(outArgs);
-                if (outArgs.length == 1) {
+                let methodSignature = signatures.methods[method_name];
+                if (methodSignature.nOutArgs == 1) {
                     // if one arg, we don't require the handler wrapping it
                     // into an Array
                     retval = [retval];
                 }
-                retval = new GLib.Variant(outSignature, retval);
+                retval = Gi.variant_pack(methodSignature.outSignature, retval);
             }
             invocation.return_value(retval);
         } catch(e) {
@@ -320,16 +348,15 @@ function _handleMethodCall(info, impl, method_name, parameters, invocation) {
     }
 }
 
-function _handlePropertyGet(info, impl, property_name) {
-    let propInfo = info.lookup_property(property_name);
+function _handlePropertyGet(signatures, impl, property_name) {
     let jsval = this[property_name];
     if (jsval != undefined)
-        return new GLib.Variant(propInfo.signature, jsval);
+        return Gi.variant_pack(signatures.properties[property_name], jsval);
     else
         return null;
 }
 
-function _handlePropertySet(info, impl, property_name, new_value) {
+function _handlePropertySet(signatures, impl, property_name, new_value) {
     this[property_name] = new_value.deep_unpack();
 }
 
@@ -340,18 +367,35 @@ function _wrapJSObject(interfaceInfo, jsObj) {
     else
         info = Gio.DBusInterfaceInfo.new_for_xml(interfaceInfo);
     info.cache_build();
+    var signatures = _makeSignatureTables(info);
 
     var impl = new GjsPrivate.DBusImplementation({ g_interface_info: info });
     impl.connect('handle-method-call', function(impl, method_name, parameters, invocation) {
-        return _handleMethodCall.call(jsObj, info, impl, method_name, parameters, invocation)
+        return _handleMethodCall.call(jsObj, signatures, impl, method_name, parameters, invocation)
     });
     impl.connect('handle-property-get', function(impl, property_name) {
-        return _handlePropertyGet.call(jsObj, info, impl, property_name);
+        return _handlePropertyGet.call(jsObj, signatures, impl, property_name);
     });
     impl.connect('handle-property-set', function(impl, property_name, value) {
-        return _handlePropertySet.call(jsObj, info, impl, property_name, value);
+        return _handlePropertySet.call(jsObj, signatures, impl, property_name, value);
     });
 
+    // Queues a change of property_name, to be sent along with the other
+    // changes of the same batch in a single PropertiesChanged. The value
+    // is packed with the signature of the property, unless the property
+    // only emits invalidation; leaving the value out only invalidates it
+    impl.queuePropertyChanged = function(property_name, value) {
+        let variant = null;
+        if (value !== undefined &&
+            !impl.get_property_invalidate_only(property_name))
+            variant = Gi.variant_pack(signatures.properties[property_name], value);
+        impl.emit_property_changed(property_name, variant);
+    };
+
+    // Calls to plain methods of jsObj skip the handle-method-call signal
+    if (GLib.getenv('GJS_DISABLE_DBUS_DIRECT_DISPATCH') === null)
+        Gi.dbus_implementation_set_dispatch(impl, jsObj);
+
     return impl;
 }
 
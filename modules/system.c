@@ -26,9 +26,11 @@
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <string.h>
 
 #include <gjs/gjs-module.h>
 #include <gi/object.h>
+#include <gjs/gc-scheduler.h>
 #include "system.h"
 
 static JSBool
@@ -106,6 +108,103 @@ gjs_gc(JSContext *context,
     return JS_TRUE;
 }
 
+static JSBool
+gjs_gc_hint(JSContext *context,
+            unsigned   argc,
+            jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    GjsGcScheduler *scheduler;
+    GjsGcHint hint;
+    char *name;
+
+    if (!gjs_parse_args(context, "gcHint", "s", argc, argv, "hint", &name))
+        return JS_FALSE;
+
+    if (strcmp(name, "paint-begin") == 0) {
+        hint = GJS_GC_HINT_PAINT_BEGIN;
+    } else if (strcmp(name, "paint-end") == 0) {
+        hint = GJS_GC_HINT_PAINT_END;
+    } else if (strcmp(name, "idle") == 0) {
+        hint = GJS_GC_HINT_IDLE;
+    } else {
+        gjs_throw(context, "Unknown GC hint '%s'", name);
+        g_free(name);
+        return JS_FALSE;
+    }
+    g_free(name);
+
+    scheduler = gjs_gc_scheduler_get(JS_GetRuntime(context));
+    if (scheduler != NULL)
+        gjs_gc_scheduler_hint(scheduler, hint);
+
+    JS_SET_RVAL(context, vp, JSVAL_VOID);
+    return JS_TRUE;
+}
+
+static JSBool
+define_number(JSContext  *context,
+              JSObject   *obj,
+              const char *name,
+              double      number)
+{
+    jsval value;
+
+    return JS_NewNumberValue(context, number, &value) &&
+        JS_DefineProperty(context, obj, name, value,
+                          NULL, NULL, JSPROP_ENUMERATE);
+}
+
+static JSBool
+gjs_gc_stats(JSContext *context,
+             unsigned   argc,
+             jsval     *vp)
+{
+    jsval *argv = JS_ARGV(cx, vp);
+    GjsGcScheduler *scheduler;
+    GjsGcStats stats;
+    JSObject *obj, *histogram;
+    jsval value;
+    int i;
+
+    if (!gjs_parse_args(context, "gcStats", "", argc, argv))
+        return JS_FALSE;
+
+    memset(&stats, 0, sizeof(stats));
+    scheduler = gjs_gc_scheduler_get(JS_GetRuntime(context));
+    if (scheduler != NULL)
+        gjs_gc_scheduler_get_stats(scheduler, &stats);
+
+    obj = JS_NewObject(context, NULL, NULL, NULL);
+    if (obj == NULL)
+        return JS_FALSE;
+    JS_SET_RVAL(context, vp, OBJECT_TO_JSVAL(obj));
+
+    /* pauses are in milliseconds; pauseHistogram[i] counts the slices
+     * shorter than 2^i ms, and the last element the longer ones */
+    if (!define_number(context, obj, "cycles", stats.n_cycles) ||
+        !define_number(context, obj, "slices", stats.n_slices) ||
+        !define_number(context, obj, "totalPause", stats.total_pause_us / 1000.0) ||
+        !define_number(context, obj, "maxPause", stats.max_pause_us / 1000.0))
+        return JS_FALSE;
+
+    histogram = JS_NewArrayObject(context, 0, NULL);
+    if (histogram == NULL)
+        return JS_FALSE;
+    value = OBJECT_TO_JSVAL(histogram);
+    if (!JS_DefineProperty(context, obj, "pauseHistogram", value,
+                           NULL, NULL, JSPROP_ENUMERATE))
+        return JS_FALSE;
+
+    for (i = 0; i < GJS_GC_PAUSE_BUCKETS; i++) {
+        if (!JS_NewNumberValue(context, stats.pause_histogram[i], &value) ||
+            !JS_SetElement(context, histogram, i, &value))
+            return JS_FALSE;
+    }
+
+    return JS_TRUE;
+}
+
 static JSBool
 gjs_exit(JSContext *context,
          unsigned   argc,
@@ -152,6 +251,18 @@ gjs_js_define_system_stuff(JSContext *context,
                            0, GJS_MODULE_PROP_FLAGS))
         return JS_FALSE;
 
+    if (!JS_DefineFunction(context, module,
+                           "gcHint",
+                           (JSNative) gjs_gc_hint,
+                           1, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
+    if (!JS_DefineFunction(context, module,
+                           "gcStats",
+                           (JSNative) gjs_gc_stats,
+                           0, GJS_MODULE_PROP_FLAGS))
+        return JS_FALSE;
+
     if (!JS_DefineFunction(context, module,
                            "exit",
                            (JSNative) gjs_exit,
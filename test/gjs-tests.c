@@ -22,9 +22,17 @@
  */
 
 #include <config.h>
+#include <string.h>
+#include <sys/types.h>
+#include <utime.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <glib-object.h>
 #include <gjs/gjs-module.h>
+#include <gi/object.h>
+#include <gi/arg.h>
+#include <gjs/script-cache.h>
+#include <girepository.h>
 #include <util/glib.h>
 #include <util/crash.h>
 
@@ -130,6 +138,49 @@ gjstest_test_func_gjs_jsapi_util_array(void)
 
 #undef N_ELEMS
 
+static void
+gjstest_test_func_gjs_runtime_value_stack(void)
+{
+    GjsUnitTestFixture fixture;
+    JSContext *context;
+    JSRuntime *runtime;
+    jsval *small, *large;
+    char *ascii;
+    int i;
+
+    _gjs_unit_test_fixture_begin(&fixture);
+    context = fixture.context;
+    runtime = fixture.runtime;
+
+    small = gjs_runtime_push_values(runtime, 3);
+    g_assert(JSVAL_IS_VOID(small[0]));
+    small[1] = STRING_TO_JSVAL(JS_NewStringCopyZ(context, "abcdefghijk"));
+
+    /* Doesn't fit in what's left of the first chunk */
+    large = gjs_runtime_push_values(runtime, 1000);
+    for (i = 0; i < 1000; i++)
+        large[i] = STRING_TO_JSVAL(JS_NewStringCopyZ(context, "lmnopqrstuv"));
+
+    JS_GC(runtime);
+
+    gjs_string_to_utf8(context, small[1], &ascii);
+    g_assert_cmpstr(ascii, ==, "abcdefghijk");
+    g_free(ascii);
+    gjs_string_to_utf8(context, large[999], &ascii);
+    g_assert_cmpstr(ascii, ==, "lmnopqrstuv");
+    g_free(ascii);
+
+    gjs_runtime_pop_values(runtime, large, 1000);
+
+    /* The freed chunk is reused */
+    g_assert(gjs_runtime_push_values(runtime, 1000) == large);
+    gjs_runtime_pop_values(runtime, large, 1000);
+
+    gjs_runtime_pop_values(runtime, small, 3);
+
+    _gjs_unit_test_fixture_finish(&fixture);
+}
+
 static void
 gjstest_test_func_gjs_jsapi_util_string_js_string_utf8(void)
 {
@@ -230,6 +281,327 @@ gjstest_test_func_gjs_jsapi_util_error_throw(void)
     _gjs_unit_test_fixture_finish(&fixture);
 }
 
+static void
+gjstest_test_func_gjs_mem_boxed_payload(void)
+{
+    guint8 *block, *reused, *large;
+    guint live;
+
+    live = GJS_GET_COUNTER(boxed_payload);
+
+    block = gjs_boxed_payload_alloc0(24);
+    g_assert(block != NULL);
+    g_assert_cmpuint(GJS_GET_COUNTER(boxed_payload), ==, live + 1);
+    memset(block, 0xff, 24);
+    gjs_boxed_payload_free(24, block);
+    g_assert_cmpuint(GJS_GET_COUNTER(boxed_payload), ==, live);
+
+    /* Same size class, so the freed block is handed out again, zeroed */
+    reused = gjs_boxed_payload_alloc0(20);
+    g_assert(reused == block);
+    g_assert_cmpuint(reused[0], ==, 0);
+    g_assert_cmpuint(reused[19], ==, 0);
+    gjs_boxed_payload_free(20, reused);
+
+    large = gjs_boxed_payload_alloc0(4096);
+    g_assert(large != NULL);
+    g_assert_cmpuint(large[4095], ==, 0);
+    gjs_boxed_payload_free(4096, large);
+
+    /* Zero-size structs get no memory and mustn't be counted */
+    g_assert(gjs_boxed_payload_alloc0(0) == NULL);
+    g_assert_cmpuint(GJS_GET_COUNTER(boxed_payload), ==, live);
+    gjs_boxed_payload_free(0, NULL);
+
+    g_assert_cmpuint(GJS_GET_COUNTER(boxed_payload), ==, live);
+}
+
+#define N_GC_STRESS_THREADS 4
+#define N_GC_STRESS_ITERATIONS 20000
+
+typedef struct {
+    volatile gint in_gc;
+    volatile gint n_blocked;
+    volatile gint n_finished;
+} GcStressData;
+
+static gpointer
+gc_block_stress_thread(gpointer user_data)
+{
+    GcStressData *data = user_data;
+    int i;
+
+    for (i = 0; i < N_GC_STRESS_ITERATIONS; i++) {
+        if (i % 2 == 0) {
+            if (!gjs_try_block_gc())
+                continue;
+        } else {
+            gjs_block_gc();
+        }
+
+        g_atomic_int_inc(&data->n_blocked);
+        g_assert(!g_atomic_int_get(&data->in_gc));
+        g_atomic_int_add(&data->n_blocked, -1);
+
+        gjs_unblock_gc();
+    }
+
+    g_atomic_int_inc(&data->n_finished);
+    return NULL;
+}
+
+static void
+gjstest_test_func_gjs_gc_block_stress(void)
+{
+    GcStressData data = { 0, 0, 0 };
+    GThread *threads[N_GC_STRESS_THREADS];
+    int i;
+
+    for (i = 0; i < N_GC_STRESS_THREADS; i++)
+        threads[i] = g_thread_new("gc-block-stress", gc_block_stress_thread, &data);
+
+    while (g_atomic_int_get(&data.n_finished) < N_GC_STRESS_THREADS) {
+        gjs_enter_gc();
+        g_atomic_int_set(&data.in_gc, TRUE);
+        g_assert_cmpint(g_atomic_int_get(&data.n_blocked), ==, 0);
+        g_thread_yield();
+        g_atomic_int_set(&data.in_gc, FALSE);
+        gjs_leave_gc();
+    }
+
+    for (i = 0; i < N_GC_STRESS_THREADS; i++)
+        g_thread_join(threads[i]);
+
+    /* Nothing may be left blocking the GC */
+    gjs_enter_gc();
+    gjs_leave_gc();
+    g_assert(gjs_try_block_gc());
+    gjs_unblock_gc();
+}
+
+typedef struct {
+    GObject *gobj;
+    volatile gint n_finished;
+} ToggleStressData;
+
+static gpointer
+toggle_ref_stress_thread(gpointer user_data)
+{
+    ToggleStressData *data = user_data;
+    int i;
+
+    for (i = 0; i < N_GC_STRESS_ITERATIONS; i++) {
+        g_object_ref(data->gobj);
+        g_object_unref(data->gobj);
+    }
+
+    g_atomic_int_inc(&data->n_finished);
+    return NULL;
+}
+
+static void
+gjstest_test_func_gjs_gc_toggle_ref_stress(void)
+{
+    GjsUnitTestFixture fixture;
+    JSContext *context;
+    JSObject *global;
+    ToggleStressData data = { NULL, 0 };
+    GThread *threads[N_GC_STRESS_THREADS];
+    jsval value;
+    int estatus, i;
+    GError *error = NULL;
+
+    _gjs_unit_test_fixture_begin(&fixture);
+    context = fixture.context;
+
+    if (!gjs_context_eval(fixture.gjs_context,
+                          "var obj = new imports.gi.GObject.Object();",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+
+    global = JS_GetGlobalObject(context);
+    g_assert(JS_GetProperty(context, global, "obj", &value));
+    g_assert(JSVAL_IS_OBJECT(value));
+    data.gobj = gjs_g_object_from_object(context, JSVAL_TO_OBJECT(value));
+    g_assert(G_IS_OBJECT(data.gobj));
+
+    /* Other threads push the wrapper across the toggle boundary,
+     * queueing notifications, while this one collects garbage, handles
+     * the queue and toggles the object directly.
+     */
+    for (i = 0; i < N_GC_STRESS_THREADS; i++)
+        threads[i] = g_thread_new("toggle-ref-stress", toggle_ref_stress_thread, &data);
+
+    while (g_atomic_int_get(&data.n_finished) < N_GC_STRESS_THREADS) {
+        gjs_context_gc(fixture.gjs_context);
+        g_object_ref(data.gobj);
+        g_object_unref(data.gobj);
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+    }
+
+    for (i = 0; i < N_GC_STRESS_THREADS; i++)
+        g_thread_join(threads[i]);
+
+    gjs_object_process_pending_toggles();
+    gjs_context_gc(fixture.gjs_context);
+
+    /* The wrapper must still be alive and attached to the same object */
+    g_assert(JS_GetProperty(context, global, "obj", &value));
+    g_assert(gjs_g_object_from_object(context, JSVAL_TO_OBJECT(value)) == data.gobj);
+    g_assert(G_IS_OBJECT(data.gobj));
+
+    _gjs_unit_test_fixture_finish(&fixture);
+}
+
+static void
+gjstest_test_func_gi_arg_bytes_transfer_none(void)
+{
+    GjsUnitTestFixture fixture;
+    JSContext *context;
+    JSObject *global;
+    GIBaseInfo *bytes_info;
+    GIFunctionInfo *new_info;
+    GITypeInfo *type_info;
+    GArgument arg;
+    const guint8 *data;
+    gsize len;
+    jsval value, elem;
+    int estatus;
+    GError *error = NULL;
+
+    _gjs_unit_test_fixture_begin(&fixture);
+    context = fixture.context;
+
+    if (!gjs_context_eval(fixture.gjs_context,
+                          "imports.gi.GLib;\n"
+                          "var array = imports.byteArray.fromString('abc');\n",
+                          -1, "<input>", &estatus, &error))
+        g_error("%s", error->message);
+
+    bytes_info = g_irepository_find_by_name(NULL, "GLib", "Bytes");
+    g_assert(bytes_info != NULL);
+    new_info = g_struct_info_find_method((GIStructInfo *) bytes_info, "new");
+    g_assert(new_info != NULL);
+    type_info = g_callable_info_get_return_type((GICallableInfo *) new_info);
+
+    global = JS_GetGlobalObject(context);
+    g_assert(JS_GetProperty(context, global, "array", &value));
+
+    /* What a callback or vfunc returning a ByteArray as GBytes does;
+     * C code may then keep the GBytes after the ByteArray is gone.
+     */
+    g_assert(gjs_value_to_g_argument(context, value, type_info, "callback",
+                                     GJS_ARGUMENT_RETURN_VALUE,
+                                     GI_TRANSFER_NOTHING, TRUE, &arg));
+    g_assert(arg.v_pointer != NULL);
+
+    /* Writing to the ByteArray takes its own copy of the data */
+    elem = INT_TO_JSVAL('x');
+    g_assert(JS_SetElement(context, JSVAL_TO_OBJECT(value), 0, &elem));
+    g_assert(JS_DeleteProperty(context, global, "array"));
+    gjs_context_gc(fixture.gjs_context);
+
+    data = g_bytes_get_data(arg.v_pointer, &len);
+    g_assert_cmpuint(len, ==, 3);
+    g_assert(memcmp(data, "abc", 3) == 0);
+    g_bytes_unref(arg.v_pointer);
+
+    g_base_info_unref((GIBaseInfo *) type_info);
+    g_base_info_unref((GIBaseInfo *) new_info);
+    g_base_info_unref(bytes_info);
+
+    _gjs_unit_test_fixture_finish(&fixture);
+}
+
+static int
+run_script_file(JSContext  *context,
+                const char *filename)
+{
+    JSObject *global;
+    JSScript *script;
+    GError *error = NULL;
+    jsval rval;
+
+    global = JS_GetGlobalObject(context);
+    script = gjs_script_cache_compile_file(context, global, filename, &error);
+    g_assert_no_error(error);
+    g_assert(script != NULL);
+    g_assert(JS_ExecuteScript(context, global, script, &rval));
+    g_assert(JSVAL_IS_INT(rval));
+
+    return JSVAL_TO_INT(rval);
+}
+
+static void
+gjstest_test_func_gjs_script_cache(void)
+{
+    GjsUnitTestFixture fixture;
+    JSContext *context;
+    GError *error = NULL;
+    GStatBuf source_stat, cache_stat;
+    struct utimbuf times;
+    char *dir, *filename, *cache_path;
+    ino_t cache_ino;
+
+    if (g_getenv("GJS_DISABLE_SCRIPT_CACHE") != NULL)
+        return;
+
+    _gjs_unit_test_fixture_begin(&fixture);
+    context = fixture.context;
+
+    dir = g_dir_make_tmp("gjs-script-cache-XXXXXX", &error);
+    g_assert_no_error(error);
+    filename = g_build_filename(dir, "script.js", NULL);
+    cache_path = gjs_script_cache_get_path(filename);
+
+    /* The first run compiles the source and writes the cache file */
+    g_assert(g_file_set_contents(filename, "1 + 1", -1, &error));
+    g_assert_cmpint(run_script_file(context, filename), ==, 2);
+    g_assert(g_stat(cache_path, &cache_stat) == 0);
+    cache_ino = cache_stat.st_ino;
+
+    /* A cache hit leaves the file alone; it is only ever replaced by a
+     * new one, never rewritten in place.
+     */
+    g_assert_cmpint(run_script_file(context, filename), ==, 2);
+    g_assert(g_stat(cache_path, &cache_stat) == 0);
+    g_assert(cache_stat.st_ino == cache_ino);
+
+    /* An edit keeping the size and modification time still invalidates
+     * the cache, like one made within the same second would.
+     */
+    g_assert(g_stat(filename, &source_stat) == 0);
+    g_assert(g_file_set_contents(filename, "2 + 2", -1, &error));
+    times.actime = source_stat.st_atime;
+    times.modtime = source_stat.st_mtime;
+    g_assert(g_utime(filename, &times) == 0);
+
+    g_assert_cmpint(run_script_file(context, filename), ==, 4);
+    g_assert(g_stat(cache_path, &cache_stat) == 0);
+    g_assert(cache_stat.st_ino != cache_ino);
+
+    /* A corrupted cache file is discarded and written again */
+    g_assert(g_file_set_contents(cache_path, "garbage", -1, &error));
+    g_assert_cmpint(run_script_file(context, filename), ==, 4);
+    g_assert(g_stat(cache_path, &cache_stat) == 0);
+    g_assert_cmpint(cache_stat.st_size, >, strlen("garbage"));
+    cache_ino = cache_stat.st_ino;
+
+    g_assert_cmpint(run_script_file(context, filename), ==, 4);
+    g_assert(g_stat(cache_path, &cache_stat) == 0);
+    g_assert(cache_stat.st_ino == cache_ino);
+
+    g_unlink(cache_path);
+    g_unlink(filename);
+    g_rmdir(dir);
+    g_free(cache_path);
+    g_free(filename);
+    g_free(dir);
+
+    _gjs_unit_test_fixture_finish(&fixture);
+}
+
 static void
 gjstest_test_func_util_glib_strv_concat_null(void)
 {
@@ -279,9 +651,15 @@ main(int    argc,
     g_test_add_func("/gjs/context/construct/destroy", gjstest_test_func_gjs_context_construct_destroy);
     g_test_add_func("/gjs/context/construct/eval", gjstest_test_func_gjs_context_construct_eval);
     g_test_add_func("/gjs/jsapi/util/array", gjstest_test_func_gjs_jsapi_util_array);
+    g_test_add_func("/gjs/runtime/value-stack", gjstest_test_func_gjs_runtime_value_stack);
     g_test_add_func("/gjs/jsapi/util/error/throw", gjstest_test_func_gjs_jsapi_util_error_throw);
     g_test_add_func("/gjs/jsapi/util/string/js/string/utf8", gjstest_test_func_gjs_jsapi_util_string_js_string_utf8);
     g_test_add_func("/gjs/stack/dump", gjstest_test_func_gjs_stack_dump);
+    g_test_add_func("/gjs/mem/boxed/payload", gjstest_test_func_gjs_mem_boxed_payload);
+    g_test_add_func("/gjs/gc/block/stress", gjstest_test_func_gjs_gc_block_stress);
+    g_test_add_func("/gjs/gc/toggle-ref/stress", gjstest_test_func_gjs_gc_toggle_ref_stress);
+    g_test_add_func("/gjs/script-cache", gjstest_test_func_gjs_script_cache);
+    g_test_add_func("/gi/arg/bytes/transfer-none", gjstest_test_func_gi_arg_bytes_transfer_none);
     g_test_add_func("/util/glib/strv/concat/null", gjstest_test_func_util_glib_strv_concat_null);
     g_test_add_func("/util/glib/strv/concat/pointers", gjstest_test_func_util_glib_strv_concat_pointers);
 